@@ -0,0 +1,45 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory>
+#include <vector>
+
+using std::unique_ptr;
+using std::vector;
+
+//
+// Bump allocator handing out contiguous runs of T from large blocks.
+// Nothing is freed individually and pointers stay valid until clear().
+//
+template <typename T>
+class arena {
+public:
+    arena(size_t block_size = 4096) : block_size_(block_size) {}
+
+    T* allocate(size_t n)
+    {
+        if (blocks_.empty() || used_ + n > capacity_) {
+            capacity_ = n > block_size_ ? n : block_size_;
+            blocks_.push_back(unique_ptr<T[]>(new T[capacity_]));
+            used_ = 0;
+        }
+        T* p = blocks_.back().get() + used_;
+        used_ += n;
+        return p;
+    }
+
+    void clear()
+    {
+        blocks_.clear();
+        used_ = 0;
+        capacity_ = 0;
+    }
+
+private:
+    vector<unique_ptr<T[]>> blocks_;
+    size_t block_size_;
+    size_t used_ = 0;
+    size_t capacity_ = 0;
+};
+
+#endif
\ No newline at end of file
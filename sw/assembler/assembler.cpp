@@ -0,0 +1,935 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "token.h"
+#include "lexer.h"
+#include "macro.h"
+#include "symbol.h"
+#include "symbol_table.h"
+#include "source_cache.h"
+#include "expression.h"
+#include "macro_cache.h"
+#include "statistics.h"
+#include "image.h"
+#include "prelude.h"
+#include "assembler.h"
+
+using std::endl;
+using std::ostream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Thrown by fail() to unwind to assemble() once the message is written.
+//
+class assembly_error {};
+
+static bool check_for_char(char c, size_t& offset, const token* tokens)
+{
+    if (tokens[offset].is_punct(c)) {
+        offset++;
+        return true;
+    }
+    return false;
+}
+
+assembler::assembler(
+    source_cache& sources,
+    const prelude* p,
+    bool one_pass) :
+        sources_(sources), prelude_(p), one_pass_(one_pass),
+        symbol_table_(sources.names()), native_(sources.names())
+{
+    pass_ = 0;
+    max_dot_ = 0;
+    in_prelude_ = false;
+    statement_ = NULL;
+    stats_ = NULL;
+    line_map_ = NULL;
+    map_statement_ = NULL;
+    map_frame_ = -1;
+}
+
+bool assembler::assemble(
+    const string& filename)
+{
+    int file = sources_.open(filename);
+    if (file < 0) {
+        error_ = "unable to open " + filename + "\n";
+        return false;
+    }
+    return assemble(file);
+}
+
+//
+// In one-pass mode labels are defined while bytes are emitted and forward
+// references are patched at the end instead of rescanning.
+//
+bool assembler::assemble(
+    int file)
+{
+    message_.str("");
+    error_.clear();
+
+    try {
+        const token* tokens = get_tokens(file);
+
+        symbol_table_ = symbol_table(sources_.names());
+        if (prelude_ != NULL) {
+            symbol_table_.copy_symbols(prelude_->symbols());
+        }
+        expressions_.clear();
+        fixups_.clear();
+        if (stats_ != NULL) {
+            stats_->files_++;
+        }
+
+        start_pass(1, file);
+        scan(tokens);
+        end_phase();
+
+        if (one_pass_) {
+            begin_phase("fixups");
+            resolve_fixups();
+            end_phase();
+        } else {
+            start_pass(2, file);
+            scan(tokens);
+            end_phase();
+        }
+        image_.compact();
+    } catch (assembly_error&) {
+        error_ = message_.str();
+        return false;
+    }
+    return true;
+}
+
+bool assembler::assemble_prelude(
+    int file)
+{
+    message_.str("");
+    error_.clear();
+
+    try {
+        const token* tokens = get_tokens(file);
+
+        symbol_table_ = symbol_table(sources_.names());
+        start_pass(1, file);
+        in_prelude_ = true;
+        scan(tokens);
+        in_prelude_ = false;
+        end_phase();
+
+        if (max_dot_ != 0) {
+            message_ << "prelude " << sources_.name(file)
+                    << " assembles bytes" << endl;
+            fail();
+        }
+    } catch (assembly_error&) {
+        in_prelude_ = false;
+        error_ = message_.str();
+        return false;
+    }
+    return true;
+}
+
+void assembler::start_pass(
+    int pass,
+    int file)
+{
+    symbol_table_.dot() = symbol(0);
+    symbol_table_.initialize_macros();
+    max_dot_ = 0;
+    pass_ = pass;
+    image_.clear();
+    macro_cache_.clear();
+    native_.clear();
+    statement_ = NULL;
+    expansions_.clear();
+    if (line_map_ != NULL) {
+        line_map_->clear();
+        map_files_.clear();
+        map_statement_ = NULL;
+        map_calls_.clear();
+    }
+
+    included_.clear();
+    if (prelude_ != NULL) {
+        included_ = prelude_->files();
+    }
+    included_.push_back(file);
+    begin_phase("pass " + std::to_string(pass));
+}
+
+void assembler::begin_phase(
+    const string& name)
+{
+    if (stats_ != NULL) {
+        stats_->begin_phase(name, { symbol_table_.lookups(),
+                symbol_table_.lookup_misses(), macro_cache_.hits(),
+                macro_cache_.misses() });
+    }
+}
+
+void assembler::end_phase()
+{
+    if (stats_ != NULL) {
+        stats_->end_phase({ symbol_table_.lookups(),
+                symbol_table_.lookup_misses(), macro_cache_.hits(),
+                macro_cache_.misses() });
+    }
+}
+
+const token* assembler::get_tokens(
+    int file)
+{
+    string error;
+    const token* tokens = sources_.tokens(file, error);
+    if (tokens == NULL) {
+        message_ << error << endl;
+        fail();
+    }
+    symbol_table_.grow();
+    return tokens;
+}
+
+void assembler::fail()
+{
+    throw assembly_error();
+}
+
+void assembler::print_location(
+    int file,
+    int line)
+{
+    if (file >= 0) {
+        message_ << sources_.name(file) << ":" << line << ": ";
+    }
+}
+
+//
+// Starts an error message with the location of t, preceded by the macro
+// calls that led to it.
+//
+ostream& assembler::diagnostic(const token& t)
+{
+    for (auto const& e : expansions_) {
+        print_location(e.call_->file_, e.call_->line_);
+        message_ << "in expansion of macro " << e.call_->text_ << endl;
+    }
+    print_location(t.file_, t.line_);
+    return message_;
+}
+
+ostream& assembler::diagnostic()
+{
+    if (statement_ == NULL) {
+        return message_;
+    }
+    return diagnostic(*statement_);
+}
+
+void assembler::read_macro(
+    size_t& offset,
+    const token* tokens)
+{
+    macro_cache_.rule_out();
+    if (tokens[offset].type_ != token::SYMBOL) {
+        diagnostic(tokens[offset]) << "expected name following .macro"
+                << endl;
+        fail();
+    }
+
+    int macro_name = symbol_table_.get_symbol(tokens[offset++]);
+    vector<int> macro_params;
+
+    //
+    // See if parenthesized list follows. If it does, each entry should be
+    // a symbol.
+    //
+    if (check_for_char('(', offset, tokens)) {
+        while (true) {
+            if (check_for_char(')', offset, tokens)) {
+                break;
+            }
+
+            if (tokens[offset].type_ == token::END) {
+                diagnostic(tokens[offset])
+                        << "expected ')' in macro definition" << endl;
+                fail();
+            }
+
+            if (tokens[offset].type_ != token::SYMBOL) {
+                diagnostic(tokens[offset])
+                        << "symbol expected in macro parameter list" << endl;
+                fail();
+            }
+
+            macro_params.push_back(
+                    symbol_table_.get_symbol(tokens[offset++]));
+            check_for_char(',', offset, tokens);
+        }
+    }
+
+    //
+    // Read the body of the macro. A body in braces may start on the next
+    // line and span several lines, otherwise it ends with the line.
+    //
+    size_t start = offset;
+    while (tokens[start].type_ == token::EOL) {
+        start++;
+    }
+
+    size_t end;
+    if (check_for_char('{', start, tokens)) {
+        offset = start;
+        for (end = offset; tokens[end].type_ != token::END; ++end) {
+            if (tokens[end].is_punct('}')) {
+                break;
+            }
+        }
+    } else {
+        for (end = offset; !tokens[end].is_eol(); ++end);
+    }
+
+    size_t body_start = offset;
+    offset = tokens[end].type_ == token::END ? end : end + 1;
+
+    if (!symbol_table_.add_macro(macro_name, macro_params,
+            &tokens[body_start], end - body_start)) {
+        diagnostic() << "failed to add macro "
+                << symbol_table_.name(macro_name) << endl;
+        fail();
+    }
+}
+
+void assembler::scan(
+    const token* tokens)
+{
+    size_t offset = 0;
+    if (stats_ != NULL) {
+        stats_->count_scan();
+    }
+
+    while (tokens[offset].type_ != token::END) {
+        if (tokens[offset].type_ == token::EOL) {
+            offset++;
+            continue;
+        }
+
+        const token& t = tokens[offset];
+        statement_ = &t;
+        if (t.type_ == token::SYMBOL) {
+            const token& next = tokens[offset + 1];
+
+            switch (t.value_) {
+                case token::MACRO:
+                    offset++;
+                    read_macro(offset, tokens);
+                    continue;
+                case token::ALIGN: {
+                    operand align = 4;
+                    offset++;
+                    bool constant = tokens[offset].is_eol()
+                            || (tokens[offset].type_ == token::NUMBER
+                                && tokens[offset + 1].is_eol());
+                    if (!tokens[offset].is_eol()) {
+                        read_expression(offset, tokens, align);
+                    }
+                    if (align.is_pending()) {
+                        diagnostic() << "forward reference in .align" << endl;
+                        fail();
+                    }
+                    if (align.value_ <= 0) {
+                        diagnostic() << "bad .align" << endl;
+                        fail();
+                    }
+                    if (constant) {
+                        macro_cache_.record_align(align.value_);
+                    } else {
+                        macro_cache_.rule_out();
+                    }
+                    int dot = symbol_table_.dot().value_;
+                    if (dot >= 0) {
+                        assemble_zeros((align.value_ - dot % align.value_)
+                                % align.value_);
+                        continue;
+                    }
+                    while ((symbol_table_.dot().value_ % align.value_) != 0) {
+                        assemble_byte(0);
+                    }
+                    continue;
+                }
+                case token::TEXT:
+                    macro_cache_.record_align(4);
+                    offset++;
+                    assemble_string(offset, tokens);
+                    assemble_byte(0);
+                    while (symbol_table_.dot().value_ % 4 != 0) {
+                        assemble_byte(0);
+                    }
+                    continue;
+                case token::ASCII:
+                    offset++;
+                    assemble_string(offset, tokens);
+                    continue;
+                case token::INCLUDE:
+                    offset++;
+                    include_file(offset, tokens);
+                    continue;
+            }
+
+            if (next.is_punct(':')) {
+                offset += 2;
+                assign_label(symbol_table_.get_symbol(t));
+                continue;
+            } else if (next.is_punct('=')) {
+                offset += 2;
+                assign_value(offset, tokens, symbol_table_.get_symbol(t));
+                continue;
+            }
+        }
+
+        //
+        // This is not a special form, so read operands and place their
+        // value into memory.
+        //
+        while (!tokens[offset].is_eol()) {
+            read_operand(offset, tokens);
+            check_for_char(',', offset, tokens);
+        }
+    }
+}
+
+void assembler::assign_value(
+    size_t& offset,
+    const token* tokens,
+    int symbol_id)
+{
+    macro_cache_.rule_out();
+    operand v;
+    if (read_expression(offset, tokens, v)) {
+        symbol& s = symbol_table_[symbol_id];
+        if (s.type_ == symbol::LABEL) {
+            diagnostic() << "illegal redefinition of symbol "
+                    << symbol_table_.name(symbol_id) << endl;
+            fail();
+        } else if (symbol_id == symbol_table::DOT && v.is_pending()) {
+            diagnostic() << "forward reference in assignment to ." << endl;
+            fail();
+        } else {
+            s.type_ = symbol::ASSIGN;
+            s.value_ = v.value_;
+            s.expr_ = v.expr_;
+            if (symbol_id == symbol_table::DOT && v.value_ > max_dot_) {
+                max_dot_ = v.value_;
+            }
+        }
+    }
+}
+
+void assembler::assign_label(
+    int symbol_id)
+{
+    macro_cache_.rule_out();
+    symbol& s = symbol_table_[symbol_id];
+    int dot = symbol_table_.dot().value_;
+    if (pass_ == 1) {
+        if (s.type_ != symbol::UNDEF) {
+            diagnostic() << "multiply defined symbol "
+                    << symbol_table_.name(symbol_id) << endl;
+            fail();
+        } else {
+            s.type_ = symbol::LABEL;
+            s.value_ = dot;
+        }
+    } else {
+        if (s.value_ != dot) {
+            diagnostic() << "phase error in symbol definition "
+                    << symbol_table_.name(symbol_id) << endl;
+            fail();
+        }
+    }
+}
+
+//
+// In one-pass mode a symbol that is not defined yet reads as a pending
+// expression which is evaluated once the whole source has been scanned.
+//
+operand assembler::read_symbol_value(
+    size_t& offset,
+    const token* tokens)
+{
+    int id = symbol_table_.get_symbol(tokens[offset++]);
+    symbol& s = symbol_table_[id];
+    if (macro_cache_.recording()) {
+        macro_cache_.record_symbol(id, s);
+    }
+
+    if (s.type_ == symbol::UNDEF) {
+        if (one_pass_ && !in_prelude_) {
+            return expressions_.make_symbol(id);
+        } else if (pass_ == 2 || in_prelude_) {
+            diagnostic(tokens[offset - 1]) << "undefined symbol "
+                    << symbol_table_.name(id) << endl;
+            message_ << symbol_table_;
+            fail();
+        }
+    }
+    return operand(s.value_, s.expr_);
+}
+
+bool assembler::read_term(
+    size_t& offset,
+    const token* tokens,
+    operand& result)
+{
+    const token& t = tokens[offset];
+
+    if (t.type_ == token::NUMBER) {
+        result = t.value_;
+        offset++;
+    } else if (t.type_ == token::SYMBOL) {
+        result = read_symbol_value(offset, tokens);
+    } else if (t.is_punct('-')) {
+        offset++;
+        read_term(offset, tokens, result);
+        result = expressions_.apply(expression::NEGATE, result);
+    } else if (t.is_punct('~')) {
+        offset++;
+        read_term(offset, tokens, result);
+        result = expressions_.apply(expression::INVERT, result);
+    } else if (t.is_punct('(')) {
+        offset++;
+        if (read_expression(offset, tokens, result)) {
+            if (!tokens[offset].is_punct(')')) {
+                diagnostic(tokens[offset])
+                        << "unbalanced parenthesis in expression" << endl;
+                fail();
+            } else {
+                offset++;
+            }
+        }
+    } else {
+        diagnostic(tokens[offset])
+                << "illegal term in expression " << tokens[offset] << endl;
+        fail();
+    }
+
+    return true;
+}
+
+bool assembler::read_expression(
+    size_t& offset,
+    const token* tokens,
+    operand& result)
+{
+    operand term;
+    expression::op_type op;
+    bool valid = read_term(offset, tokens, result);
+
+    while (valid) {
+        const token& t = tokens[offset];
+        if (t.type_ != token::PUNCT) {
+            break;
+        }
+
+        offset++;
+        switch (t.value_) {
+            case '+': op = expression::ADD; break;
+            case '-': op = expression::SUB; break;
+            case '*': op = expression::MUL; break;
+            case '/': op = expression::DIV; break;
+            case '%': op = expression::MOD; break;
+            case '>':
+                if (check_for_char('>', offset, tokens)) {
+                    op = expression::SHR;
+                    break;
+                }
+                offset--;
+                goto exit;
+            case '<':
+                if (check_for_char('<', offset, tokens)) {
+                    op = expression::SHL;
+                    break;
+                }
+                offset--;
+                goto exit;
+            default:
+                offset--;
+                goto exit;
+        }
+
+        if ((valid = read_term(offset, tokens, term))) {
+            //
+            // A symbol not yet defined in pass 1 reads as 0, so dividing
+            // by it is only an error once its value is known.
+            //
+            if (!term.is_pending() && (one_pass_ || pass_ == 2 || in_prelude_)
+                    && expression::divides_by_zero(op, term.value_)) {
+                diagnostic() << "division by zero" << endl;
+                fail();
+            }
+            result = expressions_.apply(op, result, term);
+        }
+    }
+
+    exit:
+    return valid;
+}
+
+void assembler::get_macro_info(
+    size_t& offset,
+    const token* tokens,
+    int macro_symbol,
+    vector<operand>& macro_args,
+    macro*& m)
+{
+    while (true) {
+        if (check_for_char(')', offset, tokens)) {
+            break;
+        }
+        check_for_char(',', offset, tokens);
+        operand v;
+        if (read_expression(offset, tokens, v)) {
+            macro_args.push_back(v);
+        } else {
+            diagnostic(tokens[offset])
+                    << "expression or close paren expected" << endl;
+            fail();
+        }
+    }
+
+    if (symbol_table_.get_macro(macro_symbol, macro_args.size(), &m)) {
+        for (auto const& e : expansions_) {
+            if (e.macro_ == m) {
+                diagnostic() << "recursive call to macro "
+                        << symbol_table_.name(macro_symbol) << endl;
+                fail();
+            }
+        }
+    } else {
+        diagnostic() << "can't find macro definition for "
+                << symbol_table_.name(macro_symbol)
+                << " with " << macro_args.size()
+                << " arguments" << endl;
+        fail();
+    }
+}
+
+void assembler::read_operand(
+    size_t& offset,
+    const token* tokens)
+{
+    const token& t = tokens[offset];
+
+    if (t.type_ == token::SYMBOL && tokens[offset + 1].is_punct('(')) {
+        offset += 2;
+        statement_ = &t;
+        vector<operand> macro_args;
+        macro *m = NULL;
+        get_macro_info(offset, tokens, symbol_table_.get_symbol(t),
+                macro_args, m);
+        call_macro(macro_args, m);
+        return;
+    }
+
+    operand v;
+    if (read_expression(offset, tokens, v)) {
+        assemble_byte(v);
+    } else {
+        diagnostic(tokens[offset]) << "illegal operand" << endl;
+        fail();
+    }
+}
+
+//
+// Standard instructions are encoded without expanding them. Other calls
+// that were expanded before with the same key are replayed from the macro
+// cache instead of scanning the body again. Neither is done while a line
+// map is made.
+//
+void assembler::call_macro(
+    vector<operand>& macro_args,
+    macro *m)
+{
+    statistics::clock::time_point start;
+    if (stats_ != NULL) {
+        start = statistics::clock::now();
+    }
+
+    if (call_native(macro_args, m)) {
+        if (stats_ != NULL) {
+            stats_->add_expansion(m->name_, start);
+        }
+        return;
+    }
+
+    const vector<unsigned char>* bytes;
+    int dot = symbol_table_.dot().value_;
+    macro_cache::lookup_result cached = line_map_ != NULL
+            ? macro_cache::BYPASS
+            : macro_cache_.lookup(m, macro_args, symbol_table_, dot, bytes);
+    if (cached == macro_cache::HIT) {
+        for (unsigned char b : *bytes) {
+            assemble_byte(b);
+        }
+        if (stats_ != NULL) {
+            stats_->add_expansion(m->name_, start);
+        }
+        return;
+    }
+
+    const token* statement = statement_;
+    expansions_.push_back({ statement, m });
+    int num_params = m->num_params_;
+    vector<symbol> saved(num_params);
+
+    //
+    // Parameters are bound by slot, the symbol ids were resolved when the
+    // macro was defined.
+    //
+    for (int i = 0; i < num_params; ++i) {
+        symbol& s = symbol_table_[m->params_[i]];
+        saved[i] = s;
+        s.value_ = macro_args[i].value_;
+        s.expr_ = macro_args[i].expr_;
+        s.type_ = symbol::ASSIGN;
+    }
+
+    if (cached == macro_cache::MISS) {
+        macro_cache_.start(m, macro_args, dot);
+        scan(m->body_);
+        macro_cache_.finish(symbol_table_);
+    } else {
+        scan(m->body_);
+    }
+    expansions_.pop_back();
+    statement_ = statement;
+
+    for (int i = 0; i < num_params; ++i) {
+        symbol& s = symbol_table_[m->params_[i]];
+        s.value_ = saved[i].value_;
+        s.expr_ = saved[i].expr_;
+        s.type_ = saved[i].type_;
+    }
+
+    if (stats_ != NULL) {
+        stats_->add_expansion(m->name_, start);
+    }
+}
+
+//
+// Assembles the words of a call of a standard macro, or returns false if it
+// has to be expanded. While a macro is recorded its calls are expanded, the
+// recording needs the symbols they read, and so are they while a line map
+// is made, so that the bytes are mapped to the lines of the bodies.
+//
+bool assembler::call_native(
+    const vector<operand>& macro_args,
+    const macro* m)
+{
+    if (macro_cache_.recording() || line_map_ != NULL) {
+        return false;
+    }
+    const native_encoder::encoding* e = native_.find(m, symbol_table_);
+    if (e == NULL) {
+        return false;
+    }
+
+    int words[native_encoder::MAX_WORDS];
+    int dot = symbol_table_.dot().value_;
+    int num_words = native_.encode(*e, macro_args, symbol_table_, dot, words);
+    if (num_words == 0) {
+        return false;
+    }
+
+    assemble_zeros((4 - dot % 4) % 4);
+    for (int i = 0; i < num_words; ++i) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            assemble_byte((words[i] >> shift) & 0xFF);
+        }
+    }
+    return true;
+}
+
+//
+// A pending value is emitted as 0 and patched by resolve_fixups().
+//
+void assembler::assemble_byte(
+    operand v)
+{
+    symbol& dot = symbol_table_.dot();
+    if (pass_ == 2 || (one_pass_ && !in_prelude_)) {
+        if (dot.value_ < 0) {
+            diagnostic() << "byte assembled at negative address "
+                    << dot.value_ << endl;
+            fail();
+        }
+        if (v.is_pending()) {
+            const token* where =
+                    expansions_.empty() ? statement_ : expansions_[0].call_;
+            fixups_.push_back({ dot.value_, v.expr_,
+                    where->file_, where->line_ });
+            image_.add_byte(dot.value_, 0);
+        } else {
+            image_.add_byte(dot.value_, v.value_);
+        }
+        if (line_map_ != NULL) {
+            line_map_->add_byte(dot.value_, map_location());
+        }
+    }
+
+    macro_cache_.record_byte(v.value_);
+    if (stats_ != NULL) {
+        stats_->count_bytes(1);
+    }
+    dot.value_++;
+
+    if (dot.value_ > max_dot_) {
+        max_dot_ = dot.value_;
+    }
+}
+
+//
+// Padding is added to the image as one run. While a macro is recorded the
+// bytes go one by one, the recording needs each of them.
+//
+void assembler::assemble_zeros(
+    int count)
+{
+    symbol& dot = symbol_table_.dot();
+    if (macro_cache_.recording()) {
+        for (int i = 0; i < count; ++i) {
+            assemble_byte(0);
+        }
+        return;
+    }
+
+    if (pass_ == 2 || (one_pass_ && !in_prelude_)) {
+        image_.add_zeros(dot.value_, count);
+    }
+    if (stats_ != NULL) {
+        stats_->count_bytes(count);
+    }
+    dot.value_ += count;
+
+    if (dot.value_ > max_dot_) {
+        max_dot_ = dot.value_;
+    }
+}
+
+void assembler::assemble_string(
+    size_t& offset,
+    const token* tokens)
+{
+    if (tokens[offset].type_ == token::STRING) {
+        string bytes;
+        lexer::decode_string(tokens[offset].text_, bytes);
+        for (char ch : bytes) {
+            assemble_byte(ch);
+        }
+        offset++;
+    }
+}
+
+//
+// Assembles the named file in place of the directive, unless it was already
+// included during this pass. The path is relative to the including file.
+//
+void assembler::include_file(
+    size_t& offset,
+    const token* tokens)
+{
+    macro_cache_.rule_out();
+    const token& t = tokens[offset];
+    if (t.type_ != token::STRING) {
+        diagnostic(t) << "expected file name following .include" << endl;
+        fail();
+    }
+    offset++;
+
+    string filename;
+    lexer::decode_string(t.text_, filename);
+    int file = sources_.open(filename, t.file_);
+    if (file < 0) {
+        diagnostic(t) << "unable to open " << filename << endl;
+        fail();
+    }
+
+    for (int included : included_) {
+        if (included == file) {
+            return;
+        }
+    }
+    included_.push_back(file);
+
+    const token* statement = statement_;
+    scan(get_tokens(file));
+    statement_ = statement;
+}
+
+//
+// Frame of the byte being assembled: the line of the statement, called
+// from the line of each macro call that led to it.
+//
+int assembler::map_location()
+{
+    bool same = statement_ == map_statement_
+            && expansions_.size() == map_calls_.size();
+    for (size_t i = 0; same && i < map_calls_.size(); ++i) {
+        same = expansions_[i].call_ == map_calls_[i];
+    }
+    if (same) {
+        return map_frame_;
+    }
+
+    map_statement_ = statement_;
+    map_calls_.clear();
+    int frame = -1;
+    for (size_t i = 0; i <= expansions_.size(); ++i) {
+        const token* t = i < expansions_.size()
+                ? expansions_[i].call_ : statement_;
+        if (i < expansions_.size()) {
+            map_calls_.push_back(t);
+        }
+        if (t->file_ >= (int)map_files_.size()) {
+            map_files_.resize(t->file_ + 1, -1);
+        }
+        int& file = map_files_[t->file_];
+        if (file < 0) {
+            file = line_map_->add_file(sources_.name(t->file_));
+        }
+        string_view name = t->type_ == token::SYMBOL
+                && t[1].is_punct('(') ? t->text_ : "";
+        frame = line_map_->add_frame(frame, file, t->line_, name);
+    }
+    map_frame_ = frame;
+    return frame;
+}
+
+void assembler::resolve_fixups()
+{
+    for (auto const& f : fixups_) {
+        int v;
+        int id;
+        if (!expressions_.evaluate(f.expr_, symbol_table_, v, id)) {
+            print_location(f.file_, f.line_);
+            if (id < 0) {
+                message_ << "division by zero" << endl;
+                fail();
+            }
+            message_ << "undefined symbol " << symbol_table_.name(id) << endl;
+            message_ << symbol_table_;
+            fail();
+        }
+        image_.add_byte(f.address_, v);
+    }
+    fixups_.clear();
+    expressions_.clear();
+}
\ No newline at end of file
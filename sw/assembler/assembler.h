@@ -0,0 +1,161 @@
+#ifndef ASSEMBLER_H
+#define ASSEMBLER_H
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "token.h"
+#include "macro.h"
+#include "symbol_table.h"
+#include "source_cache.h"
+#include "expression.h"
+#include "macro_cache.h"
+#include "native_encoder.h"
+#include "statistics.h"
+#include "image.h"
+#include "line_map.h"
+
+using std::ostream;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+class prelude;
+
+//
+// Assembles one source file at a time into an image. All the state of an
+// assembly lives here, so several assemblers can run in parallel as long as
+// each has its own object. They share the source cache and the prelude,
+// which are only read once set up. Errors are returned, not printed.
+//
+class assembler {
+public:
+    assembler(
+        source_cache& sources,
+        const prelude* p = NULL,
+        bool one_pass = false);
+
+    bool assemble(const string& filename);
+    bool assemble(int file);
+
+    //
+    // Scans a prelude once. It may define symbols and macros but must not
+    // assemble any bytes.
+    //
+    bool assemble_prelude(int file);
+
+    const image& get_image() const { return image_; }
+    const symbol_table& symbols() const { return symbol_table_; }
+    const vector<int>& included() const { return included_; }
+    const string& error() const { return error_; }
+    const macro_cache& expansions() const { return macro_cache_; }
+
+    //
+    // Collects statistics into s from the next assembly on, or stops
+    // collecting if s is NULL.
+    //
+    void set_statistics(statistics* s) { stats_ = s; }
+
+    //
+    // Records in map where each byte of the next assembly came from, or
+    // stops if map is NULL. Macros are then always expanded, so that the
+    // bytes of every call are mapped to the lines of its body.
+    //
+    void set_line_map(line_map* map) { line_map_ = map; }
+
+    //
+    // Standard macros that calls can't be encoded natively for, since the
+    // macros assembled so far don't define them as the encoder's table
+    // does, see native_encoder::unmatched().
+    //
+    vector<string> unmatched_native()
+    {
+        return native_.unmatched(symbol_table_);
+    }
+
+private:
+    struct expansion {
+        const token* call_;
+        const macro* macro_;
+    };
+
+    void start_pass(int pass, int file);
+    void begin_phase(const string& name);
+    void end_phase();
+    const token* get_tokens(int file);
+
+    void scan(const token* tokens);
+    void read_macro(size_t& offset, const token* tokens);
+    bool read_expression(size_t& offset, const token* tokens, operand& result);
+    bool read_term(size_t& offset, const token* tokens, operand& result);
+    void read_operand(size_t& offset, const token* tokens);
+    operand read_symbol_value(size_t& offset, const token* tokens);
+    void call_macro(vector<operand>& macro_args, macro *m);
+    bool call_native(const vector<operand>& macro_args, const macro* m);
+    void assign_label(int symbol_id);
+    void assign_value(size_t& offset, const token* tokens, int symbol_id);
+    void assemble_byte(operand v);
+    void assemble_zeros(int count);
+    void assemble_string(size_t& offset, const token* tokens);
+    void include_file(size_t& offset, const token* tokens);
+    void resolve_fixups();
+    int map_location();
+
+    void get_macro_info(
+        size_t& offset,
+        const token* tokens,
+        int macro_symbol,
+        vector<operand>& macro_args,
+        macro*& m);
+
+    ostream& diagnostic(const token& t);
+    ostream& diagnostic();
+    void print_location(int file, int line);
+    [[noreturn]] void fail();
+
+    source_cache& sources_;
+    const prelude* prelude_;
+    bool one_pass_;
+
+    symbol_table symbol_table_;
+    image image_;
+    expression_pool expressions_;
+    macro_cache macro_cache_;
+    native_encoder native_;
+    statistics* stats_;
+    line_map* line_map_;
+    vector<fixup> fixups_;
+    int pass_;
+    int max_dot_;
+    bool in_prelude_;
+
+    //
+    // Files included during the current pass, the prelude's files are
+    // always considered included.
+    //
+    vector<int> included_;
+
+    //
+    // First token of the statement being assembled, or the name of the
+    // macro being called, and the enclosing macro calls, for diagnostics.
+    // The macros being expanded are also checked for recursion.
+    //
+    const token* statement_;
+    vector<expansion> expansions_;
+
+    //
+    // For the line map: the map's id of each source file, by source file
+    // id, and the frame map_location() last returned with the statement
+    // and calls it was for. Consecutive bytes usually share it.
+    //
+    vector<int> map_files_;
+    const token* map_statement_;
+    vector<const token*> map_calls_;
+    int map_frame_;
+
+    ostringstream message_;
+    string error_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assembly.h"
+#include "assembler.h"
+#include "source_cache.h"
+#include "prelude.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+bool assemble_to_memory(
+    string_view source,
+    assembly& result,
+    const assembly_options& options)
+{
+    result = assembly();
+
+    source_cache local_sources;
+    source_cache& sources = options.sources_ != NULL
+            ? *options.sources_ : local_sources;
+
+    assembler a(sources, options.prelude_, options.one_pass_);
+    if (!a.assemble(sources.add(options.name_, source))) {
+        result.error_ = a.error();
+        return false;
+    }
+
+    const image& img = a.get_image();
+    if (options.words_) {
+        result.words_.assign((img.size() + 3) / 4, 0);
+        for (auto const& s : img.segments()) {
+            for (size_t i = 0; i < s.bytes_.size(); ++i) {
+                size_t address = s.address_ + i;
+                result.words_[address / 4] |=
+                        (uint32_t)s.bytes_[i] << (8 * (address % 4));
+            }
+        }
+    }
+    result.segments_ = img.segments();
+
+    const symbol_table& st = a.symbols();
+    for (size_t id = 0; id < st.size(); ++id) {
+        if (id != (size_t)interner::DOT && st[id].type_ != symbol::UNDEF) {
+            result.symbols_.emplace(st.name(id), st[id].value_);
+        }
+    }
+
+    result.ok_ = true;
+    return true;
+}
\ No newline at end of file
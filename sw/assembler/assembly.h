@@ -0,0 +1,72 @@
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "image.h"
+
+using std::map;
+using std::string;
+using std::string_view;
+using std::vector;
+
+class source_cache;
+class prelude;
+
+//
+// Result of assembling source text in memory. segments_ holds the segments
+// of the image, where long runs of zeros are fills without bytes, the same
+// as the command line tool writes with -f seg. words_ is the whole image as
+// little-endian words, with zeros where nothing was assembled, if the
+// options asked for it. symbols_ maps every label and assigned symbol,
+// including those of the prelude, to its final value.
+//
+class assembly {
+public:
+    bool ok_ = false;
+    string error_;
+    vector<uint32_t> words_;
+    vector<image::segment> segments_;
+    map<string, int> symbols_;
+};
+
+class assembly_options {
+public:
+    bool one_pass_ = false;
+
+    //
+    // Fill in words_ as well. They run from address 0 to the end of the
+    // image, so space reserved with STORAGE takes memory there.
+    //
+    bool words_ = false;
+
+    //
+    // Name of the source in diagnostics. Relative includes are looked up
+    // in its directory.
+    //
+    string name_ = "<memory>";
+
+    //
+    // Cache shared by calls, which must be the one the prelude was loaded
+    // into. A cache local to the call is used when it is NULL.
+    //
+    source_cache* sources_ = NULL;
+    const prelude* prelude_ = NULL;
+};
+
+//
+// Assembles source with the same assembler as the command line tool and
+// returns the image and symbols in result. Returns false and sets
+// result.error_ on failure. Calls with distinct results can run in
+// parallel.
+//
+bool assemble_to_memory(
+    string_view source,
+    assembly& result,
+    const assembly_options& options = assembly_options());
+
+#endif
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../token.h"
+#include "../lexer.h"
+#include "../interner.h"
+#include "../source_cache.h"
+#include "../assembler.h"
+#include "../assembly.h"
+#include "generator.h"
+
+using std::cout;
+using std::endl;
+using std::function;
+using std::ofstream;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+//
+// Figures for one benchmark. bytes_ is the size of the source for the
+// lexer and the size of the assembled image for the others.
+//
+struct result {
+    char name_[32];
+    size_t lines_;
+    size_t bytes_;
+    double seconds_;
+    long peak_rss_;
+    bool ok_;
+};
+
+struct options {
+    size_t instructions_ = 100000;
+    int repetitions_ = 5;
+    uint32_t seed_ = 1;
+    bool one_pass_ = false;
+    bool json_ = false;
+    string macros_;
+};
+
+void usage();
+
+static size_t count_lines(const string& text)
+{
+    return std::count(text.begin(), text.end(), '\n');
+}
+
+//
+// Runs body once to warm up, then the given number of times, and returns
+// the median time in seconds.
+//
+static double median_time(
+    int repetitions,
+    const function<void()>& body)
+{
+    body();
+    vector<double> times;
+    for (int i = 0; i < repetitions; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double> elapsed =
+                std::chrono::steady_clock::now() - start;
+        times.push_back(elapsed.count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+//
+// Runs a benchmark in a child process so that its peak RSS is its own and a
+// crash doesn't take the other benchmarks with it.
+//
+static result run_isolated(
+    const char* name,
+    const function<void(result&)>& benchmark)
+{
+    result r = {};
+    snprintf(r.name_, sizeof(r.name_), "%s", name);
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return r;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        benchmark(r);
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        r.peak_rss_ = usage.ru_maxrss;
+        ssize_t written = write(fds[1], &r, sizeof(r));
+        _exit(written == sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    if (pid < 0 || read(fds[0], &r, sizeof(r)) != sizeof(r)) {
+        r.ok_ = false;
+    }
+    close(fds[0]);
+    if (pid > 0) {
+        waitpid(pid, NULL, 0);
+    }
+    return r;
+}
+
+//
+// Assembles a source that has already been tokenized, so the time is that
+// of scanning: expressions, macro calls and emitting bytes.
+//
+static void bench_scan(
+    const string& text,
+    const options& opts,
+    result& r)
+{
+    source_cache sources;
+    int file = sources.add("bench.uasm", text);
+    assembler a(sources, NULL, opts.one_pass_);
+    r.seconds_ = median_time(opts.repetitions_, [&]() {
+        r.ok_ = a.assemble(file);
+    });
+    if (!r.ok_) {
+        std::cerr << a.error();
+    }
+    r.lines_ = count_lines(text);
+    r.bytes_ = a.get_image().size();
+}
+
+static void bench_lexer(
+    const string& text,
+    const options& opts,
+    result& r)
+{
+    interner names;
+    vector<token> tokens;
+    r.seconds_ = median_time(opts.repetitions_, [&]() {
+        lexer l(text, "bench.uasm", 0, &names);
+        tokens.clear();
+        r.ok_ = l.tokenize(tokens);
+    });
+    r.lines_ = count_lines(text);
+    r.bytes_ = text.size();
+}
+
+//
+// What the command line tool does for one file: map and tokenize the
+// sources, assemble and format the image.
+//
+static void bench_pipeline(
+    const string& text,
+    const options& opts,
+    result& r)
+{
+    size_t bytes = 0;
+    r.seconds_ = median_time(opts.repetitions_, [&]() {
+        source_cache sources;
+        assembler a(sources, NULL, opts.one_pass_);
+        r.ok_ = a.assemble(sources.add("bench.uasm", text));
+        ostringstream os;
+        a.get_image().write(os, image::HEX);
+        bytes = a.get_image().size();
+    });
+    r.lines_ = count_lines(text);
+    r.bytes_ = bytes;
+}
+
+//
+// Checks that out, from assemble_to_memory, is what the command line tool
+// makes of text: the image rebuilt from its segments is written the same
+// in every format, and its words are the flat binary.
+//
+static bool same_as_command_line(
+    const string& text,
+    const assembly& out,
+    const options& opts)
+{
+    source_cache sources;
+    assembler a(sources, NULL, opts.one_pass_);
+    if (!a.assemble(sources.add("bench.uasm", text))) {
+        return false;
+    }
+
+    image rebuilt;
+    for (auto const& s : out.segments_) {
+        if (s.is_fill()) {
+            rebuilt.add_zeros(s.address_, s.length_);
+        }
+        for (size_t i = 0; i < s.bytes_.size(); ++i) {
+            rebuilt.add_byte(s.address_ + i, s.bytes_[i]);
+        }
+    }
+    rebuilt.compact();
+
+    for (auto format : { image::TEXT, image::BINARY, image::HEX,
+            image::TESTCASE, image::SEGMENTS }) {
+        ostringstream expected;
+        ostringstream actual;
+        a.get_image().write(expected, format);
+        rebuilt.write(actual, format);
+        if (actual.str() != expected.str()) {
+            std::cerr << "assemble_to_memory differs from the command line "
+                    << "in " << image::extension(format) << endl;
+            return false;
+        }
+    }
+
+    ostringstream binary;
+    a.get_image().write(binary, image::BINARY);
+    string words(out.words_.size() * 4, 0);
+    for (size_t i = 0; i < words.size(); ++i) {
+        words[i] = out.words_[i / 4] >> (8 * (i % 4));
+    }
+    if (words.compare(0, binary.str().size(), binary.str()) != 0) {
+        std::cerr << "assemble_to_memory words differ from the binary"
+                << endl;
+        return false;
+    }
+    return true;
+}
+
+//
+// What a program linking the assembler does: assemble_to_memory without
+// the words. The result, with the words, is checked against the command
+// line tool first.
+//
+static void bench_memory(
+    const string& text,
+    const options& opts,
+    result& r)
+{
+    assembly_options ao;
+    ao.one_pass_ = opts.one_pass_;
+    ao.name_ = "bench.uasm";
+    ao.words_ = true;
+    assembly out;
+    r.ok_ = assemble_to_memory(text, out, ao)
+            && same_as_command_line(text, out, opts);
+    if (!out.ok_) {
+        std::cerr << out.error_;
+    }
+    if (r.ok_) {
+        ao.words_ = false;
+        r.seconds_ = median_time(opts.repetitions_, [&]() {
+            r.ok_ = assemble_to_memory(text, out, ao);
+        });
+    }
+    r.lines_ = count_lines(text);
+    r.bytes_ = out.segments_.empty() ? 0 : out.segments_.back().end();
+}
+
+static void write_results(
+    const vector<result>& results,
+    const options& opts)
+{
+    char line[160];
+    if (opts.json_) {
+        cout << "{\n  \"instructions\": " << opts.instructions_
+                << ",\n  \"seed\": " << opts.seed_
+                << ",\n  \"one_pass\": " << (opts.one_pass_ ? "true" : "false")
+                << ",\n  \"benchmarks\": [";
+        for (size_t i = 0; i < results.size(); ++i) {
+            const result& r = results[i];
+            snprintf(line, sizeof(line), "%s\n    { \"name\": \"%s\", "
+                    "\"ok\": %s, \"lines\": %zu, \"bytes\": %zu, "
+                    "\"seconds\": %.6f, ", i > 0 ? "," : "", r.name_,
+                    r.ok_ ? "true" : "false", r.lines_, r.bytes_,
+                    r.seconds_);
+            cout << line;
+            snprintf(line, sizeof(line), "\"lines_per_second\": %.0f, "
+                    "\"bytes_per_second\": %.0f, \"peak_rss_kb\": %ld }",
+                    r.lines_ / r.seconds_, r.bytes_ / r.seconds_,
+                    r.peak_rss_);
+            cout << line;
+        }
+        cout << "\n  ]\n}" << endl;
+        return;
+    }
+
+    snprintf(line, sizeof(line), "%-12s %10s %10s %10s %12s %12s %10s\n",
+            "benchmark", "lines", "bytes", "ms", "lines/s", "bytes/s",
+            "RSS KB");
+    cout << line;
+    for (auto const& r : results) {
+        if (!r.ok_) {
+            cout << r.name_ << " failed" << endl;
+            continue;
+        }
+        snprintf(line, sizeof(line),
+                "%-12s %10zu %10zu %10.3f %12.0f %12.0f %10ld\n",
+                r.name_, r.lines_, r.bytes_, r.seconds_ * 1000,
+                r.lines_ / r.seconds_, r.bytes_ / r.seconds_, r.peak_rss_);
+        cout << line;
+    }
+}
+
+void usage()
+{
+    cout << "usage: bench [-n instructions] [-r repetitions] [-s seed] [-1] "
+            << "[--json] macros.uasm" << endl;
+    cout << "       bench [-n instructions] [-s seed] --generate output "
+            << "macros.uasm" << endl;
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    options opts;
+    string generate_filename;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            opts.instructions_ = strtoul(argv[++i], NULL, 0);
+        } else if (arg == "-r" && i + 1 < argc) {
+            opts.repetitions_ = atoi(argv[++i]);
+        } else if (arg == "-s" && i + 1 < argc) {
+            opts.seed_ = strtoul(argv[++i], NULL, 0);
+        } else if (arg == "-1") {
+            opts.one_pass_ = true;
+        } else if (arg == "--json") {
+            opts.json_ = true;
+        } else if (arg == "--generate" && i + 1 < argc) {
+            generate_filename = argv[++i];
+        } else if (arg[0] != '-' && opts.macros_.empty()) {
+            opts.macros_ = arg;
+        } else {
+            usage();
+            return -1;
+        }
+    }
+
+    if (opts.macros_.empty() || opts.repetitions_ < 1) {
+        usage();
+        return -1;
+    }
+
+    string program;
+    if (!generate_filename.empty()) {
+        //
+        // The output may be anywhere, so it includes the macros by their
+        // full path.
+        //
+        char resolved[PATH_MAX];
+        if (realpath(opts.macros_.c_str(), resolved) == NULL) {
+            cout << "unable to open " << opts.macros_ << endl;
+            return -1;
+        }
+        generate_program(opts.instructions_, opts.seed_, resolved, program);
+
+        ofstream ofs(generate_filename, std::ios::binary);
+        if (!ofs) {
+            cout << "unable to open output file " << generate_filename
+                    << endl;
+            return -1;
+        }
+        ofs << program;
+        return 0;
+    }
+
+    //
+    // The benchmarks assemble the program as if it were in the current
+    // directory.
+    //
+    generate_program(opts.instructions_, opts.seed_, opts.macros_, program);
+
+    string expressions;
+    generate_expressions(opts.instructions_ / 4, opts.seed_, expressions);
+
+    vector<result> results;
+    results.push_back(run_isolated("lexer", [&](result& r) {
+        bench_lexer(program, opts, r);
+    }));
+    results.push_back(run_isolated("expressions", [&](result& r) {
+        bench_scan(expressions, opts, r);
+    }));
+    results.push_back(run_isolated("macros", [&](result& r) {
+        bench_scan(program, opts, r);
+    }));
+    results.push_back(run_isolated("pipeline", [&](result& r) {
+        bench_pipeline(program, opts, r);
+    }));
+    results.push_back(run_isolated("memory", [&](result& r) {
+        bench_memory(program, opts, r);
+    }));
+    write_results(results, opts);
+
+    for (auto const& r : results) {
+        if (!r.ok_) {
+            return -1;
+        }
+    }
+    return 0;
+}
\ No newline at end of file
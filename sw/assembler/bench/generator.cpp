@@ -0,0 +1,183 @@
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "generator.h"
+
+using std::string;
+
+//
+// Labels are placed every LABEL_SPACING instructions, branches go forward
+// by up to MAX_BRANCH labels so their offsets always fit.
+//
+static const int LABEL_SPACING = 8;
+static const int MAX_BRANCH = 16;
+static const int DATA_SPACING = 512;
+static const int CONSTANTS = 64;
+
+static const char* const OPERATE[] = {
+    "ADD", "SUB", "MUL", "DIV", "AND", "OR", "XOR", "XNOR",
+    "SHL", "SHR", "SRA", "CMPEQ", "CMPLT", "CMPLE"
+};
+
+static const char* const BRANCHES[] = { "BEQ", "BNE", "BF", "BT" };
+
+static const char* const WORDS[] = {
+    "alpha", "beta", "gamma", "delta", "pipeline", "bypass", "stall",
+    "register", "branch", "memory"
+};
+
+template <size_t N>
+static const char* pick(
+    program_random& r,
+    const char* const (&names)[N])
+{
+    return names[r.below(N)];
+}
+
+static void append(
+    string& out,
+    const char* format,
+    ...) __attribute__((format(printf, 2, 3)));
+
+static void append(
+    string& out,
+    const char* format,
+    ...)
+{
+    char line[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    out.append(line, n);
+}
+
+static void generate_data(
+    program_random& r,
+    size_t block,
+    string& out)
+{
+    append(out, "data%zu:\n", block);
+    for (int i = r.below(3) + 1; i > 0; --i) {
+        append(out, "        .ascii \"%s %s\"\n", pick(r, WORDS),
+                pick(r, WORDS));
+    }
+    append(out, "        .text \"%s\\n\"\n", pick(r, WORDS));
+    append(out, "        .align %d\n", 4 << r.below(3));
+    append(out, "buffer%zu:\n        STORAGE(%d)\n", block, r.below(16) + 1);
+    append(out, "        LONG(data%zu) LONG(buffer%zu)\n", block, block);
+}
+
+static void generate_instruction(
+    program_random& r,
+    size_t label,
+    string& out)
+{
+    int ra = r.below(31);
+    int rb = r.below(31);
+    int rc = r.below(31);
+    switch (r.below(10)) {
+        case 0:
+        case 1:
+        case 2:
+            append(out, "        %s(r%d, r%d, r%d)\n", pick(r, OPERATE),
+                    ra, rb, rc);
+            break;
+        case 3:
+        case 4:
+            append(out, "        %sC(r%d, K%d, r%d)\n", pick(r, OPERATE),
+                    ra, r.below(CONSTANTS), rc);
+            break;
+        case 5:
+            append(out, "        LD(r%d, %d, r%d)\n", ra, 4 * r.below(64),
+                    rc);
+            break;
+        case 6:
+            append(out, "        ST(r%d, %d, r%d)\n", rc, 4 * r.below(64),
+                    ra);
+            break;
+        case 7:
+            append(out, "        %s(r%d, L%zu)\n", pick(r, BRANCHES), ra,
+                    label + 1 + r.below(MAX_BRANCH));
+            break;
+        case 8:
+            if (r.below(2) == 0) {
+                append(out, "        PUSH(r%d)\n", ra);
+            } else {
+                append(out, "        POP(r%d)\n", ra);
+            }
+            break;
+        default:
+            append(out, "        CMOVE(K%d + %d, r%d)\n", r.below(CONSTANTS),
+                    r.below(100), rc);
+            break;
+    }
+}
+
+void generate_program(
+    size_t instructions,
+    uint32_t seed,
+    const string& include,
+    string& out)
+{
+    program_random r(seed);
+    out.clear();
+    append(out, "// %zu instructions, seed %u\n", instructions, seed);
+    append(out, ".include \"%s\"\n\n", include.c_str());
+    for (int i = 0; i < CONSTANTS; ++i) {
+        append(out, "K%d = %d\n", i, r.below(0x7fff));
+    }
+    out += "\n. = 0\n";
+
+    size_t label = 0;
+    size_t block = 0;
+    for (size_t i = 0; i < instructions; ++i) {
+        if (i % LABEL_SPACING == 0) {
+            append(out, "L%zu:\n", label++);
+        }
+        if (i % DATA_SPACING == DATA_SPACING - 1) {
+            append(out, "        BR(L%zu)\n", label);
+            generate_data(r, block++, out);
+            continue;
+        }
+        generate_instruction(r, label - 1, out);
+    }
+
+    //
+    // Targets of the last branches.
+    //
+    for (int i = 0; i < MAX_BRANCH; ++i) {
+        append(out, "L%zu:\n", label++);
+    }
+    out += "        HALT()\n";
+}
+
+void generate_expressions(
+    size_t lines,
+    uint32_t seed,
+    string& out)
+{
+    static const char* const OPS[] = {
+        "+", "-", "*", "/", "%", "<<", ">>"
+    };
+
+    program_random r(seed);
+    out.clear();
+    for (int i = 0; i < CONSTANTS; ++i) {
+        append(out, "X%d = %d\n", i, r.below(1000) + 1);
+    }
+    for (size_t i = 0; i < lines; ++i) {
+        out += "        ";
+        for (int j = 0; j < 4; ++j) {
+            const char* op = pick(r, OPS);
+            int right = op[0] == '<' || op[0] == '>' ? r.below(8)
+                    : r.below(99) + 1;
+            append(out, "%s(X%d %s %d) * ~X%d - -%d", j > 0 ? ", " : "",
+                    r.below(CONSTANTS), op, right, r.below(CONSTANTS),
+                    r.below(50));
+        }
+        out += "\n";
+    }
+}
\ No newline at end of file
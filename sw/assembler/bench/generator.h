@@ -0,0 +1,51 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <cstdint>
+#include <string>
+
+using std::string;
+
+//
+// Small linear congruential generator. The standard distributions differ
+// between library implementations, this one gives the same programs
+// everywhere so numbers can be compared across machines and commits.
+//
+class program_random {
+public:
+    program_random(uint32_t seed) : state_(seed * 2654435761u + 1) {}
+
+    uint32_t next()
+    {
+        state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+        return (uint32_t)(state_ >> 33);
+    }
+
+    int below(int n) { return (int)(next() % (uint32_t)n); }
+
+private:
+    uint64_t state_;
+};
+
+//
+// Writes a Beta program of about the given number of instructions to out.
+// It includes the macro package named by include, then mixes instruction
+// macros with labels, forward branches, constant assignments and data
+// blocks using .align, .ascii, .text and STORAGE.
+//
+void generate_program(
+    size_t instructions,
+    uint32_t seed,
+    const string& include,
+    string& out);
+
+//
+// Writes a program that is nothing but data bytes given by expressions over
+// a set of constants, to time expression parsing without macros.
+//
+void generate_expressions(
+    size_t lines,
+    uint32_t seed,
+    string& out);
+
+#endif
\ No newline at end of file
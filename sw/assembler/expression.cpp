@@ -0,0 +1,170 @@
+#include <climits>
+#include <vector>
+
+#include "symbol.h"
+#include "symbol_table.h"
+#include "expression.h"
+
+using std::vector;
+
+//
+// The operators of read_expression(). Pending expressions are evaluated
+// with the same function so both give identical results. Dividing the
+// most negative number by -1 wraps around, as adding and multiplying do.
+//
+int expression::apply(
+    op_type op,
+    int left,
+    int right)
+{
+    int result = 0;
+    switch (op) {
+        case NEGATE: result = -left; break;
+        case INVERT: result = ~left; break;
+        case ADD: result = left + right; break;
+        case SUB: result = left - right; break;
+        case MUL: result = left * right; break;
+        case DIV:
+            if (divides_by_zero(op, right)) {
+                break;
+            }
+            result = left == INT_MIN && right == -1 ? left : left / right;
+            break;
+        case MOD:
+            if (divides_by_zero(op, right) || right == -1) {
+                break;
+            }
+            result = left % right;
+            result = result < 0 ? result + right : result;
+            break;
+        case SHR: result = left >> right; break;
+        case SHL: result = left << right; break;
+        default: break;
+    }
+    return result;
+}
+
+operand expression_pool::make_symbol(
+    int symbol_id)
+{
+    expression e;
+    e.nodes_.push_back({ expression::SYMBOL, symbol_id });
+    expressions_.push_back(e);
+    return operand(0, expressions_.size() - 1);
+}
+
+operand expression_pool::apply(
+    expression::op_type op,
+    operand left,
+    operand right)
+{
+    if (!left.is_pending() && !right.is_pending()) {
+        return operand(expression::apply(op, left.value_, right.value_));
+    }
+
+    expression e;
+    append(e, left);
+    append(e, right);
+    e.nodes_.push_back({ op, 0 });
+    expressions_.push_back(e);
+    return operand(0, expressions_.size() - 1);
+}
+
+operand expression_pool::apply(
+    expression::op_type op,
+    operand arg)
+{
+    if (!arg.is_pending()) {
+        return operand(expression::apply(op, arg.value_, 0));
+    }
+
+    expression e;
+    append(e, arg);
+    e.nodes_.push_back({ op, 0 });
+    expressions_.push_back(e);
+    return operand(0, expressions_.size() - 1);
+}
+
+void expression_pool::append(
+    expression& e,
+    operand arg)
+{
+    if (arg.is_pending()) {
+        vector<expression::node>& nodes = expressions_[arg.expr_].nodes_;
+        e.nodes_.insert(e.nodes_.end(), nodes.begin(), nodes.end());
+    } else {
+        e.nodes_.push_back({ expression::CONSTANT, arg.value_ });
+    }
+}
+
+//
+// Evaluates a pending expression with the current symbol values. Returns
+// false and the offending symbol if one of them is still undefined, or -1
+// for it if the expression divides by zero.
+//
+bool expression_pool::evaluate(
+    int expr,
+    symbol_table& st,
+    int& result,
+    int& undefined_symbol)
+{
+    return evaluate(expr, st, result, undefined_symbol, 0);
+}
+
+bool expression_pool::evaluate(
+    int expr,
+    symbol_table& st,
+    int& result,
+    int& undefined_symbol,
+    int depth)
+{
+    vector<int> stack;
+    for (auto const& n : expressions_[expr].nodes_) {
+        switch (n.op_) {
+            case expression::CONSTANT:
+                stack.push_back(n.value_);
+                break;
+            case expression::SYMBOL: {
+                symbol& s = st[n.value_];
+                int v = s.value_;
+
+                //
+                // A symbol assigned from a pending expression refers to
+                // that expression. A cycle can never become defined.
+                //
+                if (s.type_ == symbol::UNDEF || depth > 1000) {
+                    undefined_symbol = n.value_;
+                    return false;
+                } else if (s.expr_ >= 0) {
+                    if (!evaluate(s.expr_, st, v, undefined_symbol,
+                            depth + 1)) {
+                        return false;
+                    }
+                }
+                stack.push_back(v);
+                break;
+            }
+            case expression::NEGATE:
+            case expression::INVERT:
+                stack.back() = expression::apply(n.op_, stack.back(), 0);
+                break;
+            default: {
+                int right = stack.back();
+                stack.pop_back();
+                if (expression::divides_by_zero(n.op_, right)) {
+                    undefined_symbol = -1;
+                    return false;
+                }
+                stack.back() = expression::apply(n.op_, stack.back(), right);
+                break;
+            }
+        }
+    }
+    result = stack.back();
+    return true;
+}
+
+void expression_pool::clear()
+{
+    expressions_.clear();
+}
\ No newline at end of file
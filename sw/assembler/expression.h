@@ -0,0 +1,98 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include <vector>
+
+#include "symbol_table.h"
+
+using std::vector;
+
+//
+// Expression kept in postfix form so it can be evaluated after the symbols
+// it references have been defined.
+//
+class expression {
+public:
+    enum op_type {
+        CONSTANT, SYMBOL, NEGATE, INVERT,
+        ADD, SUB, MUL, DIV, MOD, SHR, SHL
+    };
+
+    struct node {
+        op_type op_;
+        int value_;
+    };
+
+    static int apply(op_type op, int left, int right);
+
+    //
+    // Whether op is a division or remainder by zero, which apply() gives
+    // as 0 and the assembler reports.
+    //
+    static bool divides_by_zero(op_type op, int right)
+    {
+        return (op == DIV || op == MOD) && right == 0;
+    }
+
+    vector<node> nodes_;
+};
+
+//
+// Result of reading a term or an expression. expr_ is -1 when the value is
+// known, otherwise it indexes the pending expression in the pool and value_
+// is only a placeholder.
+//
+class operand {
+public:
+    operand() = default;
+    operand(int value) : value_(value), expr_(-1) {}
+    operand(int value, int expr) : value_(value), expr_(expr) {}
+
+    bool is_pending() const { return expr_ >= 0; }
+
+    int value_;
+    int expr_;
+};
+
+//
+// Byte at address_ whose value is the pending expression expr_. The file
+// and line of the statement are kept for diagnostics.
+//
+class fixup {
+public:
+    int address_;
+    int expr_;
+    int file_;
+    int line_;
+};
+
+class expression_pool {
+public:
+    expression_pool() = default;
+
+    operand make_symbol(int symbol_id);
+    operand apply(expression::op_type op, operand left, operand right);
+    operand apply(expression::op_type op, operand arg);
+
+    bool evaluate(
+        int expr,
+        symbol_table& st,
+        int& result,
+        int& undefined_symbol);
+
+    void clear();
+
+private:
+    void append(expression& e, operand arg);
+
+    bool evaluate(
+        int expr,
+        symbol_table& st,
+        int& result,
+        int& undefined_symbol,
+        int depth);
+
+    vector<expression> expressions_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,475 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "segment_file.h"
+#include "image.h"
+
+using std::string;
+using std::vector;
+using std::ostream;
+
+//
+// Zeros at the end of a segment become a separate fill once there are this
+// many of them. Shorter runs are cheaper to keep as bytes.
+//
+static const size_t FILL_THRESHOLD = 16;
+
+//
+// Fast path for the usual case of bytes assembled in increasing order.
+//
+void image::add_byte(
+    int address,
+    int value)
+{
+    if (!segments_.empty() && (size_t)address == segments_.back().end()) {
+        append(value);
+    } else if (segments_.empty() || (size_t)address > segments_.back().end()) {
+        unsigned char b = (unsigned char)(value & 0xFF);
+        segments_.push_back({ address, 1, { b } });
+        trailing_zeros_ = b == 0 ? 1 : 0;
+    } else {
+        write_at(address, value);
+    }
+}
+
+//
+// Assembles length zero bytes without storing them one by one.
+//
+void image::add_zeros(
+    int address,
+    size_t length)
+{
+    if (length == 0) {
+        return;
+    }
+
+    bool at_end = !segments_.empty()
+            && (size_t)address == segments_.back().end();
+    bool past_end = segments_.empty()
+            || (size_t)address > segments_.back().end();
+    if ((at_end || past_end) && length >= FILL_THRESHOLD) {
+        if (at_end && segments_.back().is_fill()) {
+            segments_.back().length_ += length;
+        } else {
+            segments_.push_back({ address, length, {} });
+        }
+        trailing_zeros_ = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < length; ++i) {
+        add_byte(address + i, 0);
+    }
+}
+
+void image::clear()
+{
+    segments_.clear();
+    trailing_zeros_ = 0;
+}
+
+//
+// Adds length zeros at address to out, as a fill if there are enough of
+// them and otherwise to the segment of bytes they follow.
+//
+void image::push_zeros(
+    vector<segment>& out,
+    size_t address,
+    size_t length) const
+{
+    if (length == 0) {
+        return;
+    }
+    if (length >= FILL_THRESHOLD) {
+        out.push_back({ (int)address, length, {} });
+        return;
+    }
+    if (out.empty() || out.back().is_fill() || out.back().end() != address) {
+        out.push_back({ (int)address, 0, {} });
+    }
+    out.back().bytes_.insert(out.back().bytes_.end(), length, 0);
+    out.back().length_ += length;
+}
+
+void image::compact()
+{
+    vector<segment> out;
+    size_t zeros_at = 0;
+    size_t zeros = 0;
+    size_t end = 0;
+
+    for (auto const& s : segments_) {
+        if (zeros > 0 && (size_t)s.address_ != end) {
+            push_zeros(out, zeros_at, zeros);
+            zeros = 0;
+        }
+        if (s.is_fill()) {
+            zeros_at = zeros == 0 ? s.address_ : zeros_at;
+            zeros += s.length_;
+        }
+        for (size_t i = 0; i < s.bytes_.size(); ++i) {
+            if (s.bytes_[i] == 0) {
+                zeros_at = zeros == 0 ? s.address_ + i : zeros_at;
+                zeros++;
+                continue;
+            }
+            push_zeros(out, zeros_at, zeros);
+            zeros = 0;
+            size_t address = s.address_ + i;
+            if (out.empty() || out.back().is_fill()
+                    || out.back().end() != address) {
+                out.push_back({ (int)address, 0, {} });
+            }
+            out.back().bytes_.push_back(s.bytes_[i]);
+            out.back().length_++;
+        }
+        end = s.end();
+    }
+    push_zeros(out, zeros_at, zeros);
+
+    segments_ = std::move(out);
+    trailing_zeros_ = 0;
+}
+
+size_t image::size() const
+{
+    return segments_.empty() ? 0 : segments_.back().end();
+}
+
+void image::append(
+    int value)
+{
+    segment& last = segments_.back();
+    unsigned char b = (unsigned char)(value & 0xFF);
+    if (last.is_fill()) {
+        if (b == 0) {
+            last.length_++;
+        } else {
+            segments_.push_back({ (int)last.end(), 1, { b } });
+            trailing_zeros_ = 0;
+        }
+        return;
+    }
+
+    last.bytes_.push_back(b);
+    last.length_++;
+    trailing_zeros_ = b == 0 ? trailing_zeros_ + 1 : 0;
+    if (trailing_zeros_ < FILL_THRESHOLD) {
+        return;
+    }
+
+    last.bytes_.resize(last.length_ - FILL_THRESHOLD);
+    last.length_ -= FILL_THRESHOLD;
+    if (last.length_ == 0) {
+        last.length_ = FILL_THRESHOLD;
+    } else {
+        segments_.push_back({ (int)last.end(), FILL_THRESHOLD, {} });
+    }
+    trailing_zeros_ = 0;
+}
+
+//
+// Writes a byte that isn't past the end of the image, as when a fixup is
+// patched or "." is moved back. A fill the byte lands in is split.
+//
+void image::write_at(
+    int address,
+    int value)
+{
+    unsigned char b = (unsigned char)(value & 0xFF);
+    trailing_zeros_ = 0;
+
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), address,
+            [](int a, const segment& s) { return a < s.address_; });
+    size_t index = it - segments_.begin();
+
+    if (index > 0 && (size_t)address < segments_[index - 1].end()) {
+        segment& s = segments_[index - 1];
+        size_t offset = address - s.address_;
+        if (!s.is_fill()) {
+            s.bytes_[offset] = b;
+            return;
+        }
+        if (b == 0) {
+            return;
+        }
+
+        segment right = { address + 1, s.length_ - offset - 1, {} };
+        s.length_ = offset;
+        if (s.length_ == 0) {
+            segments_.erase(segments_.begin() + --index);
+        }
+        if (right.length_ > 0) {
+            segments_.insert(segments_.begin() + index, right);
+        }
+    }
+
+    segments_.insert(segments_.begin() + index, { address, 1, { b } });
+    merge(index);
+}
+
+//
+// Joins the segment at index, which holds bytes, with neighbours that hold
+// bytes and touch it.
+//
+void image::merge(
+    size_t index)
+{
+    auto touches = [&](size_t first) {
+        return !segments_[first].is_fill() && !segments_[first + 1].is_fill()
+                && segments_[first].end()
+                    == (size_t)segments_[first + 1].address_;
+    };
+
+    if (index + 1 < segments_.size() && touches(index)) {
+        segment& s = segments_[index];
+        segment& next = segments_[index + 1];
+        s.bytes_.insert(s.bytes_.end(), next.bytes_.begin(),
+                next.bytes_.end());
+        s.length_ += next.length_;
+        segments_.erase(segments_.begin() + index + 1);
+    }
+    if (index > 0 && touches(index - 1)) {
+        segment& prev = segments_[index - 1];
+        segment& s = segments_[index];
+        prev.bytes_.insert(prev.bytes_.end(), s.bytes_.begin(),
+                s.bytes_.end());
+        prev.length_ += s.length_;
+        segments_.erase(segments_.begin() + index);
+    }
+}
+
+void image::write(
+    ostream& os,
+    image_format format) const
+{
+    switch (format) {
+        case TEXT: write_text(os); break;
+        case BINARY: write_binary(os); break;
+        case HEX: write_hex(os); break;
+        case TESTCASE: write_testcase(os); break;
+        case SEGMENTS: write_segments(os); break;
+    }
+    os.flush();
+}
+
+bool image::parse_format(
+    const string& name,
+    image_format& format_out)
+{
+    if (name == "text") {
+        format_out = TEXT;
+    } else if (name == "bin") {
+        format_out = BINARY;
+    } else if (name == "hex") {
+        format_out = HEX;
+    } else if (name == "testcase") {
+        format_out = TESTCASE;
+    } else if (name == "seg") {
+        format_out = SEGMENTS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+//
+// File name extension used for an output in the format.
+//
+string image::extension(
+    image_format format)
+{
+    switch (format) {
+        case BINARY: return ".bin";
+        case HEX: return ".hex";
+        case TESTCASE: return ".tc";
+        case SEGMENTS: return ".seg";
+        default: return ".txt";
+    }
+}
+
+//
+// One "mem[N] = 0xNN" line per assembled byte.
+//
+void image::write_text(
+    ostream& os) const
+{
+    string out;
+    char line[32];
+    for (auto const& s : segments_) {
+        for (size_t i = 0; i < s.length_; ++i) {
+            int n = snprintf(line, sizeof(line), "mem[%zu] = 0x%02x\n",
+                    s.address_ + i, s.is_fill() ? 0 : s.bytes_[i]);
+            out.append(line, n);
+        }
+    }
+    os.write(out.data(), out.size());
+}
+
+static void write_zeros(
+    ostream& os,
+    size_t length)
+{
+    static const char zeros[4096] = {};
+    while (length > 0) {
+        size_t n = std::min(length, sizeof(zeros));
+        os.write(zeros, n);
+        length -= n;
+    }
+}
+
+//
+// Flat image starting at address 0, gaps are zero filled.
+//
+void image::write_binary(
+    ostream& os) const
+{
+    size_t address = 0;
+    for (auto const& s : segments_) {
+        write_zeros(os, s.address_ - address);
+        if (s.is_fill()) {
+            write_zeros(os, s.length_);
+        } else {
+            os.write((const char *)s.bytes_.data(), s.length_);
+        }
+        address = s.end();
+    }
+}
+
+//
+// One 32-bit word per line for $readmemh, word 0 is at address 0. Runs of
+// at least HEX_SKIP bytes of zero fill or addresses that were never
+// assembled are left out, and an "@N" line gives the word index where
+// output resumes, so the memory has to be cleared before it is loaded.
+// Shorter runs are written as zeros.
+//
+void image::write_hex(
+    ostream& os) const
+{
+    static const size_t HEX_SKIP = 256;
+
+    string out;
+    char line[16];
+    size_t next_word = 0;
+    size_t word_index = 0;
+    unsigned int word = 0;
+    bool have_word = false;
+
+    auto flush = [&]() {
+        if (word_index != next_word) {
+            int n = snprintf(line, sizeof(line), "@%zx\n", word_index);
+            out.append(line, n);
+        }
+        int n = snprintf(line, sizeof(line), "%08x\n", word);
+        out.append(line, n);
+        next_word = word_index + 1;
+    };
+
+    auto put = [&](size_t address, unsigned char b) {
+        if (have_word && address / 4 != word_index) {
+            flush();
+            have_word = false;
+        }
+        if (!have_word) {
+            word_index = address / 4;
+            word = 0;
+            have_word = true;
+        }
+        word |= (unsigned int)b << (8 * (address % 4));
+    };
+
+    size_t end = 0;
+    for (auto const& s : segments_) {
+        if (s.address_ - end < HEX_SKIP) {
+            for (size_t a = end; a < (size_t)s.address_; ++a) {
+                put(a, 0);
+            }
+        }
+        if (!s.is_fill() || s.length_ < HEX_SKIP) {
+            for (size_t i = 0; i < s.length_; ++i) {
+                put(s.address_ + i, s.is_fill() ? 0 : s.bytes_[i]);
+            }
+        }
+        end = s.end();
+    }
+    if (have_word) {
+        flush();
+    }
+    os.write(out.data(), out.size());
+}
+
+//
+// NUM_INST/INST block in the format read by testbench/core_tb.v, which
+// loads words in order from address 0, so every word is written.
+//
+void image::write_testcase(
+    ostream& os) const
+{
+    size_t num_words = (size() + 3) / 4;
+    vector<unsigned int> words(num_words, 0);
+    for (auto const& s : segments_) {
+        if (s.is_fill()) {
+            continue;
+        }
+        for (size_t i = 0; i < s.length_; ++i) {
+            size_t address = s.address_ + i;
+            words[address / 4] |= (unsigned int)s.bytes_[i]
+                    << (8 * (address % 4));
+        }
+    }
+
+    string out = "NUM_INST " + std::to_string(num_words) + "\nINST\n";
+    char line[16];
+    for (unsigned int word : words) {
+        int n = snprintf(line, sizeof(line), "%08x\n", word);
+        out.append(line, n);
+    }
+    os.write(out.data(), out.size());
+}
+
+void image::write_segments(
+    ostream& os) const
+{
+    segment_file::header h;
+    memcpy(h.magic_, segment_file::MAGIC, sizeof(h.magic_));
+    h.num_segments_ = segments_.size();
+    h.reserved_ = 0;
+
+    vector<segment_file::record> records;
+    size_t offset = sizeof(h) + segments_.size() * sizeof(segment_file::record);
+    for (auto const& s : segments_) {
+        segment_file::record r;
+        r.address_ = s.address_;
+        r.length_ = s.length_;
+        if (s.is_fill()) {
+            r.offset_ = 0;
+            r.flags_ = segment_file::FILL;
+        } else {
+            offset = (offset + segment_file::ALIGNMENT - 1)
+                    & ~(segment_file::ALIGNMENT - 1);
+            r.offset_ = offset;
+            r.flags_ = 0;
+            offset += s.length_;
+        }
+        records.push_back(r);
+    }
+
+    os.write((const char *)&h, sizeof(h));
+    os.write((const char *)records.data(),
+            records.size() * sizeof(segment_file::record));
+    offset = sizeof(h) + records.size() * sizeof(segment_file::record);
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segments_[i].is_fill()) {
+            continue;
+        }
+        write_zeros(os, records[i].offset_ - offset);
+        os.write((const char *)segments_[i].bytes_.data(),
+                segments_[i].length_);
+        offset = records[i].offset_ + segments_[i].length_;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+using std::string;
+using std::vector;
+using std::ostream;
+
+//
+// In-memory copy of the assembled program. Bytes are collected during the
+// final pass and written out once in one of the supported formats.
+//
+// The image is kept as segments sorted by address. Addresses that were
+// never assembled, such as space reserved with STORAGE, lie between
+// segments and take no room. Long runs of assembled zeros, such as .align
+// padding, are kept as a length only.
+//
+class image {
+public:
+    enum image_format { TEXT, BINARY, HEX, TESTCASE, SEGMENTS };
+
+    //
+    // length_ bytes starting at address_. A zero fill has no bytes_.
+    //
+    struct segment {
+        int address_;
+        size_t length_;
+        vector<unsigned char> bytes_;
+
+        bool is_fill() const { return bytes_.empty(); }
+        size_t end() const { return address_ + length_; }
+    };
+
+    image() = default;
+
+    void add_byte(int address, int value);
+    void add_zeros(int address, size_t length);
+    void clear();
+
+    //
+    // Puts the segments in the one form that depends only on the bytes:
+    // each run of zeros between assembled bytes is a fill if it is long
+    // enough and bytes otherwise, and touching segments of bytes are
+    // joined. Patching fixups into fills leaves short fills behind, so
+    // this is done once the image is complete.
+    //
+    void compact();
+
+    size_t size() const;
+    const vector<segment>& segments() const { return segments_; }
+
+    void write(ostream& os, image_format format) const;
+
+    static bool parse_format(const string& name, image_format& format_out);
+    static string extension(image_format format);
+
+private:
+    void append(int value);
+    void write_at(int address, int value);
+    void merge(size_t index);
+    void push_zeros(
+        vector<segment>& out,
+        size_t address,
+        size_t length) const;
+
+    void write_text(ostream& os) const;
+    void write_binary(ostream& os) const;
+    void write_hex(ostream& os) const;
+    void write_testcase(ostream& os) const;
+    void write_segments(ostream& os) const;
+
+    vector<segment> segments_;
+
+    //
+    // Zeros at the end of the last segment, when it holds bytes. A long
+    // enough run is moved into a fill.
+    //
+    size_t trailing_zeros_ = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <cstring>
+#include <mutex>
+#include <shared_mutex>
+#include <string_view>
+
+#include "interner.h"
+
+using std::shared_lock;
+using std::shared_mutex;
+using std::string_view;
+using std::unique_lock;
+
+interner::interner() : name_arena_(65536)
+{
+    intern(".");
+}
+
+int interner::intern(
+    string_view name)
+{
+    int id;
+    if (find(name, &id)) {
+        return id;
+    }
+
+    unique_lock<shared_mutex> lock(mutex_);
+    auto it = ids_.find(name);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+
+    char *stored = name_arena_.allocate(name.length());
+    memcpy(stored, name.data(), name.length());
+    string_view stored_name(stored, name.length());
+
+    id = names_.size();
+    ids_.emplace(stored_name, id);
+    names_.push_back(stored_name);
+    return id;
+}
+
+bool interner::find(
+    string_view name,
+    int* id_out) const
+{
+    shared_lock<shared_mutex> lock(mutex_);
+    auto it = ids_.find(name);
+    if (it == ids_.end()) {
+        return false;
+    }
+    *id_out = it->second;
+    return true;
+}
+
+//
+// The name is stored in the arena, so the view stays valid after the lock
+// is released.
+//
+string_view interner::name(
+    int id) const
+{
+    shared_lock<shared_mutex> lock(mutex_);
+    return names_[id];
+}
+
+size_t interner::size() const
+{
+    shared_lock<shared_mutex> lock(mutex_);
+    return names_.size();
+}
\ No newline at end of file
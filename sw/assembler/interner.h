@@ -0,0 +1,60 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+
+using std::shared_mutex;
+using std::string;
+using std::string_view;
+using std::unordered_map;
+using std::vector;
+
+//
+// Hash and compare names as string_view so that lookups with a slice of the
+// source don't have to build a string first.
+//
+struct symbol_name_hash {
+    using is_transparent = void;
+    size_t operator()(string_view name) const
+    {
+        return std::hash<string_view>()(name);
+    }
+};
+
+//
+// Maps symbol names to small integer ids. Ids are shared by every symbol
+// table in the process, so tokens can be interned once when a file is
+// lexed and used by any number of assemblers. Safe to use from several
+// threads.
+//
+class interner {
+public:
+    //
+    // Id of ".", interned when the interner is created.
+    //
+    static const int DOT = 0;
+
+    interner();
+    interner(const interner&) = delete;
+    interner& operator=(const interner&) = delete;
+
+    int intern(string_view name);
+    bool find(string_view name, int* id_out) const;
+    string_view name(int id) const;
+    size_t size() const;
+
+private:
+    mutable shared_mutex mutex_;
+    unordered_map<string_view, int, symbol_name_hash, std::equal_to<>> ids_;
+    vector<string_view> names_;
+    arena<char> name_arena_;
+};
+
+#endif
\ No newline at end of file
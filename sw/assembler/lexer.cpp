@@ -0,0 +1,322 @@
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <vector>
+#include <cctype>
+
+#include "token.h"
+#include "interner.h"
+#include "lexer.h"
+
+using std::string;
+using std::string_view;
+using std::to_string;
+using std::vector;
+
+lexer::lexer(
+    string_view text, 
+    string_view name, 
+    int file, 
+    interner* names) : 
+        text_(text), name_(name), file_(file), names_(names)
+{
+    offset_ = 0;
+    line_ = 1;
+    depth_ = 0;
+}
+
+//
+// Appends a token tagged with the current file and line.
+//
+void lexer::emit(
+    vector<token>& tokens_out, 
+    token::token_type type, 
+    string_view text, 
+    int value)
+{
+    tokens_out.push_back(token(type, text, value));
+    tokens_out.back().file_ = file_;
+    tokens_out.back().line_ = line_;
+}
+
+//
+// Records the first error, tokenize() stops at it.
+//
+void lexer::error(const char* message)
+{
+    if (!error_.empty()) {
+        return;
+    }
+    if (!name_.empty()) {
+        error_ += name_;
+        error_ += ":" + to_string(line_) + ": ";
+    }
+    error_ += message;
+    offset_ = text_.length();
+}
+
+bool lexer::is_token_char(char c)
+{
+    return isalnum(c) || c == '$' || c == '_' || c == '.';
+}
+
+bool lexer::is_symbol_start_char(char c)
+{
+    return isalpha(c) || c == '$' || c == '_' || c == '.';
+}
+
+bool lexer::tokenize(
+    vector<token>& tokens_out)
+{
+    while (offset_ < text_.length()) {
+        char ch = text_[offset_];
+        char next = offset_ + 1 < text_.length() ? text_[offset_ + 1] : 0;
+
+        if (ch == '\n') {
+            offset_++;
+            if (depth_ == 0) {
+                emit(tokens_out, token::EOL, "", 0);
+            }
+            line_++;
+        } else if (isspace(ch)) {
+            offset_++;
+        } else if (ch == '|' || (ch == '/' && next == '/')) {
+            skip_line_comment();
+        } else if (ch == '/' && next == '*') {
+            int line = line_;
+            if (skip_block_comment() && depth_ == 0) {
+                int end_line = line_;
+                line_ = line;
+                emit(tokens_out, token::EOL, "", 0);
+                line_ = end_line;
+            }
+        } else if (isdigit(ch)) {
+            read_number(tokens_out);
+        } else if (is_symbol_start_char(ch)) {
+            read_symbol(tokens_out);
+        } else if (ch == '\'') {
+            read_char_literal(tokens_out);
+        } else if (ch == '\"') {
+            read_string(tokens_out);
+        } else {
+            if (ch == '(') {
+                depth_++;
+            } else if (ch == ')' && depth_ > 0) {
+                depth_--;
+            }
+            emit(tokens_out, token::PUNCT, text_.substr(offset_, 1), ch);
+            offset_++;
+        }
+    }
+
+    emit(tokens_out, token::END, "", 0);
+    return error_.empty();
+}
+
+//
+// Skips to the newline ending the comment, the newline itself becomes an EOL
+// token.
+//
+void lexer::skip_line_comment()
+{
+    while (offset_ < text_.length() && text_[offset_] != '\n') {
+        offset_++;
+    }
+}
+
+//
+// Returns true if the comment spanned a newline.
+//
+bool lexer::skip_block_comment()
+{
+    bool newline = false;
+    size_t end = text_.find("*/", offset_ + 2);
+    if (end == string_view::npos) {
+        error("unterminated comment");
+        return false;
+    }
+    for (; offset_ < end; ++offset_) {
+        if (text_[offset_] == '\n') {
+            newline = true;
+            line_++;
+        }
+    }
+    offset_ = end + 2;
+    return newline;
+}
+
+void lexer::read_symbol(
+    vector<token>& tokens_out)
+{
+    size_t start = offset_;
+    while (offset_ < text_.length() && is_token_char(text_[offset_])) {
+        offset_++;
+    }
+
+    string_view name = text_.substr(start, offset_ - start);
+    int d = token::NONE;
+    if (name[0] == '.') {
+        if (name == ".macro") {
+            d = token::MACRO;
+        } else if (name == ".align") {
+            d = token::ALIGN;
+        } else if (name == ".text") {
+            d = token::TEXT;
+        } else if (name == ".ascii") {
+            d = token::ASCII;
+        } else if (name == ".include") {
+            d = token::INCLUDE;
+        }
+    }
+    emit(tokens_out, token::SYMBOL, name, d);
+    if (names_ != NULL && d == token::NONE) {
+        tokens_out.back().symbol_ = names_->intern(name);
+    }
+}
+
+void lexer::read_number(
+    vector<token>& tokens_out)
+{
+    int base = 10;
+    size_t start = offset_;
+    while (offset_ < text_.length() && is_token_char(text_[offset_])) {
+        offset_++;
+    }
+    string_view number = text_.substr(start, offset_ - start);
+    string_view number_prefix = number.substr(0, 2);
+
+    if (number_prefix == "0x" || number_prefix == "0X") {
+        base = 16;
+        number = number.substr(2);
+    } else if (number_prefix == "0b" || number_prefix == "0B") {
+        base = 2;
+        number = number.substr(2);
+    } else if (number[0] == '0') {
+        if (number.length() > 1) {
+            base = 8;
+            number = number.substr(1);
+        }
+    }
+
+    unsigned long lresult = 0;
+    auto [end, ec] = std::from_chars(number.data(), 
+            number.data() + number.length(), lresult, base);
+    if (end == number.data()) {
+        string message = "bad number ";
+        message += text_.substr(start, offset_ - start);
+        error(message.c_str());
+        return;
+    }
+    emit(tokens_out, token::NUMBER, 
+            text_.substr(start, offset_ - start), (int)lresult);
+}
+
+void lexer::read_char_literal(
+    vector<token>& tokens_out)
+{
+    size_t start = offset_;
+    char ch = text_[offset_];
+    offset_ += 3;
+    if (offset_ < text_.length()) {
+        if (text_[offset_ - 2] == '\\') {
+            offset_++;
+            ch = text_[offset_ - 2];
+            switch (ch) {
+                case 'b': ch = '\b'; break;
+                case 'f': ch = '\f'; break;
+                case 'n': ch = '\n'; break;
+                case 'r': ch = '\r'; break;
+                case 't': ch = '\t'; break;
+            }
+        } else {
+            ch = text_[offset_ - 2];
+        }
+        if (offset_ < text_.length() && text_[offset_ - 1] == '\'') {
+            emit(tokens_out, token::NUMBER, 
+                    text_.substr(start, offset_ - start), (int)ch);
+            return;
+        }
+        error("bad character constant");
+        return;
+    }
+    error("unable to read char literal");
+}
+
+//
+// Finds the end of a double quoted string. The token holds the raw text
+// between the quotes, escapes are replaced when the string is assembled.
+//
+void lexer::read_string(
+    vector<token>& tokens_out)
+{
+    size_t start = ++offset_;
+    while (offset_ < text_.length()) {
+        char ch = text_[offset_++];
+        switch (ch) {
+            case '\"':
+                emit(tokens_out, token::STRING, 
+                        text_.substr(start, offset_ - 1 - start), 0);
+                return;
+            case '\n':
+                goto exit_loop;
+            case '\\':
+                if (offset_ < text_.length()) {
+                    offset_++;
+                }
+                break;
+        }
+    }
+    exit_loop:
+    error("unterminated string constant");
+}
+
+void lexer::decode_string(
+    string_view text,
+    string& bytes_out)
+{
+    size_t offset = 0;
+    while (offset < text.length()) {
+        char ch = text[offset++];
+        if (ch == '\\') {
+            if (offset < text.length()) {
+                ch = text[offset++];
+            }
+            switch (ch) {
+                case 'b': ch = '\b'; break;
+                case 'f': ch = '\f'; break;
+                case 'n': ch = '\n'; break;
+                case 'r': ch = '\r'; break;
+                case 't': ch = '\t'; break;
+                case '\\': ch = '\\'; break;
+                default:
+                    if (ch >= '0' && ch <= '7') {
+                        ch = read_octal_digits(ch, offset, text);
+                    }
+            }
+        }
+        bytes_out += ch;
+    }
+}
+
+int lexer::read_octal_digits(
+    char ch,
+    size_t& offset,
+    string_view text)
+{
+    int result = ch - '0';
+    if (offset < text.length()) {
+        ch = text[offset];
+        if (ch >= '0' && ch <= '7') {
+            offset++;
+            result = result * 8 + ch - '0';
+            if (offset < text.length()) {
+                ch = text[offset];
+                if (ch >= '0' && ch <= '7') {
+                    offset++;
+                    result = result * 7 + ch - '0';
+                }
+            }
+        }
+    }
+    return result;
+}
\ No newline at end of file
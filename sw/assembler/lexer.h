@@ -0,0 +1,61 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "token.h"
+#include "interner.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Splits source text into tokens. Comments are dropped, literals are
+// converted to their values and newlines inside parentheses are ignored so
+// that a statement ends at the first newline outside of an argument list.
+// Symbol names are interned as they are read when an interner is given.
+//
+class lexer {
+public:
+    lexer(
+        string_view text, 
+        string_view name = "", 
+        int file = -1, 
+        interner* names = NULL);
+
+    bool tokenize(vector<token>& tokens_out);
+    const string& error() const { return error_; }
+
+    static bool is_token_char(char c);
+    static bool is_symbol_start_char(char c);
+    static void decode_string(string_view text, string& bytes_out);
+
+private:
+    void emit(
+        vector<token>& tokens_out, 
+        token::token_type type, 
+        string_view text, 
+        int value);
+    void error(const char* message);
+    void skip_line_comment();
+    bool skip_block_comment();
+    void read_symbol(vector<token>& tokens_out);
+    void read_number(vector<token>& tokens_out);
+    void read_char_literal(vector<token>& tokens_out);
+    void read_string(vector<token>& tokens_out);
+    static int read_octal_digits(char ch, size_t& offset, string_view text);
+
+    string_view text_;
+    string_view name_;
+    int file_;
+    interner* names_;
+    string error_;
+    size_t offset_;
+    int line_;
+    int depth_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "line_map.h"
+
+using std::endl;
+using std::string;
+using std::string_view;
+using std::vector;
+
+const char line_map::MAGIC[] = "BETALINES";
+
+//
+// Returns the text up to the next newline and moves offset past it.
+//
+static string_view next_line(
+    string_view text,
+    size_t& offset)
+{
+    size_t end = text.find('\n', offset);
+    if (end == string_view::npos) {
+        end = text.size();
+    }
+    string_view line = text.substr(offset, end - offset);
+    offset = end < text.size() ? end + 1 : end;
+    return line;
+}
+
+//
+// Reads the next field of a line separated by spaces into value_out.
+//
+template <typename T>
+static bool next_number(
+    string_view line,
+    size_t& offset,
+    T& value_out,
+    int base = 10)
+{
+    while (offset < line.size() && line[offset] == ' ') {
+        offset++;
+    }
+    auto [end, ec] = std::from_chars(line.data() + offset,
+            line.data() + line.size(), value_out, base);
+    if (ec != std::errc()) {
+        return false;
+    }
+    offset = end - line.data();
+    return true;
+}
+
+//
+// Reads a "name N" line.
+//
+static bool read_count(
+    string_view text,
+    size_t& offset,
+    string_view name,
+    size_t& count_out)
+{
+    string_view line = next_line(text, offset);
+    size_t field = name.size();
+    return line.substr(0, field) == name
+            && next_number(line, field, count_out) && field == line.size();
+}
+
+void line_map::clear()
+{
+    files_.clear();
+    frames_.clear();
+    ranges_.clear();
+    frame_ids_.clear();
+}
+
+int line_map::add_file(
+    const string& name)
+{
+    files_.push_back(name);
+    return files_.size() - 1;
+}
+
+int line_map::add_frame(
+    int parent,
+    int file,
+    int line,
+    string_view name)
+{
+    auto key = std::make_tuple(parent, file, line, string(name));
+    auto found = frame_ids_.find(key);
+    if (found != frame_ids_.end()) {
+        return found->second;
+    }
+    frames_.push_back({ parent, file, line, string(name) });
+    frame_ids_.emplace(key, frames_.size() - 1);
+    return frames_.size() - 1;
+}
+
+//
+// Bytes nearly always come in increasing order, extending the last range.
+//
+void line_map::add_byte(
+    uint32_t address,
+    int frame)
+{
+    if (!ranges_.empty()) {
+        range& last = ranges_.back();
+        if (last.frame_ == frame && last.address_ + last.length_ == address) {
+            last.length_++;
+            return;
+        }
+    }
+    ranges_.push_back({ address, 1, frame });
+}
+
+//
+// Assigning to . can go back and assemble bytes over earlier ones; the
+// later range wins where they overlap, as the later bytes do in the image.
+//
+vector<line_map::range> line_map::sort_ranges(
+    vector<range> ranges)
+{
+    std::stable_sort(ranges.begin(), ranges.end(),
+            [](const range& a, const range& b) {
+                return a.address_ < b.address_;
+            });
+    vector<range> sorted;
+    for (auto r : ranges) {
+        while (!sorted.empty()
+                && sorted.back().address_ + sorted.back().length_
+                        > r.address_) {
+            range& last = sorted.back();
+            if (last.address_ >= r.address_) {
+                sorted.pop_back();
+            } else {
+                last.length_ = r.address_ - last.address_;
+            }
+        }
+        sorted.push_back(r);
+    }
+    return sorted;
+}
+
+void line_map::write(
+    ostream& os) const
+{
+    vector<range> ranges = sort_ranges(ranges_);
+    char line[64];
+
+    os << MAGIC << endl;
+    os << "files " << files_.size() << endl;
+    for (auto const& f : files_) {
+        os << f << endl;
+    }
+    os << "frames " << frames_.size() << endl;
+    for (auto const& f : frames_) {
+        os << f.parent_ << " " << f.file_ << " " << f.line_ << " "
+                << (f.name_.empty() ? "-" : f.name_) << endl;
+    }
+    os << "ranges " << ranges.size() << endl;
+    for (auto const& r : ranges) {
+        snprintf(line, sizeof(line), "%x %u %d", r.address_, r.length_,
+                r.frame_);
+        os << line << endl;
+    }
+}
+
+bool line_map::load(
+    const string& filename,
+    string& error_out)
+{
+    mapped_file file;
+    if (!file.open(filename)) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+    if (!read(file.text())) {
+        clear();
+        error_out = filename + " is not a valid line map\n";
+        return false;
+    }
+    return true;
+}
+
+//
+// Checks that every frame and range refers to something before it.
+//
+bool line_map::read(
+    string_view text)
+{
+    clear();
+    size_t offset = 0;
+    size_t count;
+
+    if (next_line(text, offset) != MAGIC
+            || !read_count(text, offset, "files ", count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (offset == text.size()) {
+            return false;
+        }
+        files_.push_back(string(next_line(text, offset)));
+    }
+
+    if (!read_count(text, offset, "frames ", count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        string_view line = next_line(text, offset);
+        size_t field = 0;
+        frame f;
+        if (!next_number(line, field, f.parent_)
+                || !next_number(line, field, f.file_)
+                || !next_number(line, field, f.line_)
+                || field >= line.size() || line[field] != ' '
+                || f.parent_ < -1 || f.parent_ >= (int)i
+                || f.file_ < 0 || f.file_ >= (int)files_.size()) {
+            return false;
+        }
+        string_view name = line.substr(field + 1);
+        f.name_ = name == "-" ? "" : string(name);
+        frames_.push_back(f);
+    }
+
+    if (!read_count(text, offset, "ranges ", count)) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        string_view line = next_line(text, offset);
+        size_t field = 0;
+        range r;
+        if (!next_number(line, field, r.address_, 16)
+                || !next_number(line, field, r.length_)
+                || !next_number(line, field, r.frame_)
+                || field != line.size()
+                || r.frame_ < 0 || r.frame_ >= (int)frames_.size()
+                || (!ranges_.empty() && ranges_.back().address_
+                        + ranges_.back().length_ > r.address_)) {
+            return false;
+        }
+        ranges_.push_back(r);
+    }
+    return true;
+}
+
+int line_map::find(
+    uint32_t address) const
+{
+    auto after = std::upper_bound(ranges_.begin(), ranges_.end(), address,
+            [](uint32_t a, const range& r) { return a < r.address_; });
+    if (after == ranges_.begin()) {
+        return -1;
+    }
+    const range& r = *(after - 1);
+    return address - r.address_ < r.length_ ? r.frame_ : -1;
+}
\ No newline at end of file
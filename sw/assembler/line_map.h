@@ -0,0 +1,87 @@
+#ifndef LINE_MAP_H
+#define LINE_MAP_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+using std::map;
+using std::ostream;
+using std::string;
+using std::string_view;
+using std::tuple;
+using std::vector;
+
+//
+// Where each assembled byte came from, written with "-l" for profilers.
+// A frame is a source line holding a statement, and points to the frame
+// of the macro call that expanded it, if any; a byte belongs to the frame
+// of the statement that assembled it. The bytes are kept as runs of
+// consecutive addresses in the same frame.
+//
+// The file is text, one item to a line:
+//
+//     BETALINES
+//     files N         then N file names
+//     frames N        then N of "parent file line name", parent being -1
+//                     outside macros and name the macro the statement
+//                     calls, or "-"
+//     ranges N        then N of "address length frame", the address in
+//                     hex, in increasing order of address
+//
+class line_map {
+public:
+    struct frame {
+        int parent_;
+        int file_;
+        int line_;
+        string name_;
+    };
+
+    struct range {
+        uint32_t address_;
+        uint32_t length_;
+        int frame_;
+    };
+
+    static const char MAGIC[];
+
+    line_map() = default;
+
+    void clear();
+
+    int add_file(const string& name);
+
+    //
+    // Returns the id of the frame, making it the first time.
+    //
+    int add_frame(int parent, int file, int line, string_view name);
+
+    void add_byte(uint32_t address, int frame);
+
+    void write(ostream& os) const;
+    bool load(const string& filename, string& error_out);
+
+    //
+    // Frame of the byte at address, or -1 if nothing was assembled there.
+    //
+    int find(uint32_t address) const;
+
+    const vector<string>& files() const { return files_; }
+    const vector<frame>& frames() const { return frames_; }
+
+private:
+    bool read(string_view text);
+    static vector<range> sort_ranges(vector<range> ranges);
+
+    vector<string> files_;
+    vector<frame> frames_;
+    vector<range> ranges_;
+    map<tuple<int, int, int, string>, int> frame_ids_;
+};
+
+#endif
\ No newline at end of file
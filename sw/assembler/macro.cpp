@@ -1,33 +1,18 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "token.h"
 #include "macro.h"
 
 using std::string;
+using std::string_view;
 using std::vector;
 using std::ostream;
 
-macro::macro(string& name, string& body, vector<string>& params) :
-        name_(name), body_(body), params_(params) 
+macro::macro(int name, int num_params, int* params, token* body) :
+        name_(name), num_params_(num_params), params_(params), body_(body) 
 {
-    called_ = false;
-}
-
-ostream& operator<<(ostream& os, const macro& m)
-{
-    os << "\nmacro " << m.name_ << "(";
-    vector<string>::const_iterator it = m.params_.begin();
-    if (m.params_.size() >= 2) {
-        for (; it != (m.params_.end() - 1); ++it) {
-            os << *it << ", ";
-        }
-        os << *it << ")";
-    } else if (m.params_.size() == 1) {
-        os << *it << ")";
-    } else {
-        os << ")";
-    }
-    os << " { " << m.body_ << " } ";
-    return os;
+    next_ = NULL;
 }
\ No newline at end of file
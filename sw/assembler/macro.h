@@ -2,24 +2,47 @@
 #define MACRO_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
+#include "token.h"
+
 using std::vector;
 using std::string;
+using std::string_view;
 using std::ostream;
 
+//
+// A macro definition. The parameter list and the body live in arenas owned
+// by the symbol table, so a macro is a small fixed size record. Definitions
+// loaded from a prelude are shared by several assemblers and never change
+// once built.
+//
 class macro {
 public:
     macro() = default;
-    macro(string& name, string& body, vector<string>& params);
+    macro(int name, int num_params, int* params, token* body);
 
-    string name_;
-    string body_;
-    vector<string> params_;
-    bool called_;
-};
+    int name_;
+    int num_params_;
+
+    //
+    // Symbol id bound to each parameter while the macro is expanded,
+    // indexed by argument position.
+    //
+    int* params_;
 
-ostream& operator<<(ostream& os, const macro& m);
+    //
+    // Tokens of the body, terminated by an END token. Symbols referenced by
+    // the body are resolved once and cached in the tokens.
+    //
+    token* body_;
+
+    //
+    // Next definition with the same name but a different parameter count.
+    //
+    macro* next_;
+};
 
 #endif
\ No newline at end of file
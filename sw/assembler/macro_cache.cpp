@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "macro.h"
+#include "symbol_table.h"
+#include "expression.h"
+#include "macro_cache.h"
+
+using std::vector;
+
+//
+// Larger alignments than this aren't worth keying expansions by.
+//
+static const int MAX_ALIGN = 4096;
+
+//
+// Every so many misses a macro that had fewer hits than misses is no
+// longer stored.
+//
+static const size_t HIT_RATE_PERIOD = 64;
+
+size_t macro_cache::key_hash::operator()(
+    const vector<int>& key) const
+{
+    size_t h = 14695981039346656037ull;
+    for (int v : key) {
+        h = (h ^ (unsigned int)v) * 1099511628211ull;
+    }
+    return h;
+}
+
+void macro_cache::clear()
+{
+    infos_.clear();
+    frames_.clear();
+    recorded_.clear();
+}
+
+macro_cache::lookup_result macro_cache::lookup(
+    const macro* m,
+    const vector<operand>& args,
+    const symbol_table& st,
+    int dot,
+    const vector<unsigned char>*& bytes)
+{
+    bytes = NULL;
+    info& i = infos_[m];
+    if (i.state_ == info::UNCACHEABLE) {
+        rule_out();
+        return BYPASS;
+    }
+
+    for (auto const& a : args) {
+        if (a.is_pending()) {
+            set_all(&frame::complete_);
+            return BYPASS;
+        }
+    }
+    if (dot < 0) {
+        set_all(&frame::complete_);
+        return BYPASS;
+    }
+
+    if (i.disabled_) {
+        return recording() ? MISS : BYPASS;
+    }
+    if (i.state_ == info::UNKNOWN) {
+        misses_++;
+        return MISS;
+    }
+    key_.clear();
+    for (auto const& a : args) {
+        key_.push_back(a.value_);
+    }
+    if (!complete_key(i, st, dot)) {
+        set_all(&frame::complete_);
+        return BYPASS;
+    }
+
+    auto it = i.entries_.find(key_);
+    if (it == i.entries_.end()) {
+        misses_++;
+        i.misses_++;
+        if (i.misses_ % HIT_RATE_PERIOD == 0 && i.hits_ < i.misses_) {
+            i.disabled_ = true;
+            i.entries_.clear();
+        }
+        return recording() || !i.disabled_ ? MISS : BYPASS;
+    }
+
+    //
+    // The expansion isn't scanned, so any open recording is told what it
+    // would have read.
+    //
+    if (recording()) {
+        for (int id : i.free_symbols_) {
+            record_symbol(id, st[id]);
+        }
+        record_align(i.align_);
+    }
+    hits_++;
+    i.hits_++;
+    bytes = &it->second;
+    return HIT;
+}
+
+void macro_cache::start(
+    const macro* m,
+    const vector<operand>& args,
+    int dot)
+{
+    const info& i = infos_[m];
+    frame f;
+    f.macro_ = m;
+    for (auto const& a : args) {
+        f.args_.push_back(a.value_);
+    }
+    f.dot_ = dot;
+    f.first_byte_ = recorded_.size();
+    f.collecting_ = i.state_ == info::UNKNOWN;
+    f.store_ = !i.disabled_;
+    f.align_ = f.collecting_ ? 1 : i.align_;
+    f.eligible_ = true;
+    f.complete_ = true;
+    frames_.push_back(std::move(f));
+}
+
+void macro_cache::finish(
+    const symbol_table& st)
+{
+    frame f = std::move(frames_.back());
+    frames_.pop_back();
+
+    info& i = infos_[f.macro_];
+    if (!f.eligible_) {
+        i.state_ = info::UNCACHEABLE;
+        i.entries_.clear();
+    } else if (f.complete_ && f.store_) {
+        if (f.collecting_) {
+            i.state_ = info::CACHEABLE;
+            i.free_symbols_ = std::move(f.free_symbols_);
+            i.align_ = f.align_;
+        }
+        key_.assign(f.args_.begin(), f.args_.end());
+        if (complete_key(i, st, f.dot_)) {
+            i.entries_.emplace(key_, vector<unsigned char>(
+                    recorded_.begin() + f.first_byte_, recorded_.end()));
+        }
+    }
+
+    if (frames_.empty()) {
+        recorded_.clear();
+    }
+}
+
+void macro_cache::record_byte(
+    int value)
+{
+    if (recording()) {
+        recorded_.push_back((unsigned char)(value & 0xFF));
+    }
+}
+
+//
+// A symbol bound to a parameter of a macro being recorded is an argument of
+// that recording and of the ones it is nested in. Any other symbol is free
+// and its value becomes part of the key.
+//
+void macro_cache::record_symbol(
+    int symbol_id,
+    const symbol& s)
+{
+    if (symbol_id == symbol_table::DOT) {
+        rule_out();
+        return;
+    }
+
+    bool known = s.type_ != symbol::UNDEF && s.expr_ < 0;
+    for (size_t n = frames_.size(); n-- > 0; ) {
+        frame& f = frames_[n];
+        const macro* m = f.macro_;
+        if (std::find(m->params_, m->params_ + m->num_params_, symbol_id)
+                != m->params_ + m->num_params_) {
+            break;
+        }
+
+        if (!known) {
+            f.complete_ = false;
+        }
+        if (f.collecting_ && std::find(f.free_symbols_.begin(),
+                f.free_symbols_.end(), symbol_id) == f.free_symbols_.end()) {
+            f.free_symbols_.push_back(symbol_id);
+        }
+    }
+}
+
+void macro_cache::record_align(
+    int align)
+{
+    for (auto& f : frames_) {
+        if (align <= 0) {
+            f.eligible_ = false;
+            continue;
+        }
+        f.align_ = std::lcm(f.align_, align);
+        if (f.align_ > MAX_ALIGN) {
+            f.eligible_ = false;
+            f.align_ = 1;
+        }
+    }
+}
+
+//
+// Key of an expansion: the arguments, which the caller has put in key_,
+// followed by "." modulo the alignment and the values of the free symbols.
+// Returns false if a free symbol has no value yet.
+//
+bool macro_cache::complete_key(
+    const info& i,
+    const symbol_table& st,
+    int dot)
+{
+    key_.push_back(dot % i.align_);
+    for (int id : i.free_symbols_) {
+        const symbol& s = st[id];
+        if (s.type_ == symbol::UNDEF || s.expr_ >= 0) {
+            return false;
+        }
+        key_.push_back(s.value_);
+    }
+    return true;
+}
+
+void macro_cache::set_all(
+    bool frame::* flag)
+{
+    for (auto& f : frames_) {
+        f.*flag = false;
+    }
+}
\ No newline at end of file
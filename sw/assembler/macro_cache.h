@@ -0,0 +1,136 @@
+#ifndef MACRO_CACHE_H
+#define MACRO_CACHE_H
+
+#include <unordered_map>
+#include <vector>
+
+#include "macro.h"
+#include "symbol_table.h"
+#include "expression.h"
+
+using std::unordered_map;
+using std::vector;
+
+//
+// Bytes produced by earlier expansions of a macro, keyed by the argument
+// values. Only macros whose output is a function of their arguments, the
+// symbols they read from outside and the alignment of "." are cached. A
+// macro is checked the first time it is expanded: reading ".", defining a
+// label, assigning a symbol, defining a macro, including a file or an
+// .align that isn't a constant, directly or in any macro it calls, rule it
+// out for the rest of the pass.
+//
+// While a macro is expanded without a hit it is recorded: the assembler
+// reports each byte and each symbol read, and the bytes are stored when the
+// expansion is done. Expansions nest, so several recordings may be open.
+//
+// Recording costs more than expanding, so a macro that is rarely called
+// twice with the same key, such as an instruction with many different
+// operands, stops being stored after a while. It is still recorded without
+// storing while a macro that calls it is.
+//
+class macro_cache {
+public:
+    enum lookup_result { HIT, MISS, BYPASS };
+
+    macro_cache() = default;
+
+    //
+    // Forgets every expansion. Called at the start of each pass, since
+    // symbols may change value between passes.
+    //
+    void clear();
+
+    //
+    // Looks up a call of m at dot. On a hit bytes points to the expansion,
+    // which the caller assembles in place of the body. On a miss the caller
+    // expands the body between start() and finish(). A call with a pending
+    // argument, or one of a macro that can't be cached, is expanded without
+    // recording.
+    //
+    lookup_result lookup(
+        const macro* m,
+        const vector<operand>& args,
+        const symbol_table& st,
+        int dot,
+        const vector<unsigned char>*& bytes);
+
+    void start(
+        const macro* m,
+        const vector<operand>& args,
+        int dot);
+    void finish(const symbol_table& st);
+
+    bool recording() const { return !frames_.empty(); }
+    void record_byte(int value);
+    void record_symbol(int symbol_id, const symbol& s);
+    void record_align(int align);
+    void rule_out() { set_all(&frame::eligible_); }
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct key_hash {
+        size_t operator()(const vector<int>& key) const;
+    };
+
+    struct info {
+        enum state { UNKNOWN, CACHEABLE, UNCACHEABLE };
+
+        state state_ = UNKNOWN;
+
+        //
+        // Symbols read by the body or the macros it calls that are not
+        // bound to parameters along the way, and the alignment the output
+        // depends on.
+        //
+        vector<int> free_symbols_;
+        int align_ = 1;
+
+        size_t hits_ = 0;
+        size_t misses_ = 0;
+        bool disabled_ = false;
+
+        unordered_map<vector<int>, vector<unsigned char>, key_hash> entries_;
+    };
+
+    struct frame {
+        const macro* macro_;
+        vector<int> args_;
+        int dot_;
+        size_t first_byte_;
+
+        //
+        // Set when the free symbols are being found by this expansion.
+        //
+        bool collecting_;
+        bool store_;
+        vector<int> free_symbols_;
+        int align_;
+
+        //
+        // eligible_ is cleared when the body has a side effect, which rules
+        // the macro out. complete_ is cleared when this particular expansion
+        // read an undefined or pending value, or part of it wasn't recorded.
+        //
+        bool eligible_;
+        bool complete_;
+    };
+
+    bool complete_key(
+        const info& i,
+        const symbol_table& st,
+        int dot);
+    void set_all(bool frame::* flag);
+
+    unordered_map<const macro*, info> infos_;
+    vector<frame> frames_;
+    vector<unsigned char> recorded_;
+    vector<int> key_;
+
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+#endif
\ No newline at end of file
@@ -1,758 +1,270 @@
 #include <iostream>
 #include <fstream>
-#include <istream>
-#include <sstream>
-#include <streambuf>
 #include <string>
 #include <vector>
-#include <cctype>
-#include <unordered_map>
-#include <iomanip>
-
-#include "macro.h"
-#include "symbol.h"
-#include "symbol_table.h"
-
-using std::cin;
+#include <atomic>
+#include <thread>
+#include <cstdlib>
+
+#include "source_cache.h"
+#include "image.h"
+#include "prelude.h"
+#include "assembler.h"
+#include "statistics.h"
+#include "line_map.h"
+
+using std::atomic;
+using std::cerr;
 using std::cout;
 using std::endl;
 using std::string;
-using std::pair;
-using std::ifstream;
-using std::istringstream;
-using std::stringstream;
-using std::istreambuf_iterator;
+using std::ofstream;
+using std::thread;
 using std::vector;
-using std::unordered_map;
-
-static symbol_table g_symbol_table;
-static symbol* g_dot;
-static int pass;
-static int max_dot;
-
-string get_file_string(string& filename);
-bool is_token_char(char c);
-bool is_symbol_start_char(char c);
-bool check_for_char(char c, size_t& offset, string& text);
-bool is_eol(char c);
-
-void scan(string& text);
-void read_macro(size_t& offset, string& text);
-string read_string(size_t& offset, string& text);
-bool read_expression(size_t& offset, string& text, int& result);
-bool read_term(size_t& offset, string& text, int& result);
-void read_operand(size_t& offset, string& text);
-int read_literal(size_t& offset, string& text);
-int read_char_literal(size_t& offset, string& text);
-int read_symbol_value(size_t& offset, string& text);
-void call_macro(vector<int> macro_args, macro *m);
-void assign_label(size_t& offset, string& token);
-void assign_value(size_t& offset, string& text, string& token);
-void assemble_byte(int v);
-void assemble_string(size_t& offset, string& text);
-int assemble_octal_digits(char ch, size_t& offset, string& text);
-
-void get_macro_info(
-    size_t& offset,
-    string& text,
-    string& macro_name,
-    vector<int>& macro_args,
-    macro*& m);
 
-string get_file_string(string& filename)
+void usage();
+
+bool write_image(
+    const image& img,
+    const string& output_filename,
+    image::image_format format,
+    string& error_out);
+
+int assemble_batch(
+    const vector<string>& filenames,
+    source_cache& sources,
+    const prelude* p,
+    bool one_pass,
+    image::image_format format,
+    int jobs,
+    statistics* stats);
+
+void write_statistics(
+    const statistics& stats,
+    source_cache& sources,
+    bool json);
+
+bool write_image(
+    const image& img,
+    const string& output_filename,
+    image::image_format format,
+    string& error_out)
 {
-    ifstream ifs(filename);
-    return string((istreambuf_iterator<char>(ifs)), 
-            istreambuf_iterator<char>());
-}
-
-void skip_blanks(size_t& offset, string& text)
-{
-    while (offset < text.length() && isspace(text[offset])) {
-        offset++;
+    ofstream ofs(output_filename, std::ios::binary);
+    if (!ofs) {
+        error_out = "unable to open output file " + output_filename + "\n";
+        return false;
     }
+    img.write(ofs, format);
+    return true;
 }
 
-bool is_token_char(char c)
+void write_statistics(
+    const statistics& stats,
+    source_cache& sources,
+    bool json)
 {
-    return isalnum(c) || c == '$' || c == '_' || c == '.';
-}
-
-bool is_symbol_start_char(char c)
-{
-    return isalpha(c) || c == '$' || c == '_' || c == '.';
-}
-
-bool is_eol(char c)
-{
-    return c == '\n' || c == '|' || c == '\0';
-}
-
-void skip_token(size_t& offset, string& text)
-{
-    while (offset < text.length() && is_token_char(text[offset])) {
-        offset++;
-    }
-}
-
-bool check_for_char(char c, size_t& offset, string& text)
-{
-    skip_blanks(offset, text);
-    if (offset < text.length() && text[offset] == c) {
-        offset++;
-        return true;
+    if (json) {
+        stats.write_json(cerr, sources.names());
+    } else {
+        stats.write_text(cerr, sources.names());
     }
-    return false;
 }
 
 //
-// TODO: Implement error handling code
+// Assembles each file on a pool of worker threads, one assembler per
+// worker. Every output is written next to its source, with the extension
+// of the format replacing ".uasm". Errors are printed in the order of the
+// files once all of them are done. Statistics, if wanted, are collected
+// per worker and added up in stats.
 //
-void read_macro(
-    size_t& offset, 
-    string& text)
+int assemble_batch(
+    const vector<string>& filenames,
+    source_cache& sources,
+    const prelude* p,
+    bool one_pass,
+    image::image_format format,
+    int jobs,
+    statistics* stats)
 {
-    size_t start = offset;
-    skip_token(offset, text);
+    vector<string> errors(filenames.size());
+    atomic<size_t> next(0);
 
-    if (offset == start) {
-        cout << "expected name following .macro" << endl;
-        exit(-1);
+    if (jobs > (int)filenames.size()) {
+        jobs = filenames.size();
     }
+    vector<statistics> worker_stats(jobs);
 
-    string macro_name = text.substr(start, offset - start);
-    vector<string> macro_params;
-    string macro_body;
-
-    //
-    // See if parenthesized list follows. If it does, each entry should be
-    // a symbol.
-    //
-    if (check_for_char('(', offset, text)) {
-        while (true) {
-            if (check_for_char(')', offset, text)) {
-                break;
-            }
-            
-            if (offset >= text.length()) {
-                cout << "expected ')' in macro definition" << endl;
-                exit(-1);
-            }
-            
-            char ch = text[offset];
-            if (!is_symbol_start_char(ch)) {
-                cout << "symbol expected in macro parameter list" << endl;
-                exit(-1);
-            }
-
-            start = offset;
-            skip_token(offset, text);
-            macro_params.push_back(text.substr(start, offset - start));
-
-            skip_blanks(offset, text);
-            if (offset < text.length() && text[offset] == ',') {
-                offset++;
-            }
+    auto worker = [&](int index) {
+        assembler a(sources, p, one_pass);
+        if (stats != NULL) {
+            a.set_statistics(&worker_stats[index]);
         }
-    }
-
-    // Read the body of the macro
-    size_t end;
-    if (check_for_char('{', offset, text)) {
-        end = text.find_first_of('}', offset);
-    } else {
-        end = text.find_first_of('\n', offset);
-    }
-
-    if (end == string::npos) {
-        end = text.length();
-    }
-
-    macro_body = text.substr(offset, end - offset);
-    offset = end + 1;
-
-    if (!g_symbol_table.add_macro(macro_name, macro_params, macro_body)) {
-        cout << "pass: " << pass << endl;
-        cout << "failed to add macro " << macro_name << endl;
-        exit(-1);
-    }
-}
-
-void scan(string& text)
-{
-    size_t offset = 0;
-
-    while (offset < text.length()) {
-        skip_blanks(offset, text);
-        if (offset < text.length() && !is_eol(text[offset])) {
-            skip_blanks(offset, text);
-            size_t start = offset;
-            skip_token(offset, text);
-            string token = text.substr(start, offset - start);
-            skip_blanks(offset, text);
-            char ch;
-
-            if (offset < text.length()) {
-                ch = text[offset];
-            } else {
-                ch = 0;
-            }
-
-            if (token == ".macro") {
-                read_macro(offset, text);
-                continue;
-            } else if (token == ".align") {
-                int align = 4;
-                if (!is_eol(ch)) {
-                    read_expression(offset, text, align);
-                }
-                while ((g_dot->value_ % align) != 0) {
-                    assemble_byte(0);
-                }
-                continue;
-            } else if (token == ".text") {
-                assemble_string(offset, text);
-                assemble_byte(0);
-                while (g_dot->value_ % 4 != 0) {
-                    assemble_byte(0);
-                }
-                continue;
-            } else if (token == ".ascii") {
-                assemble_string(offset, text);
-                continue;
-            }
-
-            if (ch == ':') {
-                assign_label(offset, token);
-                continue;
-            } else if (ch == '=') {
-                assign_value(offset, text, token);
+        for (size_t i = next++; i < filenames.size(); i = next++) {
+            const string& filename = filenames[i];
+            if (!a.assemble(filename)) {
+                errors[i] = a.error();
                 continue;
             }
 
-            //
-            // This is not a special form, so read operands and place their 
-            // value into memory.
-            //
-            offset = start;
-            while (offset < text.length() && !is_eol(text[offset])) {
-                read_operand(offset, text);
-                skip_blanks(offset, text);
-                if (offset < text.length() && text[offset] == ',') {
-                    offset++;
-                }
+            string output_filename = filename;
+            size_t suffix = output_filename.rfind(".uasm");
+            if (suffix != string::npos
+                    && suffix + 5 == output_filename.length()) {
+                output_filename.erase(suffix);
             }
+            output_filename += image::extension(format);
+            write_image(a.get_image(), output_filename, format, errors[i]);
         }
+    };
 
-        //
-        // Now we are at the EOL marker (which might be a comment char)
-        // So we have to skip until we find the actual end of the line.
-        //
-        while (offset < text.length() && text[offset] != '\n') {
-            offset++;
-        }
-
-        // Skip the newline.
-        offset++;
+    vector<thread> workers;
+    for (int i = 0; i < jobs; ++i) {
+        workers.emplace_back(worker, i);
     }
-}
-
-void assign_value(
-    size_t& offset,
-    string& text,
-    string& token)
-{
-    offset++;
-    symbol *s = NULL;
-    if (g_symbol_table.get_symbol(token, true, &s)) {
-        int v;
-        if (read_expression(offset, text, v)) {
-            if (s->type_ == symbol::LABEL) {
-                cout << "illegal redefinition of symbol " 
-                        << token << endl;
-                exit(-1);
-            } else {
-                s->type_ = symbol::ASSIGN;
-                s->value_ = v;
-                if (s->name_ == "." && g_dot->value_ > max_dot) {
-                    max_dot = g_dot->value_;
-                }
-            }
-        }
-    }    
-}
-
-void assign_label(
-    size_t& offset,
-    string& token)
-{
-    offset++;
-    symbol *s = NULL;
-    if (g_symbol_table.get_symbol(token, true, &s)) {
-        if (pass == 1) {
-            if (s->type_ != symbol::UNDEF) {
-                cout << "multiply defined symbol " << token << endl;
-                exit(-1);
-            } else {
-                s->type_ = symbol::LABEL;
-                s->value_ = g_dot->value_;
-            }
-        } else {
-            if (s->value_ != g_dot->value_) {
-                cout << "phase error in symbol definition "
-                        << token << endl;
-                exit(-1);
-            }
-        }
-    }    
-}
-
-string read_string(
-    size_t& offset, 
-    string& text)
-{
-    skip_blanks(offset, text);
-    stringstream result;
-
-    if (!check_for_char('\"', offset, text)) {
-        cout << "expected double-quote as start of string" << endl;
-        exit(-1);
+    for (auto& t : workers) {
+        t.join();
     }
-
-    loop:
-    while (offset < text.length()) {
-        char ch = text[offset++];
-        switch (ch) {
-            case '\"': return result.str();
-            case '\n': goto loop;
-            case '\\':
-                if (offset < text.length()) {
-                    ch = text[offset++];
-                    switch (ch) {
-                        case 'b': ch = '\b'; break;
-                        case 'f': ch = '\f'; break;
-                        case 'n': ch = '\n'; break;
-                        case 'r': ch = '\r'; break;
-                        case 't': ch = '\t'; break;
-                    }
-                }
-            default: result << ch; break;
+    if (stats != NULL) {
+        for (auto const& s : worker_stats) {
+            stats->merge(s);
         }
     }
 
-    cout << "unterminated string constant" << endl;
-    exit(-1);
-    return result.str();
-}
-
-int read_literal(
-    size_t& offset,
-    string& text)
-{
-    int base = 10;
-    size_t start = offset;
-    skip_token(offset, text);
-    string number = text.substr(start, offset - start);
-    string number_prefix = number.substr(0, 2);
-
-    if (number_prefix == "0x" || number_prefix == "0X") {
-        base = 16;
-        number = number.substr(2);
-    } else if (number_prefix == "0b" || number_prefix == "0B") {
-        base = 2;
-        number = number.substr(2);
-    } else if (number[0] == '0') {
-        if (number.length() > 1) {
-            base = 8;
-            number = number.substr(1);
+    int failed = 0;
+    for (auto const& error : errors) {
+        if (!error.empty()) {
+            cout << error;
+            failed++;
         }
     }
-
-    unsigned long lresult = std::stoul(number, nullptr, base);
-    return (int)lresult;   
+    return failed == 0 ? 0 : -1;
 }
 
-int read_symbol_value(
-    size_t& offset,
-    string& text)
+void usage()
 {
-    size_t start = offset;
-    skip_token(offset, text);
-    string name = text.substr(start, offset - start);
-    symbol *s = NULL;
-
-    if (g_symbol_table.get_symbol(name, true, &s)) {
-        if (pass == 2 && s->type_ == symbol::UNDEF) {
-            cout << "undefined symbol " << name << endl;
-            cout << g_symbol_table;
-            exit(-1);
-        } else {
-            return s->value_;
-        }
-    } else {
-        cout << "error getting symbol" << endl;
-        exit(-1);
-    }    
+    cout << "usage: assembler [-1] [-p prelude] [--snapshots dir] "
+            << "[-f text|bin|hex|testcase|seg] [-o output] [-l line_map] "
+            << "[--stats[=json]] file" << endl;
+    cout << "       assembler [-1] [-p prelude] [--snapshots dir] "
+            << "[-f text|bin|hex|testcase|seg] [-j jobs] [--stats[=json]] "
+            << "file..." << endl;
 }
 
-bool read_char_literal(
-    size_t& offset,
-    string& text,
-    int& result)
-{
-    char ch = text[offset];
-    offset += 3;
-    if (offset < text.length()) {
-        if (text[offset - 2] == '\\') {
-            offset++;
-            ch = text[offset - 2];
-            switch (ch) {
-                case 'b': ch = '\b'; break;
-                case 'f': ch = '\f'; break;
-                case 'n': ch = '\n'; break;
-                case 'r': ch = '\r'; break;
-                case 't': ch = '\t'; break;
-            }        
-        } else {
-            ch = text[offset - 2];
-        }
-        if (offset < text.length() && text[offset - 1] == '\'') {
-            result = (int)ch;
-            return true;
-        }
-        cout << "bad character constant" << endl;
-        exit(-1);
-    }
-    return false;
-}
-
-bool read_term(
-    size_t& offset, 
-    string& text, 
-    int& result)
+int main(
+    int argc,
+    char *argv[])
 {
-    skip_blanks(offset, text);
-    bool ret = true;
-
-    if (offset >= text.length()) {
-        ret = false;
-    }
-
-    char ch = text[offset];
-
-    if (isdigit(ch)) {
-        result = read_literal(offset, text);
-    } else if (is_symbol_start_char(ch)) {
-        result = read_symbol_value(offset, text);
-    } else if (ch == '\'') {
-        if (!read_char_literal(offset, text, result)) {
-            cout << "unable to read char literal" << endl;
-            exit(-1);
-        }
-    } else if (ch == '-') {
-        offset++;
-        read_term(offset, text, result);
-        result = -result;
-    } else if (ch == '~') {
-        offset++;
-        read_term(offset, text, result);
-        result = ~result;
-    } else if (ch == '(') {
-        offset++;
-        if (read_expression(offset, text, result)) {
-            skip_blanks(offset, text);
-            if (offset >= text.length() || text[offset] != ')') {
-                cout << "unbalanced parenthesis in expression" << endl;
-                cout << offset << " " << text[offset] << endl;
-                exit(-1);
-            } else {
-                offset++;
+    vector<string> filenames;
+    string output_filename;
+    string prelude_filename;
+    string line_map_filename;
+    string snapshot_directory;
+    image::image_format format = image::TEXT;
+    bool one_pass = false;
+    bool show_stats = false;
+    bool json_stats = false;
+    int jobs = thread::hardware_concurrency();
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            if (!image::parse_format(argv[++i], format)) {
+                cout << "unknown output format " << argv[i] << endl;
+                usage();
+                return -1;
             }
+        } else if (arg == "-p" && i + 1 < argc) {
+            prelude_filename = argv[++i];
+        } else if (arg == "-j" && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (arg == "-1") {
+            one_pass = true;
+        } else if (arg == "-o" && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (arg == "-l" && i + 1 < argc) {
+            line_map_filename = argv[++i];
+        } else if (arg == "--snapshots" && i + 1 < argc) {
+            snapshot_directory = argv[++i];
+        } else if (arg == "--stats" || arg == "--stats=json") {
+            show_stats = true;
+            json_stats = arg == "--stats=json";
+        } else if (arg[0] != '-') {
+            filenames.push_back(arg);
+        } else {
+            usage();
+            return -1;
         }
-    } else {
-        cout << "illegal term in expression " << offset << endl;
-        cout << text.substr(offset) << endl;
-        exit(-1);
     }
 
-    return ret;
-}
-
-bool read_expression(
-    size_t& offset, 
-    string& text, 
-    int& result)
-{
-    int term;
-    bool valid = read_term(offset, text, result);
-
-    while (valid) {
-        skip_blanks(offset, text);
-        if (offset >= text.length()) {
-            break;
-        }
-
-        switch (text[offset++]) {
-            case '+':
-                if (valid = read_term(offset, text, term)) {
-                    result = result + term;
-                }
-                continue;
-            case '-':
-                if (valid = read_term(offset, text, term)) {
-                    result = result - term;
-                }
-                continue;
-            case '*':
-                if (valid = read_term(offset, text, term)) {
-                    result = result * term;
-                }
-                continue;
-            case '/':
-                if (valid = read_term(offset, text, term)) {
-                    result = result / term;
-                }
-                continue;
-            case '%':
-                if (valid = read_term(offset, text, term)) {
-                    result = result % term;
-                    result = result < 0 ? result + term : result;
-                }
-                continue;
-            case '>':
-                if (check_for_char('>', offset, text)) {
-                    if (valid = read_term(offset, text, term)) {
-                        result = result >> term;
-                    }
-                    continue;
-                }
-                offset--;
-                goto exit;
-            case '<':
-                if (check_for_char('<', offset, text)) {
-                    if (valid = read_term(offset, text, term)) {
-                        result = result << term;
-                    }
-                    continue;
-                }
-                offset--;
-                goto exit;
-            default:
-                offset--;
-                goto exit;
-        }
+    if (filenames.empty()
+            || (filenames.size() > 1
+                    && (!output_filename.empty()
+                            || !line_map_filename.empty()))) {
+        usage();
+        return -1;
     }
-
-    exit:
-    return valid;
-}
-
-void get_macro_info(
-    size_t& offset,
-    string& text,
-    string& macro_name,
-    vector<int>& macro_args,
-    macro*& m)
-{
-    while (true) {
-        if (check_for_char(')', offset, text)) {
-            break;
-        }
-        check_for_char(',', offset, text);
-        int v;
-        if (read_expression(offset, text, v)) {
-            macro_args.push_back(v);
-        } else {
-            cout << "expression or close paren expected" << endl;
-            exit(-1);
-        }
+    if (jobs < 1) {
+        jobs = 1;
     }
 
-    if (g_symbol_table.get_macro(macro_name, macro_args.size(), &m)) {
-        if (m->called_) {
-            cout << "recursive call to macro " << macro_name << endl;
-            exit(-1);
+    source_cache sources;
+    prelude p;
+    p.set_snapshot_directory(snapshot_directory);
+    if (!prelude_filename.empty()) {
+        string error;
+        if (!p.load(prelude_filename, sources, error)) {
+            cout << error;
+            return -1;
         }
-    } else {
-        cout << "can't find macro definition for " << macro_name 
-                << " with " << macro_args.size() 
-                << " arguments" << endl;
-        exit(-1);
     }
-}
-
-void read_operand(
-    size_t& offset, 
-    string& text)
-{
-    skip_blanks(offset, text);
-
-    if (is_symbol_start_char(text[offset])) {
-        size_t start = offset;
-        skip_token(offset, text);
-        size_t end = offset;
-
-        if (check_for_char('(', offset, text)) {         
-            string macro_name = text.substr(start, end - start);
-            vector<int> macro_args;
-            macro *m = NULL;
-            get_macro_info(offset, text, macro_name, macro_args, m);
-            call_macro(macro_args, m);
-            return;
+    const prelude* pp = prelude_filename.empty() ? NULL : &p;
+
+    statistics stats;
+    if (filenames.size() > 1) {
+        int result = assemble_batch(filenames, sources, pp, one_pass,
+                format, jobs, show_stats ? &stats : NULL);
+        if (show_stats) {
+            write_statistics(stats, sources, json_stats);
         }
-        
-        offset = start;
-    }
-
-    int v;
-    if (read_expression(offset, text, v)) {
-        assemble_byte(v);
-    } else {
-        cout << "illegal operand" << endl;
-        exit(-1);
+        return result;
     }
-}
 
-void call_macro(
-    vector<int> macro_args,
-    macro *m)
-{
-    m->called_ = true;
-    vector<int> saved_values;
-    vector<symbol::symbol_type> saved_types;
-
-    for (int i = 0; i < m->params_.size(); ++i) {
-        symbol *s = NULL;
-        if (g_symbol_table.get_symbol(m->params_[i], true, &s)) {
-            saved_values.push_back(s->value_);
-            saved_types.push_back(s->type_);        
-            s->value_ = macro_args[i];
-            s->type_ = symbol::ASSIGN;
-        } else {
-            cout << "could not find symbol " << m->params_[i] << endl;
-            exit(-1);
-        }
+    assembler a(sources, pp, one_pass);
+    if (show_stats) {
+        a.set_statistics(&stats);
     }
-
-    scan(m->body_);
-    m->called_ = false;
-
-    for (int i = 0; i < m->params_.size(); ++i) {
-        symbol *s = NULL;
-        if (g_symbol_table.get_symbol(m->params_[i], true, &s)) {      
-            s->value_ = saved_values[i];
-            s->type_ = saved_types[i];
-        } else {
-            cout << "could not find symbol " << m->params_[i] << endl;
-            exit(-1);
-        }
+    line_map map;
+    if (!line_map_filename.empty()) {
+        a.set_line_map(&map);
     }
-}
-
-void assemble_byte(int v)
-{
-    if (pass == 2) {
-        cout << "mem[" << g_dot->value_ << "] = 0x" << std::hex << 
-                std::setw(2) << std::setfill('0') << (0xFF & v) << 
-                std::dec << endl;
+    bool assembled = a.assemble(filenames[0]);
+    if (show_stats) {
+        write_statistics(stats, sources, json_stats);
     }
-
-    g_dot->value_++;
-
-    if (g_dot->value_ > max_dot) {
-        max_dot = g_dot->value_;
+    if (!assembled) {
+        cout << a.error();
+        return -1;
     }
-}
 
-void assemble_string(
-    size_t& offset,
-    string& text)
-{
-    if (check_for_char('\"', offset, text)) {
-        while (offset < text.length()) {
-            char ch = text[offset++];
-            switch (ch) {
-                case '\"':
-                    return;
-                case '\n':
-                    goto exit_loop;
-                case '\\':
-                    if (offset < text.length()) {
-                        ch = text[offset++];
-                    }
-                    switch (ch) {
-                        case 'b': ch = '\b'; break;
-                        case 'f': ch = '\f'; break;
-                        case 'n': ch = '\n'; break;
-                        case 'r': ch = '\r'; break;
-                        case 't': ch = '\t'; break;
-                        case '\\': ch = '\\'; break;
-                        default:
-                            if (ch >= '0' && ch <= '7') {
-                                ch = assemble_octal_digits(ch, offset, text);
-                            }
-                    }
-                default:
-                    assemble_byte(ch);
-                    break;
-            }
+    if (output_filename.empty()) {
+        a.get_image().write(cout, format);
+    } else {
+        string error;
+        if (!write_image(a.get_image(), output_filename, format, error)) {
+            cout << error;
+            return -1;
         }
-        exit_loop:
-        cout << "unterminated string constant" << endl;
-        exit(-1);
     }
-}
 
-int assemble_octal_digits(
-    char ch, 
-    size_t& offset, 
-    string& text)
-{
-    int result = ch - '0';
-    if (offset < text.length()) {
-        ch = text[offset];
-        if (ch >= '0' && ch <= '7') {
-            offset++;
-            result = result * 8 + ch - '0';
-            if (offset < text.length()) {
-                ch = text[offset];
-                if (ch >= '0' && ch <= '7') {
-                    offset++;
-                    result = result * 7 + ch - '0';
-                }
-            }
+    if (!line_map_filename.empty()) {
+        ofstream ofs(line_map_filename);
+        if (!ofs) {
+            cout << "unable to open line map " << line_map_filename << endl;
+            return -1;
         }
+        map.write(ofs);
     }
-    return result;
-}
-
-int main(
-    int argc,
-    char *argv[])
-{
-    if (argc < 2) {
-        return -1;
-    }
-
-    string filename = argv[1];
-    string text = get_file_string(filename);
-    
-    string dot_name = ".";
-    g_symbol_table.get_symbol(dot_name, true, &g_dot);
-
-    max_dot = 0;
-    pass = 1;
-    g_symbol_table.initialize_macros();
-    
-    scan(text);
-
-    symbol* dot;
-    g_dot->value_ = 0;
-    max_dot = 0;
-    pass = 2;
-    g_symbol_table.initialize_macros();
-
-    scan(text);
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+using std::string;
+using std::string_view;
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+bool mapped_file::open(
+    const string& filename)
+{
+    close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    //
+    // mmap() refuses zero length mappings, an empty file is just an empty
+    // view.
+    //
+    if (st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        data_ = (const char *)p;
+        size_ = st.st_size;
+    }
+
+    ::close(fd);
+    is_open_ = true;
+    return true;
+}
+
+void mapped_file::close()
+{
+    if (data_ != NULL) {
+        munmap((void *)data_, size_);
+    }
+    data_ = NULL;
+    size_ = 0;
+    is_open_ = false;
+}
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <string_view>
+
+using std::string;
+using std::string_view;
+
+//
+// Read-only memory mapping of a whole file. Tokens point straight into the
+// mapping, so it has to outlive everything lexed from it.
+//
+class mapped_file {
+public:
+    mapped_file() = default;
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+    ~mapped_file();
+
+    bool open(const string& filename);
+    void close();
+
+    bool is_open() const { return is_open_; }
+    string_view text() const { return string_view(data_, size_); }
+
+private:
+    const char *data_ = NULL;
+    size_t size_ = 0;
+    bool is_open_ = false;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,531 @@
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "lexer.h"
+#include "token.h"
+#include "macro.h"
+#include "symbol_table.h"
+#include "expression.h"
+#include "native_encoder.h"
+
+using std::pair;
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// The definitions from beta.uasm that calls may be encoded from, and the
+// ones they depend on. betaop(), betaopc() and BETABR() assemble one
+// instruction of their format, the encoding of every other macro is worked
+// out from the macros its body calls.
+//
+static const struct {
+    const char* source_;
+    native_encoder::instruction_format format_ = native_encoder::NONE;
+} SOURCES[] = {
+    { ".macro SHORT(x) x%0x100 (x>>8)%0x100", native_encoder::NONE },
+    { ".macro LONG(x) SHORT(x) SHORT(x >> 16)", native_encoder::NONE },
+    { ".macro betaop(OP,RA,RB,RC) {\n"
+      ".align 4\n"
+      "LONG((OP<<26)+((RC%0x20)<<21)+((RA%0x20)<<16)+((RB%0x20)<<11)) }",
+      native_encoder::OP },
+    { ".macro betaopc(OP,RA,CC,RC) {\n"
+      ".align 4\n"
+      "LONG((OP<<26)+((RC%0x20)<<21)+((RA%0x20)<<16)+(CC%0x10000)) }",
+      native_encoder::OPC },
+    { ".macro BETABR(OP,RA,RC,LABEL) betaopc(OP,RA,((LABEL-.)>>2)-1, RC)",
+      native_encoder::BRANCH },
+
+    { ".macro ADD(RA, RB, RC) betaop(0x20,RA,RB,RC)" },
+    { ".macro ADDC(RA, C, RC) betaopc(0x30,RA,C,RC)" },
+    { ".macro AND(RA, RB, RC) betaop(0x28,RA,RB,RC)" },
+    { ".macro ANDC(RA, C, RC) betaopc(0x38,RA,C,RC)" },
+    { ".macro MUL(RA, RB, RC) betaop(0x22,RA,RB,RC)" },
+    { ".macro MULC(RA, C, RC) betaopc(0x32,RA,C,RC)" },
+    { ".macro DIV(RA, RB, RC) betaop(0x23,RA,RB,RC)" },
+    { ".macro DIVC(RA, C, RC) betaopc(0x33,RA,C,RC)" },
+    { ".macro OR(RA, RB, RC) betaop(0x29,RA,RB,RC)" },
+    { ".macro ORC(RA, C, RC) betaopc(0x39,RA,C,RC)" },
+    { ".macro SHL(RA, RB, RC) betaop(0x2C,RA,RB,RC)" },
+    { ".macro SHLC(RA, C, RC) betaopc(0x3C,RA,C,RC)" },
+    { ".macro SHR(RA, RB, RC) betaop(0x2D,RA,RB,RC)" },
+    { ".macro SHRC(RA, C, RC) betaopc(0x3D,RA,C,RC)" },
+    { ".macro SRA(RA, RB, RC) betaop(0x2E,RA,RB,RC)" },
+    { ".macro SRAC(RA, C, RC) betaopc(0x3E,RA,C,RC)" },
+    { ".macro SUB(RA, RB, RC) betaop(0x21,RA,RB,RC)" },
+    { ".macro SUBC(RA, C, RC) betaopc(0x31,RA,C,RC)" },
+    { ".macro XOR(RA, RB, RC) betaop(0x2A,RA,RB,RC)" },
+    { ".macro XORC(RA, C, RC) betaopc(0x3A,RA,C,RC)" },
+    { ".macro XNOR(RA, RB, RC) betaop(0x2B,RA,RB,RC)" },
+    { ".macro XNORC(RA, C, RC) betaopc(0x3B,RA,C,RC)" },
+    { ".macro CMPEQ(RA, RB, RC) betaop(0x24,RA,RB,RC)" },
+    { ".macro CMPEQC(RA, C, RC) betaopc(0x34,RA,C,RC)" },
+    { ".macro CMPLE(RA, RB, RC) betaop(0x26,RA,RB,RC)" },
+    { ".macro CMPLEC(RA, C, RC) betaopc(0x36,RA,C,RC)" },
+    { ".macro CMPLT(RA, RB, RC) betaop(0x25,RA,RB,RC)" },
+    { ".macro CMPLTC(RA, C, RC) betaopc(0x35,RA,C,RC)" },
+
+    { ".macro BEQ(RA, LABEL, RC) BETABR(0x1C,RA,RC,LABEL)" },
+    { ".macro BEQ(RA, LABEL) BETABR(0x1C,RA,r31,LABEL)" },
+    { ".macro BF(RA, LABEL, RC) BEQ(RA,LABEL,RC)" },
+    { ".macro BF(RA,LABEL) BEQ(RA,LABEL)" },
+    { ".macro BNE(RA, LABEL, RC) BETABR(0x1D,RA,RC,LABEL)" },
+    { ".macro BNE(RA, LABEL) BETABR(0x1D,RA,r31,LABEL)" },
+    { ".macro BT(RA,LABEL,RC) BNE(RA,LABEL,RC)" },
+    { ".macro BT(RA,LABEL) BNE(RA,LABEL)" },
+    { ".macro BR(LABEL,RC) BEQ(r31, LABEL, RC)" },
+    { ".macro BR(LABEL) BR(LABEL, r31)" },
+    { ".macro JMP(RA, RC) betaopc(0x1B,RA,0,RC)" },
+    { ".macro JMP(RA) betaopc(0x1B,RA,0,r31)" },
+
+    { ".macro LD(RA, CC, RC) betaopc(0x18,RA,CC,RC)" },
+    { ".macro LD(CC, RC) betaopc(0x18,R31,CC,RC)" },
+    { ".macro ST(RC, CC, RA) betaopc(0x19,RA,CC,RC)" },
+    { ".macro ST(RC, CC) betaopc(0x19,R31,CC,RC)" },
+    { ".macro LDR(CC, RC) BETABR(0x1F, R31, RC, CC)" },
+
+    { ".macro MOVE(RA, RC) ADD(RA, R31, RC)" },
+    { ".macro CMOVE(CC, RC) ADDC(R31, CC, RC)" },
+    { ".macro PUSH(RA) ADDC(SP,4,SP) ST(RA,-4,SP)" },
+    { ".macro POP(RA) LD(SP,-4,RA) ADDC(SP,-4,SP)" },
+    { ".macro CALL(label) BR(label, LP)" },
+    { ".macro RTN() JMP(LP)" },
+    { ".macro XRTN() JMP(XP)" },
+    { ".macro GETFRAME(OFFSET, REG) LD(bp, OFFSET, REG)" },
+    { ".macro PUTFRAME(REG, OFFSET) ST(REG, OFFSET, bp)" },
+
+    { ".macro PRIV_OP(FNCODE) betaopc (0x00, 0, FNCODE, 0)" },
+    { ".macro HALT() PRIV_OP (0)" },
+    { ".macro RDCHAR() PRIV_OP (1)" },
+    { ".macro WRCHAR() PRIV_OP (2)" },
+    { ".macro CYCLE() PRIV_OP (3)" },
+    { ".macro TIME() PRIV_OP (4)" },
+    { ".macro CLICK() PRIV_OP (5)" },
+    { ".macro RANDOM() PRIV_OP (6)" },
+    { ".macro SEED() PRIV_OP (7)" },
+    { ".macro SERVER() PRIV_OP (8)" },
+    { ".macro SVC(code) betaopc (0x01, 0, code, 0)" },
+};
+
+struct native_encoder::definition {
+    string_view name_;
+    vector<string_view> params_;
+    instruction_format format_;
+
+    //
+    // The lexed definition, the body is tokens_[body_start_, body_end_).
+    //
+    vector<token> tokens_;
+    size_t body_start_;
+    size_t body_end_;
+
+    //
+    // Name and argument count of each macro the body calls.
+    //
+    vector<pair<string_view, int>> callees_;
+
+    //
+    // Whether calls can be encoded, which takes a body made only of calls
+    // with arguments that are a number, a parameter or a symbol.
+    //
+    bool encodable_;
+    encoding encoding_;
+};
+
+//
+// Every definition, and the names SYMBOL fields refer to.
+//
+struct catalog {
+    vector<native_encoder::definition> definitions_;
+    vector<string_view> symbols_;
+};
+
+static bool same_token(
+    const token& a,
+    const token& b)
+{
+    if (a.type_ != b.type_) {
+        return false;
+    }
+    switch (a.type_) {
+        case token::SYMBOL:
+        case token::STRING:
+            return a.text_ == b.text_;
+        case token::NUMBER:
+        case token::PUNCT:
+            return a.value_ == b.value_;
+        default:
+            return true;
+    }
+}
+
+//
+// Splits a definition the way assembler::read_macro() does.
+//
+static void parse_definition(
+    const char* source,
+    native_encoder::definition& d)
+{
+    lexer(source).tokenize(d.tokens_);
+    const vector<token>& tokens = d.tokens_;
+
+    d.name_ = tokens[1].text_;
+    size_t offset = 3;
+    for (; !tokens[offset].is_punct(')'); ++offset) {
+        if (tokens[offset].type_ == token::SYMBOL) {
+            d.params_.push_back(tokens[offset].text_);
+        }
+    }
+    offset++;
+
+    size_t start = offset;
+    while (tokens[start].type_ == token::EOL) {
+        start++;
+    }
+    size_t end;
+    if (tokens[start].is_punct('{')) {
+        offset = start + 1;
+        for (end = offset; !tokens[end].is_punct('}'); ++end);
+    } else {
+        for (end = offset; !tokens[end].is_eol(); ++end);
+    }
+    d.body_start_ = offset;
+    d.body_end_ = end;
+
+    int depth = 0;
+    for (size_t i = d.body_start_; i < d.body_end_; ++i) {
+        if (depth == 0 && tokens[i].type_ == token::SYMBOL
+                && tokens[i + 1].is_punct('(')) {
+            string_view name = tokens[i].text_;
+            bool empty = tokens[i + 2].is_punct(')');
+            int num_args = 1;
+            for (i += 2, depth = 1; depth > 0; ++i) {
+                if (tokens[i].is_punct('(')) {
+                    depth++;
+                } else if (tokens[i].is_punct(')')) {
+                    depth--;
+                } else if (depth == 1 && tokens[i].is_punct(',')) {
+                    num_args++;
+                }
+            }
+            d.callees_.push_back({ name, empty ? 0 : num_args });
+            i--;
+        } else if (tokens[i].is_punct('(')) {
+            depth++;
+        } else if (tokens[i].is_punct(')')) {
+            depth--;
+        }
+    }
+}
+
+static const native_encoder::definition* find_definition(
+    const catalog& c,
+    string_view name,
+    size_t num_params)
+{
+    for (auto const& d : c.definitions_) {
+        if (d.name_ == name && d.params_.size() == num_params) {
+            return &d;
+        }
+    }
+    return NULL;
+}
+
+//
+// Works out the instructions a call of d assembles. env holds the value of
+// each parameter bound while the body is expanded, innermost last, so a
+// symbol that isn't a parameter of d may still be one of a macro calling
+// it, as it is when the body is scanned.
+//
+static bool derive(
+    catalog& c,
+    const native_encoder::definition& d,
+    vector<pair<string_view, native_encoder::field>>& env,
+    native_encoder::encoding& e)
+{
+    typedef native_encoder::field field;
+
+    auto lookup = [&](string_view name) {
+        for (size_t i = env.size(); i-- > 0;) {
+            if (env[i].first == name) {
+                return env[i].second;
+            }
+        }
+        for (size_t i = 0; i < c.symbols_.size(); ++i) {
+            if (c.symbols_[i] == name) {
+                return field { field::SYMBOL, (int)i };
+            }
+        }
+        c.symbols_.push_back(name);
+        return field { field::SYMBOL, (int)c.symbols_.size() - 1 };
+    };
+
+    if (d.format_ != native_encoder::NONE) {
+        field f[4];
+        for (int i = 0; i < 4; ++i) {
+            f[i] = lookup(d.params_[i]);
+        }
+        if (f[0].kind_ != field::CONSTANT
+                || e.num_instructions_ == native_encoder::MAX_WORDS) {
+            return false;
+        }
+
+        //
+        // BETABR() takes RC before the target.
+        //
+        native_encoder::instruction& in =
+                e.instructions_[e.num_instructions_++];
+        in.format_ = d.format_;
+        in.opcode_ = f[0].value_;
+        in.ra_ = f[1];
+        in.rb_ = d.format_ == native_encoder::BRANCH ? f[3] : f[2];
+        in.rc_ = d.format_ == native_encoder::BRANCH ? f[2] : f[3];
+        return true;
+    }
+
+    const vector<token>& tokens = d.tokens_;
+    size_t i = d.body_start_;
+    while (i < d.body_end_) {
+        if (tokens[i].type_ == token::EOL) {
+            i++;
+            continue;
+        }
+        if (tokens[i].type_ != token::SYMBOL || !tokens[i + 1].is_punct('(')) {
+            return false;
+        }
+
+        string_view name = tokens[i].text_;
+        vector<field> args;
+        for (i += 2; !tokens[i].is_punct(')'); ) {
+            if (tokens[i].is_punct(',')) {
+                i++;
+                continue;
+            }
+            if (tokens[i].type_ == token::NUMBER) {
+                args.push_back({ field::CONSTANT, tokens[i++].value_ });
+            } else if (tokens[i].is_punct('-')
+                    && tokens[i + 1].type_ == token::NUMBER) {
+                args.push_back({ field::CONSTANT, expression::apply(
+                        expression::NEGATE, tokens[i + 1].value_, 0) });
+                i += 2;
+            } else if (tokens[i].type_ == token::SYMBOL) {
+                args.push_back(lookup(tokens[i++].text_));
+            } else {
+                return false;
+            }
+            if (!tokens[i].is_punct(',') && !tokens[i].is_punct(')')) {
+                return false;
+            }
+        }
+        i++;
+
+        const native_encoder::definition* callee =
+                find_definition(c, name, args.size());
+        if (callee == NULL) {
+            return false;
+        }
+        size_t depth = env.size();
+        for (size_t a = 0; a < args.size(); ++a) {
+            env.push_back({ callee->params_[a], args[a] });
+        }
+        bool encodable = derive(c, *callee, env, e);
+        env.resize(depth);
+        if (!encodable) {
+            return false;
+        }
+    }
+    return e.num_instructions_ > 0;
+}
+
+static const catalog& get_catalog()
+{
+    static const catalog c = []() {
+        catalog c;
+        c.definitions_.resize(sizeof(SOURCES) / sizeof(SOURCES[0]));
+        for (size_t i = 0; i < c.definitions_.size(); ++i) {
+            parse_definition(SOURCES[i].source_, c.definitions_[i]);
+            c.definitions_[i].format_ = SOURCES[i].format_;
+        }
+
+        for (auto& d : c.definitions_) {
+            vector<pair<string_view, native_encoder::field>> env;
+            for (size_t i = 0; i < d.params_.size(); ++i) {
+                env.push_back({ d.params_[i],
+                        { native_encoder::field::PARAM, (int)i } });
+            }
+            d.encoding_.num_instructions_ = 0;
+            d.encodable_ = d.format_ == native_encoder::NONE
+                    && derive(c, d, env, d.encoding_);
+        }
+        return c;
+    }();
+    return c;
+}
+
+//
+// Symbols are looked up once a macro is found to use them, interning them
+// here would add them to every symbol table.
+//
+native_encoder::native_encoder(
+    interner& names) :
+        names_(names), symbol_ids_(get_catalog().symbols_.size(), -1)
+{
+}
+
+const native_encoder::encoding* native_encoder::find(
+    const macro* m,
+    symbol_table& st)
+{
+    const definition* d = check(m, st);
+    return d != NULL && d->encodable_ ? &d->encoding_ : NULL;
+}
+
+//
+// Finds the definition m matches, parameter names and body token for token,
+// provided the macros it calls match theirs too.
+//
+const native_encoder::definition* native_encoder::check(
+    const macro* m,
+    symbol_table& st)
+{
+    auto it = checked_.find(m);
+    if (it != checked_.end()) {
+        return it->second;
+    }
+
+    const definition* d = find_definition(get_catalog(), st.name(m->name_),
+            m->num_params_);
+    if (d != NULL) {
+        for (int i = 0; i < m->num_params_; ++i) {
+            if (st.name(m->params_[i]) != d->params_[i]) {
+                d = NULL;
+                break;
+            }
+        }
+    }
+    if (d != NULL) {
+        size_t i = d->body_start_;
+        const token* t = m->body_;
+        for (; i < d->body_end_ && t->type_ != token::END; ++i, ++t) {
+            if (!same_token(*t, d->tokens_[i])) {
+                break;
+            }
+        }
+        if (i != d->body_end_ || t->type_ != token::END) {
+            d = NULL;
+        }
+    }
+    if (d != NULL) {
+        for (auto const& callee : d->callees_) {
+            macro* c;
+            if (!st.get_macro(callee.first, callee.second, &c)
+                    || check(c, st) == NULL) {
+                d = NULL;
+                break;
+            }
+        }
+    }
+
+    if (d != NULL && d->encodable_) {
+        const catalog& c = get_catalog();
+        for (size_t i = 0; i < symbol_ids_.size(); ++i) {
+            if (symbol_ids_[i] < 0) {
+                names_.find(c.symbols_[i], &symbol_ids_[i]);
+            }
+        }
+    }
+
+    checked_[m] = d;
+    return d;
+}
+
+vector<string> native_encoder::unmatched(
+    symbol_table& st)
+{
+    vector<string> names;
+    for (auto const& d : get_catalog().definitions_) {
+        macro* m;
+        if (!st.get_macro(d.name_, d.params_.size(), &m)
+                || check(m, st) != &d) {
+            names.push_back(string(d.name_) + "/"
+                    + std::to_string(d.params_.size()));
+        }
+    }
+    return names;
+}
+
+bool native_encoder::get_value(
+    const field& f,
+    const vector<operand>& args,
+    const symbol_table& st,
+    int& value_out) const
+{
+    switch (f.kind_) {
+        case field::PARAM:
+            value_out = args[f.value_].value_;
+            return !args[f.value_].is_pending();
+        case field::SYMBOL: {
+            int id = symbol_ids_[f.value_];
+            if (id < 0 || (size_t)id >= st.size()
+                    || st[id].type_ == symbol::UNDEF || st[id].expr_ >= 0) {
+                return false;
+            }
+            value_out = st[id].value_;
+            return true;
+        }
+        default:
+            value_out = f.value_;
+            return true;
+    }
+}
+
+//
+// Same steps as the expressions in betaop(), betaopc() and BETABR(), which
+// are evaluated left to right.
+//
+int native_encoder::encode(
+    const encoding& e,
+    const vector<operand>& args,
+    const symbol_table& st,
+    int dot,
+    int* words) const
+{
+    using op = expression;
+
+    if (dot < 0) {
+        return 0;
+    }
+
+    int address = dot;
+    for (int i = 0; i < e.num_instructions_; ++i) {
+        const instruction& in = e.instructions_[i];
+        int ra, rb, rc;
+        if (!get_value(in.ra_, args, st, ra)
+                || !get_value(in.rb_, args, st, rb)
+                || !get_value(in.rc_, args, st, rc)) {
+            return 0;
+        }
+
+        int word = op::apply(op::SHL, in.opcode_, 26);
+        word = op::apply(op::ADD, word, op::apply(op::SHL,
+                op::apply(op::MOD, rc, 0x20), 21));
+        word = op::apply(op::ADD, word, op::apply(op::SHL,
+                op::apply(op::MOD, ra, 0x20), 16));
+        if (in.format_ == OP) {
+            word = op::apply(op::ADD, word, op::apply(op::SHL,
+                    op::apply(op::MOD, rb, 0x20), 11));
+        } else {
+            if (in.format_ == BRANCH) {
+                rb = op::apply(op::SUB, op::apply(op::SHR,
+                        op::apply(op::SUB, rb, address), 2), 1);
+            }
+            word = op::apply(op::ADD, word, op::apply(op::MOD, rb, 0x10000));
+        }
+        words[i] = word;
+
+        address = (address + 3) / 4 * 4 + 4;
+    }
+    return e.num_instructions_;
+}
\ No newline at end of file
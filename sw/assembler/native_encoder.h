@@ -0,0 +1,125 @@
+#ifndef NATIVE_ENCODER_H
+#define NATIVE_ENCODER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "macro.h"
+#include "symbol_table.h"
+#include "expression.h"
+#include "interner.h"
+
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+//
+// Encodes calls of the standard instruction macros, ADD, LD, BEQ, PUSH and
+// the rest, straight from a table instead of expanding them through
+// betaop() and LONG(). The table holds the definitions from beta.uasm and
+// the instructions each one assembles.
+//
+// A call is encoded natively only when the macro it resolves to, and every
+// macro that one calls, is defined exactly as in beta.uasm. A source that
+// defines its own ADD, or doesn't include beta.uasm, keeps the macros it
+// defined. The words are the ones the macros would assemble, computed with
+// the same arithmetic.
+//
+class native_encoder {
+public:
+    enum instruction_format { NONE, OP, OPC, BRANCH };
+
+    //
+    // Most words a standard macro assembles. PUSH and POP take two.
+    //
+    static const int MAX_WORDS = 2;
+
+    //
+    // Where the value of an instruction field comes from: an argument of
+    // the call, a symbol such as SP read when the call is made, or a
+    // constant.
+    //
+    struct field {
+        enum field_kind { PARAM, SYMBOL, CONSTANT };
+
+        field_kind kind_;
+        int value_;
+    };
+
+    //
+    // rb_ is RB for OP, the literal for OPC and the target for BRANCH.
+    //
+    struct instruction {
+        instruction_format format_;
+        int opcode_;
+        field ra_;
+        field rb_;
+        field rc_;
+    };
+
+    struct encoding {
+        int num_instructions_;
+        instruction instructions_[MAX_WORDS];
+    };
+
+    //
+    // A definition from beta.uasm, see native_encoder.cpp.
+    //
+    struct definition;
+
+    native_encoder(interner& names);
+
+    //
+    // Forgets which macros were checked. Called at the start of each pass,
+    // since the macros of the source are defined again.
+    //
+    void clear() { checked_.clear(); }
+
+    //
+    // The encoding of calls of m, or NULL if they have to be expanded.
+    //
+    const encoding* find(const macro* m, symbol_table& st);
+
+    //
+    // Encodes a call at dot into words, which follow the .align 4 padding
+    // before the first one. Returns the number of words, or 0 if a value
+    // isn't known yet and the call has to be expanded instead.
+    //
+    int encode(
+        const encoding& e,
+        const vector<operand>& args,
+        const symbol_table& st,
+        int dot,
+        int* words) const;
+
+    //
+    // The definitions in the table, as "name/parameters", that no macro of
+    // st matches. None once beta.uasm is included, unless the two have
+    // drifted apart and calls of those macros are expanded again.
+    //
+    vector<string> unmatched(symbol_table& st);
+
+private:
+    const definition* check(const macro* m, symbol_table& st);
+    bool get_value(
+        const field& f,
+        const vector<operand>& args,
+        const symbol_table& st,
+        int& value_out) const;
+
+    interner& names_;
+
+    //
+    // Symbol id of each name a SYMBOL field refers to, by the index kept
+    // in the field, or -1 if the name hasn't been seen yet.
+    //
+    vector<int> symbol_ids_;
+
+    //
+    // Definition each macro seen this pass matches, or NULL.
+    //
+    unordered_map<const macro*, const definition*> checked_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "symbol_table.h"
+#include "source_cache.h"
+#include "snapshot.h"
+#include "assembler.h"
+#include "prelude.h"
+
+using std::string;
+using std::vector;
+
+//
+// The snapshot of the prelude at path. The directory is made if need be;
+// its name has a hash of the path, so preludes with the same name in
+// different directories don't share a snapshot.
+//
+string prelude::snapshot_path(
+    const string& path) const
+{
+    string directory = snapshot_directory_;
+    if (directory.empty()) {
+        const char* cache = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        if (cache != NULL && cache[0] == '/') {
+            directory = cache;
+        } else if (home != NULL && home[0] != '\0') {
+            directory = string(home) + "/.cache";
+        } else {
+            return path + ".snap";
+        }
+        mkdir(directory.c_str(), 0755);
+        directory += "/beta-assembler";
+    }
+    mkdir(directory.c_str(), 0755);
+
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx",
+            (unsigned long long)snapshot::hash(path));
+    return directory + "/" + path.substr(path.rfind('/') + 1) + "." + hash
+            + ".snap";
+}
+
+bool prelude::load(
+    const string& filename,
+    source_cache& sources,
+    string& error_out)
+{
+    int file = sources.open(filename);
+    if (file < 0) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+
+    string snapshot_filename = snapshot_path(sources.path(file));
+    symbols_.reset(new symbol_table(sources.names()));
+    if (snapshot_.load(snapshot_filename, *symbols_, sources, files_)
+            && files_[0] == file) {
+        return true;
+    }
+
+    assembler a(sources);
+    if (!a.assemble_prelude(file)) {
+        error_out = a.error();
+        return false;
+    }
+
+    //
+    // Reload from the serialized copy so the macros no longer depend on the
+    // assembler that defined them.
+    //
+    string data;
+    snapshot::serialize(a.symbols(), sources, a.included(), data);
+    snapshot::save(snapshot_filename, data);
+    symbols_.reset(new symbol_table(sources.names()));
+    if (!snapshot_.adopt(std::move(data), *symbols_, sources, files_)) {
+        error_out = "unable to load prelude " + filename + "\n";
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "symbol_table.h"
+#include "source_cache.h"
+#include "snapshot.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+//
+// Symbols and macros of a macro package such as beta.uasm, loaded once and
+// shared read-only by every assembler. They come from a snapshot, which is
+// rebuilt when it is missing or when the prelude or a file it includes has
+// changed. Snapshots are kept in the snapshot directory if one is set,
+// otherwise in beta-assembler under $XDG_CACHE_HOME or ~/.cache. If the
+// snapshot can't be written the prelude is simply assembled every time.
+//
+class prelude {
+public:
+    prelude() = default;
+    prelude(const prelude&) = delete;
+    prelude& operator=(const prelude&) = delete;
+
+    void set_snapshot_directory(const string& directory)
+    {
+        snapshot_directory_ = directory;
+    }
+
+    bool load(
+        const string& filename,
+        source_cache& sources,
+        string& error_out);
+
+    const symbol_table& symbols() const { return *symbols_; }
+
+    //
+    // The prelude and the files it included, which count as included by
+    // every source assembled with it.
+    //
+    const vector<int>& files() const { return files_; }
+
+private:
+    string snapshot_path(const string& path) const;
+
+    string snapshot_directory_;
+    snapshot snapshot_;
+    unique_ptr<symbol_table> symbols_;
+    vector<int> files_;
+};
+
+#endif
\ No newline at end of file
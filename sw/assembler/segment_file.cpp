@@ -0,0 +1,91 @@
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "segment_file.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Bump the version whenever the layout of the records changes.
+//
+const char segment_file::MAGIC[8] =
+        { 'B', 'S', 'E', 'G', '0', '0', '0', '1' };
+
+bool segment_file::open(
+    const string& filename,
+    string& error_out)
+{
+    close();
+    if (!file_.open(filename)) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+    if (!read(file_.text())) {
+        close();
+        error_out = filename + " is not a valid segment file\n";
+        return false;
+    }
+    return true;
+}
+
+void segment_file::close()
+{
+    file_.close();
+    segments_.clear();
+}
+
+uint64_t segment_file::size() const
+{
+    uint64_t size = 0;
+    for (auto const& s : segments_) {
+        if ((uint64_t)s.address_ + s.length_ > size) {
+            size = (uint64_t)s.address_ + s.length_;
+        }
+    }
+    return size;
+}
+
+//
+// Checks every record against the size of the file before using any of
+// them.
+//
+bool segment_file::read(
+    string_view data)
+{
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    const header *h = (const header *)data.data();
+    if (memcmp(h->magic_, MAGIC, sizeof(h->magic_)) != 0) {
+        return false;
+    }
+    if ((data.size() - sizeof(header)) / sizeof(record) < h->num_segments_) {
+        return false;
+    }
+
+    const record *records = (const record *)(h + 1);
+    const unsigned char *base = (const unsigned char *)data.data();
+    for (uint32_t i = 0; i < h->num_segments_; ++i) {
+        const record& r = records[i];
+        if ((uint64_t)r.address_ + r.length_ > (1ULL << 32)) {
+            return false;
+        }
+        if (r.flags_ & FILL) {
+            segments_.push_back({ r.address_, r.length_, NULL });
+            continue;
+        }
+        if (r.offset_ % ALIGNMENT != 0
+                || (uint64_t)r.offset_ + r.length_ > data.size()) {
+            return false;
+        }
+        segments_.push_back({ r.address_, r.length_, base + r.offset_ });
+    }
+    return true;
+}
\ No newline at end of file
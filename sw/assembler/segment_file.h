@@ -0,0 +1,76 @@
+#ifndef SEGMENT_FILE_H
+#define SEGMENT_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Sparse binary image written with "-f seg". A header and one record per
+// segment are followed by the bytes of the segments, each starting on an
+// 8 byte boundary. Zero fills have no bytes. A loader maps the file and
+// reads the segments in place instead of copying a flat image.
+//
+class segment_file {
+public:
+    struct header {
+        char magic_[8];
+        uint32_t num_segments_;
+        uint32_t reserved_;
+    };
+
+    struct record {
+        uint32_t address_;
+        uint32_t length_;
+
+        //
+        // Offset of the bytes from the start of the file, 0 for a fill.
+        //
+        uint32_t offset_;
+        uint32_t flags_;
+    };
+
+    enum record_flags { FILL = 1 };
+
+    static const char MAGIC[8];
+    static const size_t ALIGNMENT = 8;
+
+    //
+    // A segment of a loaded file. data_ points into the mapping, or is NULL
+    // for a zero fill.
+    //
+    struct segment {
+        uint32_t address_;
+        uint32_t length_;
+        const unsigned char* data_;
+    };
+
+    segment_file() = default;
+    segment_file(const segment_file&) = delete;
+    segment_file& operator=(const segment_file&) = delete;
+
+    bool open(const string& filename, string& error_out);
+    void close();
+
+    const vector<segment>& segments() const { return segments_; }
+
+    //
+    // One past the highest address of any segment.
+    //
+    uint64_t size() const;
+
+private:
+    bool read(string_view data);
+
+    mapped_file file_;
+    vector<segment> segments_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,341 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "token.h"
+#include "macro.h"
+#include "symbol.h"
+#include "symbol_table.h"
+#include "source_cache.h"
+#include "snapshot.h"
+
+using std::ofstream;
+using std::string;
+using std::string_view;
+using std::to_string;
+using std::vector;
+
+//
+// Bump the version whenever the layout of the records changes.
+//
+static const char SNAPSHOT_MAGIC[8] = 
+        { 'B', 'S', 'N', 'A', 'P', '0', '0', '2' };
+
+//
+// 64-bit FNV-1a.
+//
+uint64_t snapshot::hash(
+    string_view text)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : text) {
+        h ^= (unsigned char)c;
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+//
+// Layout: header, file records, symbol records, macro records, parameter
+// ids, token records and the text holding paths, symbol names and token
+// text. The records after the file records are made of 32-bit fields so the
+// parameter ids can be used in place.
+//
+void snapshot::serialize(
+    const symbol_table& st,
+    const source_cache& sources,
+    const vector<int>& files,
+    string& data_out)
+{
+    vector<file_record> file_records;
+    vector<symbol_record> symbols;
+    vector<macro_record> macros;
+    vector<int32_t> params;
+    vector<token_record> tokens;
+    string text;
+
+    for (int file : files) {
+        file_record fr;
+        fr.hash_ = hash(sources.text(file));
+        fr.path_offset_ = text.size();
+        fr.path_length_ = sources.path(file).length();
+        text += sources.path(file);
+        file_records.push_back(fr);
+    }
+
+    //
+    // Token file ids are stored as indices into the file records.
+    //
+    auto file_index = [&](int file) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (files[i] == file) {
+                return (int)i;
+            }
+        }
+        return -1;
+    };
+
+    for (size_t id = 0; id < st.symbols_.size(); ++id) {
+        const symbol& s = st.symbols_[id];
+        symbol_record sr;
+        sr.value_ = s.value_;
+        sr.type_ = s.type_;
+        sr.name_offset_ = text.size();
+        sr.name_length_ = st.name(id).length();
+        sr.macro_defs_ = s.macro_defs_ != NULL ? macros.size() : -1;
+        text += st.name(id);
+        symbols.push_back(sr);
+
+        for (macro *m = s.macro_defs_; m != NULL; m = m->next_) {
+            macro_record mr;
+            mr.name_ = m->name_;
+            mr.num_params_ = m->num_params_;
+            mr.params_ = params.size();
+            mr.body_ = tokens.size();
+            mr.next_ = m->next_ != NULL ? macros.size() + 1 : -1;
+            macros.push_back(mr);
+
+            params.insert(params.end(), m->params_,
+                    m->params_ + m->num_params_);
+
+            for (token *t = m->body_; ; ++t) {
+                token_record tr;
+                tr.type_ = t->type_;
+                tr.value_ = t->value_;
+                tr.symbol_ = t->symbol_;
+                tr.file_ = file_index(t->file_);
+                tr.line_ = t->line_;
+                tr.text_offset_ = text.size();
+                tr.text_length_ = t->text_.length();
+                text += t->text_;
+                tokens.push_back(tr);
+                if (t->type_ == token::END) {
+                    break;
+                }
+            }
+        }
+    }
+
+    header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic_, SNAPSHOT_MAGIC, sizeof(h.magic_));
+    h.num_files_ = file_records.size();
+    h.num_symbols_ = symbols.size();
+    h.num_macros_ = macros.size();
+    h.num_params_ = params.size();
+    h.num_tokens_ = tokens.size();
+    h.text_size_ = text.size();
+
+    data_out.clear();
+    data_out.append((const char *)&h, sizeof(h));
+    data_out.append((const char *)file_records.data(),
+            file_records.size() * sizeof(file_record));
+    data_out.append((const char *)symbols.data(),
+            symbols.size() * sizeof(symbol_record));
+    data_out.append((const char *)macros.data(),
+            macros.size() * sizeof(macro_record));
+    data_out.append((const char *)params.data(),
+            params.size() * sizeof(int32_t));
+    data_out.append((const char *)tokens.data(),
+            tokens.size() * sizeof(token_record));
+    data_out.append(text);
+}
+
+//
+// Written under a temporary name and renamed, so concurrent runs never map
+// a partially written snapshot.
+//
+bool snapshot::save(
+    const string& filename,
+    const string& data)
+{
+    string temp_filename = filename + ".tmp." + to_string(getpid());
+    {
+        ofstream ofs(temp_filename, std::ios::binary);
+        if (!ofs || !ofs.write(data.data(), data.size())) {
+            remove(temp_filename.c_str());
+            return false;
+        }
+    }
+    if (rename(temp_filename.c_str(), filename.c_str()) != 0) {
+        remove(temp_filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool snapshot::load(
+    const string& filename,
+    symbol_table& st,
+    source_cache& sources,
+    vector<int>& files_out)
+{
+    if (!file_.open(filename)) {
+        return false;
+    }
+    if (!read(file_.text(), st, sources, files_out)) {
+        file_.close();
+        return false;
+    }
+    return true;
+}
+
+bool snapshot::adopt(
+    string&& data,
+    symbol_table& st,
+    source_cache& sources,
+    vector<int>& files_out)
+{
+    buffer_ = std::move(data);
+    return read(buffer_, st, sources, files_out);
+}
+
+//
+// Replaces the contents of st with the snapshot and returns the ids of the
+// files it was made from, the prelude first. Returns false without touching
+// st if the data is damaged, one of the files has changed or the names it
+// uses were given different ids.
+//
+bool snapshot::read(
+    string_view data,
+    symbol_table& st,
+    source_cache& sources,
+    vector<int>& files_out)
+{
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+
+    const header *h = (const header *)data.data();
+    if (memcmp(h->magic_, SNAPSHOT_MAGIC, sizeof(h->magic_)) != 0
+            || h->num_files_ == 0 || h->num_symbols_ == 0) {
+        return false;
+    }
+
+    size_t expected = sizeof(header)
+            + (size_t)h->num_files_ * sizeof(file_record)
+            + (size_t)h->num_symbols_ * sizeof(symbol_record)
+            + (size_t)h->num_macros_ * sizeof(macro_record)
+            + (size_t)h->num_params_ * sizeof(int32_t)
+            + (size_t)h->num_tokens_ * sizeof(token_record)
+            + h->text_size_;
+    if (data.size() != expected) {
+        return false;
+    }
+
+    const file_record *file_records = (const file_record *)(h + 1);
+    const symbol_record *symbols =
+            (const symbol_record *)(file_records + h->num_files_);
+    const macro_record *macros =
+            (const macro_record *)(symbols + h->num_symbols_);
+    const int32_t *params = (const int32_t *)(macros + h->num_macros_);
+    const token_record *tokens =
+            (const token_record *)(params + h->num_params_);
+    const char *text = (const char *)(tokens + h->num_tokens_);
+
+    //
+    // Check every index before building anything, a damaged snapshot is
+    // simply treated as stale.
+    //
+    auto text_ok = [&](uint32_t offset, uint32_t length) {
+        return offset <= h->text_size_ && length <= h->text_size_ - offset;
+    };
+    vector<int> files;
+    for (uint32_t i = 0; i < h->num_files_; ++i) {
+        const file_record& fr = file_records[i];
+        if (!text_ok(fr.path_offset_, fr.path_length_)) {
+            return false;
+        }
+        string path(text + fr.path_offset_, fr.path_length_);
+        int file = sources.open(path);
+        if (file < 0 || hash(sources.text(file)) != fr.hash_) {
+            return false;
+        }
+        files.push_back(file);
+    }
+    for (uint32_t i = 0; i < h->num_symbols_; ++i) {
+        const symbol_record& sr = symbols[i];
+        if (!text_ok(sr.name_offset_, sr.name_length_)
+                || sr.macro_defs_ >= (int32_t)h->num_macros_) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->num_macros_; ++i) {
+        const macro_record& mr = macros[i];
+        if (mr.name_ < 0 || mr.name_ >= (int32_t)h->num_symbols_
+                || mr.num_params_ < 0
+                || mr.params_ + (size_t)mr.num_params_ > h->num_params_
+                || mr.body_ >= h->num_tokens_
+                || mr.next_ >= (int32_t)h->num_macros_) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->num_params_; ++i) {
+        if (params[i] < 0 || params[i] >= (int32_t)h->num_symbols_) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < h->num_tokens_; ++i) {
+        const token_record& tr = tokens[i];
+        if (!text_ok(tr.text_offset_, tr.text_length_)
+                || tr.symbol_ >= (int32_t)h->num_symbols_
+                || tr.file_ >= (int32_t)h->num_files_) {
+            return false;
+        }
+    }
+    if (h->num_tokens_ > 0 && tokens[h->num_tokens_ - 1].type_ != token::END) {
+        return false;
+    }
+
+    //
+    // The ids stored in the snapshot are only valid if interning the names
+    // in order gives the same ids, which holds when the prelude is loaded
+    // before any other source is lexed.
+    //
+    for (uint32_t i = 0; i < h->num_symbols_; ++i) {
+        const symbol_record& sr = symbols[i];
+        string_view name(text + sr.name_offset_, sr.name_length_);
+        if (st.names_->intern(name) != (int)i) {
+            return false;
+        }
+    }
+
+    tokens_.resize(h->num_tokens_);
+    for (uint32_t i = 0; i < h->num_tokens_; ++i) {
+        const token_record& tr = tokens[i];
+        tokens_[i] = token((token::token_type)tr.type_,
+                string_view(text + tr.text_offset_, tr.text_length_),
+                tr.value_);
+        tokens_[i].symbol_ = tr.symbol_;
+        tokens_[i].file_ = tr.file_ >= 0 ? files[tr.file_] : -1;
+        tokens_[i].line_ = tr.line_;
+    }
+
+    macros_.resize(h->num_macros_);
+    for (uint32_t i = 0; i < h->num_macros_; ++i) {
+        const macro_record& mr = macros[i];
+        macros_[i] = macro(mr.name_, mr.num_params_,
+                (int *)params + mr.params_, &tokens_[mr.body_]);
+        macros_[i].next_ = mr.next_ >= 0 ? &macros_[mr.next_] : NULL;
+    }
+
+    st.symbols_.clear();
+    st.prelude_macros_.clear();
+    for (uint32_t i = 0; i < h->num_symbols_; ++i) {
+        const symbol_record& sr = symbols[i];
+        st.symbols_.push_back(
+                symbol(sr.value_, (symbol::symbol_type)sr.type_));
+        st.symbols_.back().macro_defs_ =
+                sr.macro_defs_ >= 0 ? &macros_[sr.macro_defs_] : NULL;
+        st.prelude_macros_.push_back(st.symbols_.back().macro_defs_);
+    }
+    st.grow();
+    files_out = files;
+    return true;
+}
\ No newline at end of file
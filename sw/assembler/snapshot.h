@@ -0,0 +1,111 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "token.h"
+#include "macro.h"
+#include "mapped_file.h"
+#include "source_cache.h"
+#include "symbol_table.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Binary copy of the symbol table and the macros defined by a prelude file.
+// It lists the prelude and the files it included with a hash of their
+// contents, so a stale snapshot is never loaded. Parameter lists and token
+// text are used in place, the snapshot has to outlive the symbol table it
+// was loaded into.
+//
+class snapshot {
+public:
+    snapshot() = default;
+    snapshot(const snapshot&) = delete;
+    snapshot& operator=(const snapshot&) = delete;
+
+    static uint64_t hash(string_view text);
+
+    static void serialize(
+        const symbol_table& st,
+        const source_cache& sources,
+        const vector<int>& files,
+        string& data_out);
+
+    static bool save(
+        const string& filename,
+        const string& data);
+
+    bool load(
+        const string& filename,
+        symbol_table& st,
+        source_cache& sources,
+        vector<int>& files_out);
+
+    bool adopt(
+        string&& data,
+        symbol_table& st,
+        source_cache& sources,
+        vector<int>& files_out);
+
+private:
+    struct header {
+        char magic_[8];
+        uint32_t num_files_;
+        uint32_t num_symbols_;
+        uint32_t num_macros_;
+        uint32_t num_params_;
+        uint32_t num_tokens_;
+        uint32_t text_size_;
+    };
+
+    struct file_record {
+        uint64_t hash_;
+        uint32_t path_offset_;
+        uint32_t path_length_;
+    };
+
+    struct symbol_record {
+        int32_t value_;
+        int32_t type_;
+        uint32_t name_offset_;
+        uint32_t name_length_;
+        int32_t macro_defs_;
+    };
+
+    struct macro_record {
+        int32_t name_;
+        int32_t num_params_;
+        uint32_t params_;
+        uint32_t body_;
+        int32_t next_;
+    };
+
+    struct token_record {
+        int32_t type_;
+        int32_t value_;
+        int32_t symbol_;
+        int32_t file_;
+        int32_t line_;
+        uint32_t text_offset_;
+        uint32_t text_length_;
+    };
+
+    bool read(
+        string_view data,
+        symbol_table& st,
+        source_cache& sources,
+        vector<int>& files_out);
+
+    mapped_file file_;
+    string buffer_;
+    vector<macro> macros_;
+    vector<token> tokens_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,105 @@
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "token.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "source_cache.h"
+
+using std::call_once;
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::vector;
+
+int source_cache::open(
+    const string& filename,
+    int relative_to)
+{
+    string name = filename;
+    if (relative_to >= 0 && !filename.empty() && filename[0] != '/') {
+        const string& parent = get(relative_to)->name_;
+        name = parent.substr(0, parent.rfind('/') + 1) + filename;
+    }
+
+    char resolved[PATH_MAX];
+    if (realpath(name.c_str(), resolved) == NULL) {
+        return -1;
+    }
+
+    string path = resolved;
+    lock_guard<mutex> lock(mutex_);
+    auto it = ids_.find(path);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+
+    unique_ptr<source_file> f(new source_file);
+    if (!f->file_.open(path)) {
+        return -1;
+    }
+    f->name_ = name;
+    f->path_ = path;
+    f->text_ = f->file_.text();
+
+    int id = files_.size();
+    files_.push_back(std::move(f));
+    ids_.emplace(path, id);
+    return id;
+}
+
+int source_cache::add(
+    const string& name,
+    string_view text)
+{
+    unique_ptr<source_file> f(new source_file);
+    f->name_ = name;
+    f->path_ = name;
+    f->buffer_ = text;
+    f->text_ = f->buffer_;
+
+    lock_guard<mutex> lock(mutex_);
+    int id = files_.size();
+    files_.push_back(std::move(f));
+    return id;
+}
+
+source_cache::source_file* source_cache::get(
+    int file) const
+{
+    lock_guard<mutex> lock(mutex_);
+    return files_[file].get();
+}
+
+//
+// Tokens of the file, terminated by an END token, or NULL if the file
+// can't be lexed. The returned array stays valid for the lifetime of the
+// cache. The first caller lexes the file, others wait for it.
+//
+const token* source_cache::tokens(
+    int file, 
+    string& error_out)
+{
+    source_file& f = *get(file);
+    call_once(f.tokenized_, [&]() {
+        lexer l(f.text_, f.name_, file, &names_);
+        if (!l.tokenize(f.tokens_)) {
+            f.error_ = l.error();
+        }
+    });
+
+    if (!f.error_.empty()) {
+        error_out = f.error_;
+        return NULL;
+    }
+    return f.tokens_.data();
+}
\ No newline at end of file
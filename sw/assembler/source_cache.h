@@ -0,0 +1,76 @@
+#ifndef SOURCE_CACHE_H
+#define SOURCE_CACHE_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "token.h"
+#include "interner.h"
+#include "mapped_file.h"
+
+using std::mutex;
+using std::once_flag;
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+//
+// Source files used during the run, keyed by their canonical path. Each file
+// is mapped once and tokenized at most once no matter how often it is
+// included or how many assemblers use it. The id of a file is its index and
+// is recorded in its tokens. Symbol names are interned while lexing, so the
+// tokens are never written to afterwards and can be shared between threads.
+//
+class source_cache {
+public:
+    source_cache() = default;
+    source_cache(const source_cache&) = delete;
+    source_cache& operator=(const source_cache&) = delete;
+
+    //
+    // Returns the id of the file, or -1 if it can't be opened. A relative
+    // filename is looked up relative to the directory of the file with id
+    // relative_to, or the current directory if that is -1.
+    //
+    int open(const string& filename, int relative_to = -1);
+
+    //
+    // Adds source text held in memory. Every call gives a new id, name is
+    // used in diagnostics and to resolve relative includes.
+    //
+    int add(const string& name, string_view text);
+
+    const token* tokens(int file, string& error_out);
+    string_view text(int file) const { return get(file)->text_; }
+    const string& name(int file) const { return get(file)->name_; }
+    const string& path(int file) const { return get(file)->path_; }
+
+    interner& names() { return names_; }
+
+private:
+    struct source_file {
+        string name_;
+        string path_;
+        mapped_file file_;
+        string buffer_;
+        string_view text_;
+        vector<token> tokens_;
+        string error_;
+        once_flag tokenized_;
+    };
+
+    source_file* get(int file) const;
+
+    mutable mutex mutex_;
+    vector<unique_ptr<source_file>> files_;
+    unordered_map<string, int> ids_;
+    interner names_;
+};
+
+#endif
\ No newline at end of file
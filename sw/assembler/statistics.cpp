@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include "interner.h"
+#include "statistics.h"
+
+using std::ostream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+static double milliseconds(int64_t nanoseconds)
+{
+    return nanoseconds / 1e6;
+}
+
+//
+// Largest resident set of the process so far, in kilobytes.
+//
+static long peak_rss()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return usage.ru_maxrss;
+}
+
+static string json_string(string_view s)
+{
+    string result = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            result += '\\';
+        }
+        result += c;
+    }
+    return result + "\"";
+}
+
+void statistics::begin_phase(
+    const string& name,
+    const counters& c)
+{
+    phases_.push_back(phase());
+    phases_.back().name_ = name;
+    phase_counters_ = c;
+    phase_start_ = clock::now();
+}
+
+void statistics::end_phase(
+    const counters& c)
+{
+    phase& p = phases_.back();
+    p.nanoseconds_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - phase_start_).count();
+    p.counters_.lookups_ = c.lookups_ - phase_counters_.lookups_;
+    p.counters_.lookup_misses_ =
+            c.lookup_misses_ - phase_counters_.lookup_misses_;
+    p.counters_.cache_hits_ = c.cache_hits_ - phase_counters_.cache_hits_;
+    p.counters_.cache_misses_ =
+            c.cache_misses_ - phase_counters_.cache_misses_;
+}
+
+void statistics::add_expansion(
+    int macro_name,
+    clock::time_point start)
+{
+    macro_stats& m = macros_[macro_name];
+    m.expansions_++;
+    m.nanoseconds_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - start).count();
+}
+
+//
+// Phases are added up by name, so the passes of every file assembled by
+// every thread end up in one entry per pass.
+//
+void statistics::merge(
+    const statistics& other)
+{
+    files_ += other.files_;
+    for (auto const& op : other.phases_) {
+        auto p = std::find_if(phases_.begin(), phases_.end(),
+                [&](const phase& p) { return p.name_ == op.name_; });
+        if (p == phases_.end()) {
+            phases_.push_back(op);
+            continue;
+        }
+        p->nanoseconds_ += op.nanoseconds_;
+        p->scans_ += op.scans_;
+        p->bytes_ += op.bytes_;
+        p->counters_.lookups_ += op.counters_.lookups_;
+        p->counters_.lookup_misses_ += op.counters_.lookup_misses_;
+        p->counters_.cache_hits_ += op.counters_.cache_hits_;
+        p->counters_.cache_misses_ += op.counters_.cache_misses_;
+    }
+    for (auto const& om : other.macros_) {
+        macro_stats& m = macros_[om.first];
+        m.expansions_ += om.second.expansions_;
+        m.nanoseconds_ += om.second.nanoseconds_;
+    }
+}
+
+//
+// Macros by decreasing time, then by name id so the order is stable.
+//
+vector<std::pair<int, statistics::macro_stats>>
+        statistics::sorted_macros() const
+{
+    vector<std::pair<int, macro_stats>> result(macros_.begin(),
+            macros_.end());
+    std::sort(result.begin(), result.end(), [](auto const& a, auto const& b) {
+        if (a.second.nanoseconds_ != b.second.nanoseconds_) {
+            return a.second.nanoseconds_ > b.second.nanoseconds_;
+        }
+        return a.first < b.first;
+    });
+    return result;
+}
+
+void statistics::write_text(
+    ostream& os,
+    const interner& names) const
+{
+    char line[160];
+    os << "files assembled: " << files_ << "\n";
+    snprintf(line, sizeof(line), "%-8s %10s %8s %10s %10s %8s %8s %8s\n",
+            "phase", "ms", "scans", "bytes", "lookups", "hashed",
+            "hits", "misses");
+    os << line;
+    for (auto const& p : phases_) {
+        snprintf(line, sizeof(line),
+                "%-8s %10.3f %8zu %10zu %10zu %8zu %8zu %8zu\n",
+                p.name_.c_str(), milliseconds(p.nanoseconds_), p.scans_,
+                p.bytes_, p.counters_.lookups_, p.counters_.lookup_misses_,
+                p.counters_.cache_hits_, p.counters_.cache_misses_);
+        os << line;
+    }
+
+    snprintf(line, sizeof(line), "%-24s %10s %10s\n", "macro",
+            "expansions", "ms");
+    os << line;
+    for (auto const& m : sorted_macros()) {
+        snprintf(line, sizeof(line), "%-24.*s %10zu %10.3f\n",
+                (int)names.name(m.first).size(), names.name(m.first).data(),
+                m.second.expansions_, milliseconds(m.second.nanoseconds_));
+        os << line;
+    }
+    os << "peak RSS: " << peak_rss() << " KB\n";
+}
+
+void statistics::write_json(
+    ostream& os,
+    const interner& names) const
+{
+    char number[32];
+    os << "{\n  \"files\": " << files_ << ",\n  \"phases\": [";
+    for (size_t i = 0; i < phases_.size(); ++i) {
+        const phase& p = phases_[i];
+        snprintf(number, sizeof(number), "%.3f", milliseconds(p.nanoseconds_));
+        os << (i > 0 ? "," : "") << "\n    { \"name\": "
+                << json_string(p.name_) << ", \"ms\": " << number
+                << ", \"scans\": " << p.scans_
+                << ", \"bytes\": " << p.bytes_
+                << ", \"lookups\": " << p.counters_.lookups_
+                << ", \"lookup_misses\": " << p.counters_.lookup_misses_
+                << ", \"cache_hits\": " << p.counters_.cache_hits_
+                << ", \"cache_misses\": " << p.counters_.cache_misses_
+                << " }";
+    }
+    os << "\n  ],\n  \"macros\": [";
+    vector<std::pair<int, macro_stats>> macros = sorted_macros();
+    for (size_t i = 0; i < macros.size(); ++i) {
+        const macro_stats& m = macros[i].second;
+        snprintf(number, sizeof(number), "%.3f", milliseconds(m.nanoseconds_));
+        os << (i > 0 ? "," : "") << "\n    { \"name\": "
+                << json_string(names.name(macros[i].first))
+                << ", \"expansions\": " << m.expansions_
+                << ", \"ms\": " << number << " }";
+    }
+    os << "\n  ],\n  \"peak_rss_kb\": " << peak_rss() << "\n}\n";
+}
\ No newline at end of file
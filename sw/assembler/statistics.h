@@ -0,0 +1,83 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "interner.h"
+
+using std::ostream;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+//
+// Where assembly time goes, collected by an assembler that was given a
+// statistics object. Nothing is collected otherwise. Each assembler fills
+// its own object, objects from several threads are merged afterwards.
+//
+class statistics {
+public:
+    using clock = std::chrono::steady_clock;
+
+    //
+    // Running totals kept elsewhere, sampled at the start and the end of a
+    // phase.
+    //
+    struct counters {
+        size_t lookups_;
+        size_t lookup_misses_;
+        size_t cache_hits_;
+        size_t cache_misses_;
+    };
+
+    //
+    // A pass over the source, or the patching of forward references in
+    // one-pass mode.
+    //
+    struct phase {
+        string name_;
+        int64_t nanoseconds_ = 0;
+        size_t scans_ = 0;
+        size_t bytes_ = 0;
+        counters counters_ = {};
+    };
+
+    //
+    // Calls of the macros with one name, whatever their parameter count.
+    // The time includes the macros called from the body.
+    //
+    struct macro_stats {
+        size_t expansions_ = 0;
+        int64_t nanoseconds_ = 0;
+    };
+
+    statistics() = default;
+
+    void begin_phase(const string& name, const counters& c);
+    void end_phase(const counters& c);
+    void count_scan() { phases_.back().scans_++; }
+    void count_bytes(size_t n) { phases_.back().bytes_ += n; }
+    void add_expansion(int macro_name, clock::time_point start);
+
+    void merge(const statistics& other);
+
+    void write_text(ostream& os, const interner& names) const;
+    void write_json(ostream& os, const interner& names) const;
+
+    size_t files_ = 0;
+    vector<phase> phases_;
+    unordered_map<int, macro_stats> macros_;
+
+private:
+    vector<std::pair<int, macro_stats>> sorted_macros() const;
+
+    clock::time_point phase_start_;
+    counters phase_counters_;
+};
+
+#endif
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
@@ -7,26 +8,15 @@
 
 using std::ostream;
 using std::string;
+using std::string_view;
 using std::vector;
 using std::cout;
 using std::endl;
 
-symbol::symbol(string& name, int value, symbol_type type) : 
-        name_(name), value_(value), type_(type) 
+symbol::symbol(int value, symbol_type type) : 
+        value_(value), type_(type), expr_(-1)
 {
-    macro_defs_ = vector<macro>();
+    macro_defs_ = NULL;
 }
 
-symbol::symbol(string& name, int value) : symbol(name, value, ASSIGN) {}
-
-symbol::symbol(string& name) : symbol(name, 0, UNDEF) {}
-
-ostream& operator<<(ostream& os, const symbol& s)
-{
-    os << "symbol " << s.name_ << " = " << s.value_;
-    for (auto & m : s.macro_defs_) {
-        os << m;
-    }
-    os << "\n";
-    return os;
-}
\ No newline at end of file
+symbol::symbol(int value) : symbol(value, ASSIGN) {}
\ No newline at end of file
@@ -2,32 +2,36 @@
 #define SYMBOL_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
 #include "macro.h"
 
 using std::string;
+using std::string_view;
 using std::vector;
 using std::ostream;
 
 class symbol;
 
+//
+// Symbol record, stored in a flat array indexed by the symbol id. The name
+// is kept by the symbol table's interner. expr_ is the pending expression
+// the symbol was assigned from in one-pass mode, or -1.
+//
 class symbol {
 public:
     enum symbol_type { UNDEF, ASSIGN, LABEL };
     
     symbol() = default;
-    symbol(string& name, int value, symbol_type type);
-    symbol(string& name, int value);
-    symbol(string& name);
+    symbol(int value, symbol_type type);
+    symbol(int value);
 
-    string name_;
     int value_;
     symbol_type type_;
-    vector<macro> macro_defs_;
+    int expr_;
+    macro* macro_defs_;
 };
 
-ostream& operator<<(ostream& os, const symbol& s);
-
 #endif
\ No newline at end of file
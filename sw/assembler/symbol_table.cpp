@@ -1,107 +1,206 @@
-#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 
+#include "token.h"
 #include "macro.h"
 #include "symbol.h"
+#include "interner.h"
 #include "symbol_table.h"
 
-using std::unordered_map;
 using std::string;
+using std::string_view;
 using std::vector;
-using std::pair;
 using std::ostream;
 
+symbol_table::symbol_table(interner& names) :
+        names_(&names), macro_arena_(256), param_arena_(1024), 
+        token_arena_(4096)
+{
+    lookups_ = 0;
+    lookup_misses_ = 0;
+    grow();
+}
+
+//
+// Makes room for every name interned so far. Called whenever new tokens
+// may have been lexed, so that symbol ids cached in tokens index the table
+// without a bounds check.
+//
+void symbol_table::grow()
+{
+    size_t size = names_->size();
+    if (symbols_.size() < size) {
+        symbols_.resize(size, symbol(0, symbol::UNDEF));
+    }
+}
+
+//
+// Starts from the symbols and macros of another table, which is used to
+// seed each assembler with the prelude. The macros are shared, not copied.
+//
+void symbol_table::copy_symbols(
+    const symbol_table& other)
+{
+    symbols_ = other.symbols_;
+    prelude_macros_ = other.prelude_macros_;
+    grow();
+}
+
 bool symbol_table::add_macro(
-    string& macro_name, 
-    vector<string>& macro_params,
-    string& macro_body)
+    int macro_name, 
+    vector<int>& macro_params,
+    const token* macro_body,
+    size_t body_length)
 {
     macro *m;
     if (get_macro(macro_name, macro_params.size(), &m)) {
         return false;
     } else {
-        symbol *s;
-        get_symbol(macro_name, true, &s);
-        s->macro_defs_.push_back(
-                macro(macro_name, macro_body, macro_params));
+        int num_params = macro_params.size();
+
+        //
+        // The parameters and every symbol in the body were interned when
+        // the source was lexed, so expanding the macro never has to hash a
+        // name.
+        //
+        int *params = param_arena_.allocate(num_params);
+        for (int i = 0; i < num_params; ++i) {
+            params[i] = macro_params[i];
+        }
+
+        token *body = token_arena_.allocate(body_length + 1);
+        for (size_t i = 0; i < body_length; ++i) {
+            body[i] = macro_body[i];
+        }
+        body[body_length] = token(token::END, "", 0);
+
+        m = macro_arena_.allocate(1);
+        *m = macro(macro_name, num_params, params, body);
+        m->next_ = symbols_[macro_name].macro_defs_;
+        symbols_[macro_name].macro_defs_ = m;
         return true;
     }
 }
 
 void symbol_table::add_symbol(
-    string& symbol_name,
+    string_view symbol_name,
     int value,
     symbol::symbol_type type)
 {
-    table_.emplace(symbol_name, symbol(symbol_name, value, type));
+    symbols_[intern(symbol_name)] = symbol(value, type);
 }
 
 void symbol_table::clear_macro(
-    string& symbol_name)
+    string_view symbol_name)
 {
-    symbol *s;
-    if (get_symbol(symbol_name, false, &s)) {
-        s->macro_defs_.clear();
+    int id;
+    if (get_symbol(symbol_name, false, &id)) {
+        symbols_[id].macro_defs_ = NULL;
     }
 }
 
 bool symbol_table::get_macro(
-    string& macro_name,
+    string_view macro_name,
     int num_params,
     macro** macro_out)
 {
-    symbol *s = NULL;
-    bool ret = false;
-    if (get_symbol(macro_name, false, &s)) {
-        auto it = s->macro_defs_.begin();
-        for (; it != s->macro_defs_.end(); ++it) {
-            if (it->params_.size() == num_params) {
-                *macro_out = (macro *)&(*it);
-                ret = true;
-            }
+    int id;
+    if (get_symbol(macro_name, false, &id)) {
+        return get_macro(id, num_params, macro_out);
+    }
+    return false;
+}
+
+bool symbol_table::get_macro(
+    int symbol_id,
+    int num_params,
+    macro** macro_out)
+{
+    macro *m = symbols_[symbol_id].macro_defs_;
+    for (; m != NULL; m = m->next_) {
+        if (m->num_params_ == num_params) {
+            *macro_out = m;
+            return true;
         }
     }
-    return ret;
+    return false;
 }
 
 bool symbol_table::get_symbol(
-    string& symbol_name,
+    string_view symbol_name,
     bool create,
-    symbol** symbol_out)
+    int* symbol_out)
 {
-    auto it = table_.find(symbol_name);
-    if (it == table_.end()) {
-        if (create) {
-            auto emplace_pair = table_.emplace(symbol_name, 
-                    symbol(symbol_name, 0, symbol::UNDEF));
-            if (emplace_pair.second) {
-                *symbol_out = (symbol *)&(emplace_pair.first->second);
-                return true;
-            } else {
-                return false;
-            }
-        } else {
-            return false;
-        }
-    } else {
-        *symbol_out = (symbol *)&(it->second);
+    lookups_++;
+    lookup_misses_++;
+    if (create) {
+        *symbol_out = intern(symbol_name);
         return true;
     }
+    return names_->find(symbol_name, symbol_out) 
+            && (size_t)*symbol_out < symbols_.size();
+}
+
+//
+// Returns the id of the symbol named by a SYMBOL token. Tokens from the
+// lexer already carry it.
+//
+int symbol_table::get_symbol(
+    const token& t)
+{
+    lookups_++;
+    if (t.symbol_ >= 0) {
+        return t.symbol_;
+    }
+    lookup_misses_++;
+    return intern(t.text_);
 }
 
+int symbol_table::intern(
+    string_view symbol_name)
+{
+    int id = names_->intern(symbol_name);
+    grow();
+    return id;
+}
+
+//
+// Macro definitions are rebuilt on every pass, so the arenas holding them
+// are released as well. Only the prelude's definitions remain.
+//
 void symbol_table::initialize_macros()
 {
-    for (auto &it : table_) {
-        it.second.macro_defs_.clear();
+    for (size_t id = 0; id < symbols_.size(); ++id) {
+        symbols_[id].macro_defs_ = 
+                id < prelude_macros_.size() ? prelude_macros_[id] : NULL;
     }
+    macro_arena_.clear();
+    param_arena_.clear();
+    token_arena_.clear();
 }
 
 ostream& operator<<(ostream& os, const symbol_table& st)
 {
-    for (auto const& it : st.table_) {
-        os << it.second;
+    for (size_t id = 0; id < st.symbols_.size(); ++id) {
+        const symbol& s = st.symbols_[id];
+        os << "symbol " << st.name(id) << " = " << s.value_;
+        for (macro *m = s.macro_defs_; m != NULL; m = m->next_) {
+            os << "\nmacro " << st.name(m->name_) << "(";
+            for (int i = 0; i < m->num_params_; ++i) {
+                os << (i > 0 ? ", " : "") << st.name(m->params_[i]);
+            }
+            os << ") { ";
+            for (token *t = m->body_; t->type_ != token::END; ++t) {
+                os << *t;
+                if (t->type_ != token::PUNCT && t->type_ != token::EOL) {
+                    os << " ";
+                }
+            }
+            os << " } ";
+        }
+        os << "\n";
     }
     return os;
 }
\ No newline at end of file
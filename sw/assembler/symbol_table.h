@@ -1,49 +1,107 @@
 #ifndef SYMBOL_TABLE_H
 #define SYMBOL_TABLE_H
 
-#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "arena.h"
+#include "token.h"
 #include "macro.h"
 #include "symbol.h"
+#include "interner.h"
 
-using std::unordered_map;
 using std::string;
+using std::string_view;
 using std::vector;
 
+//
+// Symbol records live in a flat array indexed by the id the interner gave
+// the name, macro definitions live in arenas. Each assembler has its own
+// table, the interner is shared.
+//
 class symbol_table {
 public:
-    symbol_table() = default;
+    //
+    // Id of ".", interned when the interner is created.
+    //
+    static const int DOT = interner::DOT;
+
+    symbol_table(interner& names);
     void initialize_macros();
+    void copy_symbols(const symbol_table& other);
+    void grow();
 
     bool add_macro(
-        string& macro_name, 
-        vector<string>& macro_params,
-        string& macro_body);
+        int macro_name, 
+        vector<int>& macro_params,
+        const token* macro_body,
+        size_t body_length);
 
     void add_symbol(
-        string& symbol_name,
+        string_view symbol_name,
         int value,
         symbol::symbol_type type);
 
     void clear_macro(
-        string& symbol_name);
+        string_view symbol_name);
+
+    bool get_macro(
+        string_view macro_name,
+        int num_params,
+        macro** macro_out);
 
     bool get_macro(
-        string& macro_name,
+        int symbol_id,
         int num_params,
         macro** macro_out);
 
+    int get_symbol(
+        const token& t);
+
     bool get_symbol(
-        string& symbol_name,
+        string_view symbol_name,
         bool create,
-        symbol** symbol_out);
+        int* symbol_out);
+
+    int intern(
+        string_view symbol_name);
+
+    symbol& operator[](int symbol_id) { return symbols_[symbol_id]; }
+    const symbol& operator[](int symbol_id) const 
+    { 
+        return symbols_[symbol_id]; 
+    }
+    symbol& dot() { return symbols_[DOT]; }
+    string_view name(int symbol_id) const { return names_->name(symbol_id); }
+    size_t size() const { return symbols_.size(); }
+
+    //
+    // Calls of get_symbol(), and how many of them had to hash the name
+    // because it didn't come with an id.
+    //
+    size_t lookups() const { return lookups_; }
+    size_t lookup_misses() const { return lookup_misses_; }
 
     friend ostream& operator<<(ostream& o, const symbol_table& st);
+    friend class snapshot;
 
 private:
-    unordered_map<string, symbol> table_;
+    interner* names_;
+    vector<symbol> symbols_;
+
+    //
+    // Macro definitions loaded from a prelude snapshot, indexed by symbol
+    // id. They are kept when the macros are rebuilt for the next pass.
+    //
+    vector<macro*> prelude_macros_;
+
+    arena<macro> macro_arena_;
+    arena<int> param_arena_;
+    arena<token> token_arena_;
+
+    size_t lookups_;
+    size_t lookup_misses_;
 };
 
 #endif
\ No newline at end of file
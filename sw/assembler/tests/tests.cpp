@@ -0,0 +1,203 @@
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../source_cache.h"
+#include "../image.h"
+#include "../assembler.h"
+#include "../line_map.h"
+#include "../mapped_file.h"
+
+using std::cout;
+using std::endl;
+using std::ostringstream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Checks of what the assembler produces that are easy to break without
+// noticing. Each test is run with two passes and with one, and returns
+// what went wrong, or an empty string if it passed. macros is the full
+// path of beta.uasm.
+//
+struct test {
+    const char* name_;
+    string (*run_)(const string& macros, bool one_pass);
+};
+
+void usage();
+
+//
+// Assembles text as the command line tool would a file of that name in
+// the current directory and writes the image in format to output_out.
+//
+static bool assemble(
+    const string& text,
+    bool one_pass,
+    image::image_format format,
+    string& output_out,
+    string& error_out)
+{
+    source_cache sources;
+    assembler a(sources, NULL, one_pass);
+    if (!a.assemble(sources.add("test.uasm", text))) {
+        error_out = a.error();
+        return false;
+    }
+    ostringstream os;
+    a.get_image().write(os, format);
+    output_out = os.str();
+    return true;
+}
+
+//
+// Text output is in order of address, one line for each byte the image
+// ends up with, however the source moved . around.
+//
+static string test_text_order(
+    const string&,
+    bool one_pass)
+{
+    string output;
+    string error;
+    if (!assemble(". = 8\n1 2\n. = 0\n3\n. = 9\n4\n", one_pass,
+            image::TEXT, output, error)) {
+        return error;
+    }
+    string expected = "mem[0] = 0x03\nmem[8] = 0x01\nmem[9] = 0x04\n";
+    return output == expected ? "" : "got\n" + output;
+}
+
+//
+// Every macro native_encoder.cpp encodes from its table is still defined
+// in beta.uasm as the table has it. Otherwise calls of it quietly go back
+// to being expanded.
+//
+static string test_native_table(
+    const string& macros,
+    bool one_pass)
+{
+    source_cache sources;
+    assembler a(sources, NULL, one_pass);
+    if (!a.assemble(sources.add("test.uasm",
+            ".include \"" + macros + "\"\n"))) {
+        return a.error();
+    }
+    string error;
+    for (auto const& name : a.unmatched_native()) {
+        error += (error.empty() ? "" : ", ") + name;
+    }
+    return error.empty() ? "" : "beta.uasm doesn't match " + error;
+}
+
+//
+// Line number of the first line of text that starts with prefix, or 0.
+//
+static int find_line(
+    string_view text,
+    string_view prefix)
+{
+    int line = 1;
+    for (size_t start = 0; start < text.size(); ++line) {
+        if (text.substr(start, prefix.size()) == prefix) {
+            return line;
+        }
+        size_t end = text.find('\n', start);
+        start = end == string_view::npos ? text.size() : end + 1;
+    }
+    return 0;
+}
+
+//
+// With a line map, an instruction from a macro the native encoder knows is
+// expanded like any other, so its bytes map through ADD in beta.uasm to the
+// betaop() it calls, and from there to the line of the call.
+//
+static string test_line_map_native(
+    const string& macros,
+    bool one_pass)
+{
+    mapped_file file;
+    if (!file.open(macros)) {
+        return "unable to open " + macros;
+    }
+    int add_line = find_line(file.text(), ".macro ADD(");
+
+    source_cache sources;
+    assembler a(sources, NULL, one_pass);
+    line_map map;
+    a.set_line_map(&map);
+    if (!a.assemble(sources.add("test.uasm",
+            ".include \"" + macros + "\"\nADD(R1, R2, R3)\n"))) {
+        return a.error();
+    }
+
+    string stack;
+    bool found = false;
+    int outer = -1;
+    for (int f = map.find(0); f >= 0; f = map.frames()[f].parent_) {
+        const line_map::frame& fr = map.frames()[f];
+        const string& name = map.files()[fr.file_];
+        stack = name.substr(name.rfind('/') + 1) + ":"
+                + std::to_string(fr.line_) + " " + fr.name_ + "\n" + stack;
+        found = found || (fr.line_ == add_line && fr.name_ == "betaop"
+                && name == macros);
+        outer = f;
+    }
+    if (!found || outer < 0 || map.frames()[outer].line_ != 2
+            || map.frames()[outer].name_ != "ADD") {
+        return "ADD doesn't map to line " + std::to_string(add_line)
+                + " of beta.uasm, the frames of byte 0 are\n" + stack;
+    }
+    return "";
+}
+
+static const test TESTS[] = {
+    { "text order", test_text_order },
+    { "native table", test_native_table },
+    { "line map of native macros", test_line_map_native },
+};
+
+void usage()
+{
+    cout << "usage: tests beta.uasm" << endl;
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    if (argc != 2) {
+        usage();
+        return -1;
+    }
+    char resolved[PATH_MAX];
+    if (realpath(argv[1], resolved) == NULL) {
+        cout << "unable to open " << argv[1] << endl;
+        return -1;
+    }
+
+    int num_tests = 0;
+    int failed = 0;
+    for (auto const& t : TESTS) {
+        for (bool one_pass : { false, true }) {
+            string error = t.run_(resolved, one_pass);
+            num_tests++;
+            if (!error.empty()) {
+                cout << t.name_ << (one_pass ? " (-1)" : "") << " FAILED: "
+                        << error;
+                if (error.back() != '\n') {
+                    cout << endl;
+                }
+                failed++;
+            }
+        }
+    }
+    cout << num_tests << " tests, " << failed << " failed" << endl;
+    return failed == 0 ? 0 : -1;
+}
\ No newline at end of file
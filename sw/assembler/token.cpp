@@ -0,0 +1,43 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+#include "token.h"
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::ostream;
+
+token::token(token_type type, string_view text, int value) :
+        type_(type), text_(text), value_(value)
+{
+    symbol_ = -1;
+    file_ = -1;
+    line_ = 0;
+}
+
+ostream& operator<<(ostream& os, const token& t)
+{
+    switch (t.type_) {
+        case token::SYMBOL: os << t.text_; break;
+        case token::NUMBER: os << t.value_; break;
+        case token::STRING: os << "\"" << t.text_ << "\""; break;
+        case token::PUNCT: os << (char)t.value_; break;
+        case token::EOL: os << "\n"; break;
+        case token::END: break;
+    }
+    return os;
+}
+
+ostream& operator<<(ostream& os, const vector<token>& tokens)
+{
+    for (auto const& t : tokens) {
+        os << t;
+        if (t.type_ != token::PUNCT && t.type_ != token::EOL) {
+            os << " ";
+        }
+    }
+    return os;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iostream>
+
+using std::string;
+using std::string_view;
+using std::vector;
+using std::ostream;
+
+class token {
+public:
+    enum token_type { SYMBOL, NUMBER, STRING, PUNCT, EOL, END };
+    enum directive { NONE, MACRO, ALIGN, TEXT, ASCII, INCLUDE };
+
+    token() = default;
+    token(token_type type, string_view text, int value);
+
+    token_type type_;
+
+    //
+    // Slice of the source holding the symbol name, the string contents
+    // between the quotes or the punctuation character.
+    //
+    string_view text_;
+
+    //
+    // Literal value for NUMBER, the punctuation character for PUNCT and the
+    // directive for SYMBOL.
+    //
+    int value_;
+
+    //
+    // Symbol id for SYMBOL, interned on first use and cached. -1 until then.
+    //
+    int symbol_;
+
+    //
+    // Source file id in the source cache and 1-based line, for diagnostics.
+    //
+    int file_;
+    int line_;
+
+    bool is_punct(char c) const { return type_ == PUNCT && value_ == c; }
+    bool is_eol() const { return type_ == EOL || type_ == END; }
+};
+
+ostream& operator<<(ostream& os, const token& t);
+ostream& operator<<(ostream& os, const vector<token>& tokens);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,40 @@
+#include <cstdint>
+
+#include "beta.h"
+
+bool beta::is_legal(
+    int opcode)
+{
+    switch (opcode) {
+        case LD: case ST: case JMP: case BEQ: case BNE: case LDR:
+        case ADD: case SUB: case CMPEQ: case CMPLT: case CMPLE:
+        case AND: case OR: case XOR: case XNOR: case SHL: case SHR: case SRA:
+        case ADDC: case SUBC: case CMPEQC: case CMPLTC: case CMPLEC:
+        case ANDC: case ORC: case XORC: case XNORC:
+        case SHLC: case SHRC: case SRAC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t beta::operate(
+    int op,
+    uint32_t a,
+    uint32_t b)
+{
+    switch (op & ~0x10) {
+        case ADD: return a + b;
+        case SUB: return a - b;
+        case CMPEQ: return a == b;
+        case CMPLT: return (int32_t)a < (int32_t)b;
+        case CMPLE: return (int32_t)a <= (int32_t)b;
+        case AND: return a & b;
+        case OR: return a | b;
+        case XOR: return a ^ b;
+        case XNOR: return ~(a ^ b);
+        case SHL: return a << (b & 0x1F);
+        case SHR: return a >> (b & 0x1F);
+        default: return (int32_t)a >> (b & 0x1F);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,111 @@
+#ifndef BETA_H
+#define BETA_H
+
+#include <cstdint>
+
+//
+// Constants of the Beta instruction set as implemented by the RTL, see
+// rtl/defines.v. Opcodes not listed here, including MUL and DIV, are
+// illegal.
+//
+class beta {
+public:
+    enum opcode {
+        LD = 0x18,
+        ST = 0x19,
+        JMP = 0x1B,
+        BEQ = 0x1C,
+        BNE = 0x1D,
+        LDR = 0x1F,
+        ADD = 0x20,
+        SUB = 0x21,
+        CMPEQ = 0x24,
+        CMPLT = 0x25,
+        CMPLE = 0x26,
+        AND = 0x28,
+        OR = 0x29,
+        XOR = 0x2A,
+        XNOR = 0x2B,
+        SHL = 0x2C,
+        SHR = 0x2D,
+        SRA = 0x2E,
+        ADDC = 0x30,
+        SUBC = 0x31,
+        CMPEQC = 0x34,
+        CMPLTC = 0x35,
+        CMPLEC = 0x36,
+        ANDC = 0x38,
+        ORC = 0x39,
+        XORC = 0x3A,
+        XNORC = 0x3B,
+        SHLC = 0x3C,
+        SHRC = 0x3D,
+        SRAC = 0x3E
+    };
+
+    static const uint32_t PC_RESET = 0x80000000;
+    static const uint32_t PC_EXCEPT = 0x80000004;
+    static const uint32_t PC_ILLOP = 0x80000008;
+
+    //
+    // Bit 31 of the PC, set while in supervisor mode.
+    //
+    static const uint32_t SUPERVISOR = 0x80000000;
+
+    static const uint32_t INST_NOP = 0x83fff800;
+
+    //
+    // BNE(R31, 0, XP), what decode passes on in place of an illegal
+    // instruction. defines.v has 0xcfdf0000, which has opcode 0x33.
+    //
+    static const uint32_t INST_BNE_EXCEPT = 0x77df0000;
+
+    //
+    // PRIV_OP(0) from beta.uasm. The simulators stop when they reach it,
+    // any other word with opcode 0 is an illegal instruction.
+    //
+    static const uint32_t INST_HALT = 0x00000000;
+
+    static const int R31 = 31;
+    static const int XP = 30;
+
+    static int opcode(uint32_t ir) { return ir >> 26; }
+    static int rc(uint32_t ir) { return (ir >> 21) & 0x1F; }
+    static int ra(uint32_t ir) { return (ir >> 16) & 0x1F; }
+    static int rb(uint32_t ir) { return (ir >> 11) & 0x1F; }
+    static int32_t literal(uint32_t ir) { return (int16_t)(ir & 0xFFFF); }
+
+    static bool is_legal(int opcode);
+
+    //
+    // Result of the operate instruction with opcode op, with or without a
+    // literal, for operands a and b.
+    //
+    static uint32_t operate(int op, uint32_t a, uint32_t b);
+
+    //
+    // Address of the next instruction and the target of a branch. Neither
+    // changes the supervisor bit.
+    //
+    static uint32_t next_pc(uint32_t pc)
+    {
+        return (pc & SUPERVISOR) | ((pc + 4) & ~SUPERVISOR);
+    }
+
+    static uint32_t branch_target(uint32_t next, int32_t literal)
+    {
+        return (next & SUPERVISOR)
+                | ((next + 4 * (uint32_t)literal) & ~SUPERVISOR);
+    }
+
+    //
+    // Target of a JMP. The low two bits are dropped and the supervisor bit
+    // can be cleared but not set.
+    //
+    static uint32_t jump_target(uint32_t pc, uint32_t address)
+    {
+        return (address & ~SUPERVISOR & ~3u) | (address & pc & SUPERVISOR);
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "cache.h"
+
+using std::string;
+using std::vector;
+
+static bool is_power_of_two(
+    uint64_t n)
+{
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static int log2_of(
+    uint64_t n)
+{
+    int bits = 0;
+    while ((1ULL << bits) < n) {
+        ++bits;
+    }
+    return bits;
+}
+
+//
+// Reads a number that can end in K or M, for "16K" and the like.
+//
+static bool parse_size(
+    const string& field,
+    uint64_t& value_out)
+{
+    char* end;
+    value_out = strtoull(field.c_str(), &end, 0);
+    if (end == field.c_str()) {
+        return false;
+    }
+    if (*end == 'K' || *end == 'k') {
+        value_out <<= 10;
+        ++end;
+    } else if (*end == 'M' || *end == 'm') {
+        value_out <<= 20;
+        ++end;
+    }
+    return *end == '\0';
+}
+
+bool cache::parse(
+    const string& spec,
+    config& config_out,
+    string& error_out)
+{
+    vector<string> fields;
+    size_t start = 0;
+    for (;;) {
+        size_t colon = spec.find(':', start);
+        fields.push_back(spec.substr(start, colon - start));
+        if (colon == string::npos) {
+            break;
+        }
+        start = colon + 1;
+    }
+
+    config c;
+    uint64_t numbers[3];
+    bool bad = fields.size() < 3;
+    for (int i = 0; i < 3 && !bad; ++i) {
+        bad = !parse_size(fields[i], numbers[i])
+                || !is_power_of_two(numbers[i]) || numbers[i] > 1u << 30;
+    }
+    for (size_t i = 3; i < fields.size() && !bad; ++i) {
+        const string& f = fields[i];
+        uint64_t latency;
+        if (f == "lru") {
+            c.replacement_ = LRU;
+        } else if (f == "fifo") {
+            c.replacement_ = FIFO;
+        } else if (f == "random") {
+            c.replacement_ = RANDOM;
+        } else if (f == "wb") {
+            c.write_back_ = true;
+        } else if (f == "wt") {
+            c.write_back_ = false;
+        } else if (parse_size(f, latency) && latency <= 1000) {
+            c.latency_ = latency;
+        } else {
+            bad = true;
+        }
+    }
+    if (!bad) {
+        c.size_ = numbers[0];
+        c.ways_ = numbers[1];
+        c.line_size_ = numbers[2];
+        bad = c.line_size_ < 4 || c.line_size_ > c.size_
+                || c.ways_ > c.size_ / c.line_size_;
+    }
+    if (bad) {
+        error_out = "bad cache " + spec + ", expected size:ways:line"
+                "[:lru|fifo|random][:wb|wt][:latency]\n";
+        return false;
+    }
+    config_out = c;
+    return true;
+}
+
+cache::cache(
+    const config& c,
+    cache* next,
+    uint32_t memory_latency) :
+        config_(c), next_(next), memory_latency_(memory_latency),
+        line_bits_(log2_of(c.line_size_)),
+        set_bits_(log2_of(c.size_ / c.line_size_ / c.ways_)),
+        lines_(c.size_ / c.line_size_)
+{
+    reset();
+}
+
+void cache::reset()
+{
+    for (auto& l : lines_) {
+        l = line();
+    }
+    time_ = 0;
+    random_ = 1;
+    stats_ = statistics();
+}
+
+//
+// An empty way if there is one, otherwise the one the policy picks.
+//
+cache::line& cache::victim(
+    line* set)
+{
+    line* chosen = &set[0];
+    for (uint32_t w = 0; w < config_.ways_; ++w) {
+        if (!set[w].valid_) {
+            return set[w];
+        }
+        if (set[w].stamp_ < chosen->stamp_) {
+            chosen = &set[w];
+        }
+    }
+    if (config_.replacement_ == RANDOM) {
+        random_ ^= random_ << 13;
+        random_ ^= random_ >> 17;
+        random_ ^= random_ << 5;
+        chosen = &set[random_ & (config_.ways_ - 1)];
+    }
+    return *chosen;
+}
+
+uint32_t cache::access(
+    uint32_t address,
+    bool write,
+    bool& miss_out)
+{
+    uint32_t set_index = (address >> line_bits_) & ((1u << set_bits_) - 1);
+    uint32_t tag = (uint64_t)address >> (line_bits_ + set_bits_);
+    line* set = &lines_[set_index * config_.ways_];
+    time_++;
+    (write ? stats_.writes_ : stats_.reads_)++;
+
+    uint32_t cycles = config_.latency_;
+    bool next_miss;
+    if (write && !config_.write_back_) {
+        stats_.writes_through_++;
+        if (next_ != NULL) {
+            next_->access(address, true, next_miss);
+        }
+    }
+
+    for (uint32_t w = 0; w < config_.ways_; ++w) {
+        line& l = set[w];
+        if (l.valid_ && l.tag_ == tag) {
+            miss_out = false;
+            l.dirty_ = l.dirty_ || (write && config_.write_back_);
+            if (config_.replacement_ == LRU) {
+                l.stamp_ = time_;
+            }
+            return cycles;
+        }
+    }
+
+    miss_out = true;
+    (write ? stats_.write_misses_ : stats_.read_misses_)++;
+    if (write && !config_.write_back_) {
+        return cycles;
+    }
+
+    line& l = victim(set);
+    if (l.valid_ && l.dirty_) {
+        stats_.write_backs_++;
+        if (next_ != NULL) {
+            uint32_t victim_address = ((l.tag_ << set_bits_) | set_index)
+                    << line_bits_;
+            next_->access(victim_address, true, next_miss);
+        }
+    }
+    cycles += next_ != NULL ? next_->access(address, false, next_miss)
+            : memory_latency_;
+    l.tag_ = tag;
+    l.valid_ = true;
+    l.dirty_ = write;
+    l.stamp_ = time_;
+    return cycles;
+}
+
+string cache::describe() const
+{
+    static const char* policies[] = { "LRU", "FIFO", "random" };
+    auto bytes = [](uint32_t n) {
+        return n % (1 << 20) == 0 ? std::to_string(n >> 20) + " MB"
+                : n % (1 << 10) == 0 ? std::to_string(n >> 10) + " KB"
+                : std::to_string(n) + " B";
+    };
+    string text = bytes(config_.size_) + ", "
+            + std::to_string(config_.ways_) + "-way, "
+            + bytes(config_.line_size_) + " lines, "
+            + policies[config_.replacement_]
+            + (config_.write_back_ ? ", write-back" : ", write-through");
+    if (config_.latency_ != 0) {
+        text += ", " + std::to_string(config_.latency_) + " cycles";
+    }
+    return text;
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//
+// Timing model of one level of cache for the pipeline model. Only the tags
+// are kept; the words themselves stay in memory, so a cache changes when
+// things happen and never what a program computes.
+//
+// A hit costs latency cycles more than the single cycle core.v expects of
+// its memories, a miss that much plus what the next level takes, or the
+// memory latency after the last level. A write-back cache allocates a line
+// on a write miss, reading it in first, and writes dirty lines back when
+// they are replaced. A write-through cache passes every write on and only
+// keeps a line it already has up to date. Writes passed on and lines
+// written back go through a write buffer and cost no cycles, but they still
+// count in the next level.
+//
+class cache {
+public:
+    enum replacement_policy { LRU, FIFO, RANDOM };
+
+    struct config {
+        uint32_t size_;
+        uint32_t ways_;
+        uint32_t line_size_;
+        replacement_policy replacement_ = LRU;
+        bool write_back_ = true;
+        uint32_t latency_ = 0;
+    };
+
+    struct statistics {
+        uint64_t reads_;
+        uint64_t writes_;
+        uint64_t read_misses_;
+        uint64_t write_misses_;
+        uint64_t write_backs_;
+        uint64_t writes_through_;
+    };
+
+    //
+    // Reads "size:ways:line" followed by any of ":lru", ":fifo", ":random",
+    // ":wb", ":wt" and ":latency". The size can end in K or M. Sizes are
+    // powers of two, the line at least a word and the ways no more than
+    // the lines.
+    //
+    static bool parse(
+        const string& spec,
+        config& config_out,
+        string& error_out);
+
+    //
+    // next is the level misses go to, or NULL for memory, which takes
+    // memory_latency cycles.
+    //
+    cache(const config& c, cache* next, uint32_t memory_latency);
+    cache(const cache&) = delete;
+    cache& operator=(const cache&) = delete;
+
+    //
+    // Empties the cache and clears the counts.
+    //
+    void reset();
+
+    //
+    // Looks up the word at address, returning the cycles it costs beyond
+    // the pipeline's one and whether it missed here.
+    //
+    uint32_t access(uint32_t address, bool write, bool& miss_out);
+
+    //
+    // A line such as "16 KB, 4-way, 32 B lines, LRU, write-back".
+    //
+    string describe() const;
+
+    const config& configuration() const { return config_; }
+    const statistics& stats() const { return stats_; }
+
+private:
+    struct line {
+        uint32_t tag_;
+        bool valid_;
+        bool dirty_;
+
+        //
+        // When the line was last used for LRU, or filled for FIFO.
+        //
+        uint64_t stamp_;
+    };
+
+    line& victim(line* set);
+
+    config config_;
+    cache* next_;
+    uint32_t memory_latency_;
+    int line_bits_;
+    int set_bits_;
+    vector<line> lines_;
+    uint64_t time_;
+    uint32_t random_;
+    statistics stats_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+
+using std::string;
+using std::vector;
+
+const char checkpoint::MAGIC[8] = { 'B', 'E', 'T', 'A', 'C', 'K', 'P', '1' };
+
+//
+// Bytes of memory in each page, less than PAGE_SIZE only for memories
+// smaller than a page.
+//
+static uint64_t page_bytes(
+    const memory& m)
+{
+    return std::min(checkpoint::PAGE_SIZE, m.size());
+}
+
+//
+// Index of every page of m that is mapped or isn't all zero. Pages the host
+// never gave memory to are skipped without reading them, so a mostly
+// untouched 2 GB memory is scanned quickly.
+//
+static vector<uint32_t> used_pages(
+    const memory& m)
+{
+    uint64_t host_page = sysconf(_SC_PAGESIZE);
+    uint64_t bytes = page_bytes(m);
+    uint64_t num_pages = m.size() / bytes;
+    vector<unsigned char> resident((m.size() + host_page - 1) / host_page);
+    bool know_resident = mincore(m.words(), m.size(), resident.data()) == 0;
+    vector<uint32_t> pages;
+
+    for (uint64_t page = 0; page < num_pages; ++page) {
+        uint64_t address = page * bytes;
+        if (m.mapped(address)) {
+            pages.push_back(page);
+            continue;
+        }
+        if (know_resident) {
+            bool any = false;
+            for (uint64_t h = address / host_page;
+                    h <= (address + bytes - 1) / host_page; ++h) {
+                any = any || (resident[h] & 1);
+            }
+            if (!any) {
+                continue;
+            }
+        }
+        const uint32_t* words = m.words() + address / 4;
+        for (uint64_t i = 0; i < bytes / 4; ++i) {
+            if (words[i] != 0) {
+                pages.push_back(page);
+                break;
+            }
+        }
+    }
+    return pages;
+}
+
+checkpoint::~checkpoint()
+{
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+uint64_t checkpoint::data_offset(
+    uint64_t num_pages)
+{
+    uint64_t bytes = sizeof(header) + num_pages * sizeof(uint32_t);
+    return (bytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+}
+
+bool checkpoint::save(
+    const string& filename,
+    const cpu::state& s,
+    const memory& m,
+    string& error_out)
+{
+    vector<uint32_t> pages = used_pages(m);
+    header h = {};
+    memcpy(h.magic_, MAGIC, sizeof(MAGIC));
+    h.memory_size_ = m.size();
+    h.num_pages_ = pages.size();
+    h.state_ = s;
+
+    FILE* file = fopen(filename.c_str(), "wb");
+    if (file == NULL) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+
+    vector<uint8_t> head(data_offset(pages.size()));
+    memcpy(head.data(), &h, sizeof(h));
+    memcpy(head.data() + sizeof(h), pages.data(),
+            pages.size() * sizeof(uint32_t));
+    fwrite(head.data(), 1, head.size(), file);
+
+    uint64_t bytes = page_bytes(m);
+    vector<uint8_t> padding(PAGE_SIZE - bytes);
+    for (auto page : pages) {
+        fwrite(m.words() + page * bytes / 4, 1, bytes, file);
+        fwrite(padding.data(), 1, padding.size(), file);
+    }
+
+    bool failed = ferror(file) != 0;
+    failed = fclose(file) != 0 || failed;
+    if (failed) {
+        error_out = "unable to write " + filename + "\n";
+    }
+    return !failed;
+}
+
+bool checkpoint::open(
+    const string& filename,
+    string& error_out)
+{
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+    filename_ = filename;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0
+            || pread(fd_, &header_, sizeof(header_), 0) != sizeof(header_)
+            || memcmp(header_.magic_, MAGIC, sizeof(MAGIC)) != 0) {
+        error_out = filename + " is not a checkpoint\n";
+        return false;
+    }
+
+    //
+    // Pages past the end of the file would fault when touched, so the
+    // file is checked to be complete now.
+    //
+    uint64_t size = header_.memory_size_;
+    uint64_t num_pages = size / std::min(PAGE_SIZE, size);
+    bool bad = size == 0 || (size & (size - 1)) != 0
+            || size > memory::DEFAULT_SIZE
+            || header_.num_pages_ > num_pages
+            || (uint64_t)st.st_size < data_offset(header_.num_pages_)
+                    + header_.num_pages_ * PAGE_SIZE;
+    if (!bad) {
+        pages_.resize(header_.num_pages_);
+        size_t bytes = pages_.size() * sizeof(uint32_t);
+        bad = pread(fd_, pages_.data(), bytes, sizeof(header_))
+                != (ssize_t)bytes;
+    }
+    for (size_t i = 0; i < pages_.size() && !bad; ++i) {
+        bad = pages_[i] >= num_pages || (i > 0 && pages_[i] <= pages_[i - 1]);
+    }
+    if (bad) {
+        error_out = filename + " is damaged\n";
+        return false;
+    }
+    return true;
+}
+
+//
+// Runs of consecutive pages are mapped with one call. Where the host's
+// pages don't fit the checkpoint's, and for memories smaller than a page,
+// the pages are read instead.
+//
+bool checkpoint::restore(
+    memory& m,
+    string& error_out) const
+{
+    if (m.size() != header_.memory_size_) {
+        error_out = filename_ + " needs " + std::to_string(memory_size())
+                + " bytes of memory\n";
+        return false;
+    }
+    m.clear();
+
+    uint64_t host_page = sysconf(_SC_PAGESIZE);
+    bool map = m.size() >= PAGE_SIZE && PAGE_SIZE % host_page == 0;
+    uint64_t base = data_offset(pages_.size());
+
+    for (size_t i = 0; i < pages_.size();) {
+        size_t j = i + 1;
+        while (j < pages_.size() && pages_[j] == pages_[j - 1] + 1) {
+            ++j;
+        }
+        uint64_t address = (uint64_t)pages_[i] * PAGE_SIZE;
+        uint64_t length = std::min((j - i) * PAGE_SIZE, m.size() - address);
+        uint64_t offset = base + i * PAGE_SIZE;
+        bool done = map ? m.map_file(address, length, fd_, offset)
+                : pread(fd_, (uint8_t*)m.words() + address, length, offset)
+                        == (ssize_t)length;
+        if (!done) {
+            error_out = "unable to restore " + filename_ + "\n";
+            return false;
+        }
+        m.map_pages(address, length);
+        i = j;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "cpu.h"
+#include "memory.h"
+
+using std::string;
+using std::vector;
+
+//
+// The architectural state of a run saved to a file, so later runs can
+// start from it instead of executing everything before it again. A
+// checkpoint file has, in host byte order:
+//
+//     header  MAGIC, the memory size, the number of pages and a cpu::state
+//     pages   the index of each page saved, in increasing order
+//     data    PAGE_SIZE bytes for each page saved
+//
+// The data starts at a multiple of PAGE_SIZE. Only pages that are mapped or
+// aren't all zero are saved, so a checkpoint of a program in 2 GB of memory
+// is about the size of the memory the program used. The pages restored are
+// mapped.
+//
+// Restoring maps the pages of the file over memory copy on write rather
+// than reading them, so it takes a few system calls however much memory
+// there is, and pages are only copied once the program writes to them.
+// Any number of runs can be restored from one checkpoint.
+//
+class checkpoint {
+public:
+    static const char MAGIC[8];
+    static const uint64_t PAGE_SIZE = 4096;
+
+    checkpoint() = default;
+    checkpoint(const checkpoint&) = delete;
+    checkpoint& operator=(const checkpoint&) = delete;
+    ~checkpoint();
+
+    static bool save(
+        const string& filename,
+        const cpu::state& s,
+        const memory& m,
+        string& error_out);
+
+    //
+    // Reads the header and page indices of a checkpoint and keeps the file
+    // open to restore from.
+    //
+    bool open(const string& filename, string& error_out);
+
+    //
+    // Sets m back to what it held when the checkpoint was saved. m must be
+    // of memory_size().
+    //
+    bool restore(memory& m, string& error_out) const;
+
+    uint64_t memory_size() const { return header_.memory_size_; }
+    const cpu::state& cpu_state() const { return header_.state_; }
+
+private:
+    struct header {
+        char magic_[8];
+        uint64_t memory_size_;
+        uint64_t num_pages_;
+        cpu::state state_;
+    };
+
+    static uint64_t data_offset(uint64_t num_pages);
+
+    int fd_ = -1;
+    string filename_;
+    header header_ = {};
+    vector<uint32_t> pages_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,465 @@
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "beta.h"
+#include "memory.h"
+#include "decode_cache.h"
+#include "jit.h"
+#include "cpu.h"
+
+cpu::cpu(
+    memory& m,
+    uint32_t illop) :
+        cpu(m, m, illop)
+{
+}
+
+cpu::cpu(
+    memory& instructions,
+    memory& data,
+    uint32_t illop) :
+        code_(instructions), data_(data), illop_(illop), cache_(instructions)
+{
+    reset();
+}
+
+void cpu::reset()
+{
+    pc_ = beta::PC_RESET;
+    memset(regs_, 0, sizeof(regs_));
+    instructions_ = 0;
+    traps_ = 0;
+}
+
+void cpu::restore_state(
+    const state& s)
+{
+    pc_ = s.pc_;
+    memcpy(regs_, s.regs_, sizeof(s.regs_));
+    regs_[31] = 0;
+    instructions_ = s.instructions_;
+    traps_ = s.traps_;
+    invalidate();
+}
+
+cpu::state cpu::save_state() const
+{
+    state s;
+    s.pc_ = pc_;
+    memcpy(s.regs_, regs_, sizeof(s.regs_));
+    s.instructions_ = instructions_;
+    s.traps_ = traps_;
+    return s;
+}
+
+bool cpu::set_dispatch(
+    dispatch_mode mode,
+    string& error_out)
+{
+    if (mode == JIT && jit_ == NULL) {
+        unique_ptr<jit> j(new jit(code_, data_, cache_));
+        if (!j->allocate(error_out)) {
+            return false;
+        }
+        jit_ = std::move(j);
+    }
+    if (mode != JIT) {
+        jit_.reset();
+    }
+    dispatch_ = mode;
+    return true;
+}
+
+void cpu::invalidate()
+{
+    if (jit_ != NULL) {
+        jit_->flush();
+    }
+    cache_.clear();
+}
+
+//
+// Whether the instruction at pc, which just continued at pc itself, would
+// do so again with the registers it left behind. It writes the same value
+// each time, so nothing changes from then on.
+//
+static bool is_settled(
+    uint32_t ir,
+    uint32_t pc,
+    const uint32_t* regs)
+{
+    uint32_t a = regs[beta::ra(ir)];
+    switch (beta::opcode(ir)) {
+        case beta::BEQ: return a == 0;
+        case beta::BNE: return a != 0;
+        case beta::JMP: return beta::jump_target(pc, a) == pc;
+        default: return true;
+    }
+}
+
+cpu::stop_reason cpu::run(
+    uint64_t max_instructions)
+{
+    uint64_t limit = max_instructions == 0
+            ? UINT64_MAX : instructions_ + max_instructions;
+    return dispatch_ == SWITCH || trace_ != NULL || !wrap_ || trap_unmapped_
+            ? run_switch(limit) : run_threaded(limit);
+}
+
+//
+// Fetches and decodes every instruction as it comes to it.
+//
+cpu::stop_reason cpu::run_switch(
+    uint64_t limit)
+{
+    uint64_t count = instructions_;
+    uint32_t* r = regs_;
+    uint32_t pc = pc_;
+    trace_writer* trace = trace_;
+    bool wrap = wrap_;
+    bool trap_unmapped = trap_unmapped_;
+    stop_reason reason = LIMIT;
+
+    //
+    // Stops before the instruction if address is past the end of m, or
+    // for CHECK in a page of m that isn't mapped.
+    //
+#define FAULT_IF(condition, address) \
+    do { \
+        if (condition) { \
+            fault_address_ = (address); \
+            reason = FAULT; \
+            goto done; \
+        } \
+    } while (0)
+#define CHECK_END(m, address) \
+    FAULT_IF(!wrap && !(m).contains(address), address)
+#define CHECK(m, address) \
+    FAULT_IF((!wrap && !(m).contains(address)) \
+            || (trap_unmapped && !(m).mapped(address)), address)
+
+    while (count < limit) {
+        CHECK(code_, pc);
+        uint32_t ir = code_.read(pc);
+        uint32_t next = beta::next_pc(pc);
+        int rc = beta::rc(ir);
+        uint32_t a = r[beta::ra(ir)];
+        uint32_t b = r[beta::rb(ir)];
+        uint32_t c = beta::literal(ir);
+        uint32_t y;
+
+        switch (beta::opcode(ir)) {
+            case beta::ADD: y = a + b; break;
+            case beta::SUB: y = a - b; break;
+            case beta::CMPEQ: y = a == b; break;
+            case beta::CMPLT: y = (int32_t)a < (int32_t)b; break;
+            case beta::CMPLE: y = (int32_t)a <= (int32_t)b; break;
+            case beta::AND: y = a & b; break;
+            case beta::OR: y = a | b; break;
+            case beta::XOR: y = a ^ b; break;
+            case beta::XNOR: y = ~(a ^ b); break;
+            case beta::SHL: y = a << (b & 0x1F); break;
+            case beta::SHR: y = a >> (b & 0x1F); break;
+            case beta::SRA: y = (int32_t)a >> (b & 0x1F); break;
+            case beta::ADDC: y = a + c; break;
+            case beta::SUBC: y = a - c; break;
+            case beta::CMPEQC: y = a == c; break;
+            case beta::CMPLTC: y = (int32_t)a < (int32_t)c; break;
+            case beta::CMPLEC: y = (int32_t)a <= (int32_t)c; break;
+            case beta::ANDC: y = a & c; break;
+            case beta::ORC: y = a | c; break;
+            case beta::XORC: y = a ^ c; break;
+            case beta::XNORC: y = ~(a ^ c); break;
+            case beta::SHLC: y = a << (c & 0x1F); break;
+            case beta::SHRC: y = a >> (c & 0x1F); break;
+            case beta::SRAC: y = (int32_t)a >> (c & 0x1F); break;
+            case beta::LD:
+                CHECK(data_, a + c);
+                y = data_.read(a + c);
+                break;
+            case beta::LDR:
+                CHECK(data_, beta::branch_target(next, c));
+                y = data_.read(beta::branch_target(next, c));
+                break;
+            case beta::ST:
+                CHECK_END(data_, a + c);
+                if (trap_unmapped) {
+                    data_.map_page(a + c);
+                }
+                data_.write(a + c, r[rc]);
+                if (trace != NULL) {
+                    trace->write_store(pc, a + c, r[rc]);
+                }
+                count++;
+                pc = next;
+                continue;
+            case beta::JMP:
+                y = next;
+                next = beta::jump_target(pc, a);
+                break;
+            case beta::BEQ:
+                y = next;
+                next = a == 0 ? beta::branch_target(next, c) : next;
+                break;
+            case beta::BNE:
+                y = next;
+                next = a != 0 ? beta::branch_target(next, c) : next;
+                break;
+            default:
+                if (ir == beta::INST_HALT) {
+                    reason = HALTED;
+                    goto done;
+                }
+                y = next;
+                rc = beta::XP;
+                next = illop_;
+                traps_++;
+                break;
+        }
+
+        if (rc != beta::R31) {
+            r[rc] = y;
+            if (trace != NULL) {
+                trace->write_register(pc, rc, y);
+            }
+        }
+        count++;
+        if (next == pc && is_settled(ir, pc, r)) {
+            reason = LOOPING;
+            goto done;
+        }
+        pc = next;
+    }
+
+done:
+#undef CHECK
+#undef CHECK_END
+#undef FAULT_IF
+    pc_ = pc;
+    instructions_ = count;
+    return reason;
+}
+
+//
+// Runs the handlers of decoded instructions, each of which ends by looking
+// up the next one and jumping to its handler, using the labels as values
+// extension of GCC and Clang. The first time an instruction is run its
+// handler is decode, which fills in the instruction and jumps to the real
+// handler. A store to a word marked as decoded resets its handler to
+// decode.
+//
+// Only branches, JMP and illegal instructions can continue at their own
+// address, so only they check for a self-loop. They also end basic blocks,
+// and go on through the jit if there is one.
+//
+// When instructions have a memory of their own, stores can't change them
+// and don't look at the marks.
+//
+cpu::stop_reason cpu::run_threaded(
+    uint64_t limit)
+{
+    static const uint32_t OFFSET_MASK = decode_cache::PAGE_WORDS - 1;
+
+    //
+    // Handler of each opcode.
+    //
+    static const void* const handlers[64] = {
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&illegal, &&illegal, &&illegal, &&illegal,
+        &&ld, &&st, &&illegal, &&jmp,
+        &&beq, &&bne, &&illegal, &&ldr,
+        &&add, &&sub, &&illegal, &&illegal,
+        &&cmpeq, &&cmplt, &&cmple, &&illegal,
+        &&and_, &&or_, &&xor_, &&xnor,
+        &&shl, &&shr, &&sra, &&illegal,
+        &&addc, &&subc, &&illegal, &&illegal,
+        &&cmpeqc, &&cmpltc, &&cmplec, &&illegal,
+        &&andc, &&orc, &&xorc, &&xnorc,
+        &&shlc, &&shrc, &&srac, &&illegal
+    };
+
+    uint64_t count = instructions_;
+    uint32_t* r = regs_;
+    uint32_t pc = pc_;
+    stop_reason reason = LIMIT;
+    uint8_t* marks = cache_.marks();
+    bool shared = &code_ == &data_;
+    uint32_t written;
+    decode_cache::instruction* d;
+
+#define DISPATCH() \
+    do { \
+        if (count == limit) { \
+            goto done; \
+        } \
+        uint32_t index = code_.word_index(pc); \
+        decode_cache::instruction* page = cache_.find_page(index); \
+        if (page == NULL) { \
+            page = cache_.make_page(index, &&decode); \
+        } \
+        d = &page[index & OFFSET_MASK]; \
+        count++; \
+        goto *d->handler_; \
+    } while (0)
+
+#define A r[d->ra_]
+#define B r[d->rb_]
+#define C ((uint32_t)d->literal_)
+#define EXECUTE(value) \
+    do { \
+        r[d->rc_] = (value); \
+        pc = beta::next_pc(pc); \
+        DISPATCH(); \
+    } while (0)
+
+    DISPATCH();
+
+decode:
+    {
+        uint32_t ir = code_.read(pc);
+        int op = beta::opcode(ir);
+        d->literal_ = beta::literal(ir);
+        d->ra_ = beta::ra(ir);
+        d->rb_ = beta::rb(ir);
+        d->rc_ = beta::rc(ir);
+        if (d->rc_ == beta::R31 && op != beta::ST) {
+            d->rc_ = SPARE;
+        }
+        d->handler_ = ir == beta::INST_HALT ? &&halt : handlers[op];
+        marks[code_.word_index(pc)] |= decode_cache::DECODED;
+        goto *d->handler_;
+    }
+
+add: EXECUTE(A + B);
+sub: EXECUTE(A - B);
+cmpeq: EXECUTE(A == B);
+cmplt: EXECUTE((int32_t)A < (int32_t)B);
+cmple: EXECUTE((int32_t)A <= (int32_t)B);
+and_: EXECUTE(A & B);
+or_: EXECUTE(A | B);
+xor_: EXECUTE(A ^ B);
+xnor: EXECUTE(~(A ^ B));
+shl: EXECUTE(A << (B & 0x1F));
+shr: EXECUTE(A >> (B & 0x1F));
+sra: EXECUTE((int32_t)A >> (B & 0x1F));
+addc: EXECUTE(A + C);
+subc: EXECUTE(A - C);
+cmpeqc: EXECUTE(A == C);
+cmpltc: EXECUTE((int32_t)A < (int32_t)C);
+cmplec: EXECUTE((int32_t)A <= (int32_t)C);
+andc: EXECUTE(A & C);
+orc: EXECUTE(A | C);
+xorc: EXECUTE(A ^ C);
+xnorc: EXECUTE(~(A ^ C));
+shlc: EXECUTE(A << (C & 0x1F));
+shrc: EXECUTE(A >> (C & 0x1F));
+srac: EXECUTE((int32_t)A >> (C & 0x1F));
+ld: EXECUTE(data_.read(A + C));
+ldr: EXECUTE(data_.read(beta::branch_target(beta::next_pc(pc), C)));
+
+st:
+    {
+        uint32_t address = A + C;
+        data_.write(address, r[d->rc_]);
+        uint32_t index = data_.word_index(address);
+        pc = beta::next_pc(pc);
+        if (shared && marks[index] != 0) {
+            if (marks[index] & decode_cache::TRANSLATED) {
+                jit_->flush();
+            }
+            written = index;
+            goto forget;
+        }
+        DISPATCH();
+    }
+
+    //
+    // Code at word index written was changed.
+    //
+forget:
+    {
+        decode_cache::instruction* page = cache_.find_page(written);
+        if (page != NULL) {
+            page[written & OFFSET_MASK].handler_ = &&decode;
+        }
+        marks[written] = 0;
+        DISPATCH();
+    }
+
+jmp:
+    {
+        uint32_t next = beta::jump_target(pc, A);
+        r[d->rc_] = beta::next_pc(pc);
+        if (next == pc && beta::jump_target(pc, A) == pc) {
+            reason = LOOPING;
+            goto done;
+        }
+        pc = next;
+        goto block;
+    }
+
+beq:
+    {
+        uint32_t next = beta::next_pc(pc);
+        if (A == 0) {
+            next = beta::branch_target(next, C);
+        }
+        r[d->rc_] = beta::next_pc(pc);
+        if (next == pc && A == 0) {
+            reason = LOOPING;
+            goto done;
+        }
+        pc = next;
+        goto block;
+    }
+
+bne:
+    {
+        uint32_t next = beta::next_pc(pc);
+        if (A != 0) {
+            next = beta::branch_target(next, C);
+        }
+        r[d->rc_] = beta::next_pc(pc);
+        if (next == pc && A != 0) {
+            reason = LOOPING;
+            goto done;
+        }
+        pc = next;
+        goto block;
+    }
+
+illegal:
+    r[beta::XP] = beta::next_pc(pc);
+    traps_++;
+    if (illop_ == pc) {
+        reason = LOOPING;
+        goto done;
+    }
+    pc = illop_;
+
+block:
+    if (jit_ != NULL && jit_->run(pc, r, count, limit, written)) {
+        goto forget;
+    }
+    DISPATCH();
+
+halt:
+    count--;
+    reason = HALTED;
+
+done:
+#undef EXECUTE
+#undef C
+#undef B
+#undef A
+#undef DISPATCH
+    pc_ = pc;
+    instructions_ = count;
+    return reason;
+}
\ No newline at end of file
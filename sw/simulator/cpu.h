@@ -0,0 +1,163 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "beta.h"
+#include "memory.h"
+#include "decode_cache.h"
+#include "jit.h"
+#include "trace.h"
+
+using std::string;
+using std::unique_ptr;
+
+//
+// Functional model of the Beta: each instruction is executed completely
+// before the next one, with no pipeline. The architectural results match
+// the RTL, R31 reads as zero and ignores writes, and an illegal opcode
+// saves PC + 4 in XP and continues at the illegal instruction vector.
+//
+// The simulation stops at HALT() or when the program settles into a
+// branch or jump to itself that will be taken forever, such as the
+// BR(.) that ends the tests in testbench/testcases.txt.
+//
+// Instructions are normally decoded once into a decode_cache and run with
+// threaded code, each handler jumping straight to the next one. A store
+// into a decoded instruction has it decoded again. The plain switch over
+// the opcode is kept as a reference and to compare against. With the jit,
+// blocks that run often are translated to native code; the threaded code
+// runs the rest.
+//
+// Instructions can be fetched from a memory of their own, as in
+// testbench/core_tb.v. Where memory ends, addresses normally wrap around;
+// with wrapping off, an access past the end stops the program instead. A
+// read from a page nothing was loaded into or stored to can stop it too.
+//
+class cpu {
+public:
+    enum stop_reason { HALTED, LOOPING, LIMIT, FAULT };
+    enum dispatch_mode { SWITCH, THREADED, JIT };
+
+    //
+    // The architectural state outside memory, as a checkpoint keeps it.
+    //
+    struct state {
+        uint32_t pc_;
+        uint32_t regs_[32];
+        uint64_t instructions_;
+        uint64_t traps_;
+    };
+
+    //
+    // illop is the illegal instruction vector. rtl/defines.v puts it at
+    // PC_ILLOP, programs written for BSIM expect PC_EXCEPT.
+    //
+    cpu(memory& m, uint32_t illop = beta::PC_ILLOP);
+
+    //
+    // Fetches from one memory and loads and stores to the other, like the
+    // i_mem and d_mem of testbench/core_tb.v. Both are the same size.
+    //
+    cpu(memory& instructions, memory& data, uint32_t illop = beta::PC_ILLOP);
+
+    //
+    // Clears the registers and starts again from PC_RESET. Memory is left
+    // alone.
+    //
+    void reset();
+
+    //
+    // Carries on from s, counting on from its instructions and traps.
+    // Memory is expected to have been restored with it, so the decoded and
+    // translated instructions are dropped.
+    //
+    void restore_state(const state& s);
+
+    state save_state() const;
+
+    //
+    // Fails if the jit can't run on this host, leaving the mode as it was.
+    //
+    bool set_dispatch(dispatch_mode mode, string& error_out);
+
+    //
+    // Drops the decoded and translated instructions. Needed when memory is
+    // changed other than by the program running.
+    //
+    void invalidate();
+
+    //
+    // Writes every register write and store to trace, or stops if trace is
+    // NULL. Tracing runs the plain switch, whatever the dispatch mode.
+    //
+    void set_trace(trace_writer* trace) { trace_ = trace; }
+
+    //
+    // With wrap false, fetching, loading or storing past the end of memory
+    // stops the run with FAULT before the instruction does anything, and
+    // pc() is left at it. Checking runs the plain switch, like tracing.
+    //
+    void set_wrap(bool wrap) { wrap_ = wrap; }
+
+    //
+    // With trap_unmapped true, fetching or loading from a page of memory
+    // that isn't mapped stops the run with FAULT the same way. A store maps
+    // the page it writes, so the stack and other space the image leaves
+    // out can be used once written.
+    //
+    void set_trap_unmapped(bool trap_unmapped)
+    {
+        trap_unmapped_ = trap_unmapped;
+    }
+
+    //
+    // The jit, or NULL if it isn't used.
+    //
+    const jit* translator() const { return jit_.get(); }
+
+    //
+    // Runs until the program stops or max_instructions more have been
+    // executed, 0 meaning no limit.
+    //
+    stop_reason run(uint64_t max_instructions);
+
+    uint32_t pc() const { return pc_; }
+    uint32_t reg(int index) const { return regs_[index]; }
+    uint64_t instructions() const { return instructions_; }
+    uint64_t traps() const { return traps_; }
+
+    //
+    // The address that stopped the last run with FAULT.
+    //
+    uint32_t fault_address() const { return fault_address_; }
+
+private:
+    //
+    // Where instructions that write R31 write instead.
+    //
+    static const int SPARE = 32;
+
+    stop_reason run_switch(uint64_t limit);
+    stop_reason run_threaded(uint64_t limit);
+
+    memory& code_;
+    memory& data_;
+    uint32_t illop_;
+    dispatch_mode dispatch_ = THREADED;
+    decode_cache cache_;
+    unique_ptr<jit> jit_;
+    trace_writer* trace_ = NULL;
+    bool wrap_ = true;
+    bool trap_unmapped_ = false;
+
+    uint32_t pc_;
+    uint32_t regs_[SPARE + 1];
+    uint64_t instructions_;
+    uint64_t traps_;
+    uint32_t fault_address_ = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "memory.h"
+#include "decode_cache.h"
+
+decode_cache::decode_cache(
+    const memory& m) :
+        pages_((m.size() / 4 + PAGE_WORDS - 1) / PAGE_WORDS),
+        num_marks_(m.size() / 4)
+{
+    //
+    // Reserved rather than allocated, like memory. Failing here is no
+    // different from new running out of memory.
+    //
+    void* p = mmap(NULL, num_marks_, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    marks_ = (uint8_t*)p;
+}
+
+decode_cache::~decode_cache()
+{
+    munmap(marks_, num_marks_);
+}
+
+decode_cache::instruction* decode_cache::make_page(
+    uint32_t index,
+    const void* handler)
+{
+    unique_ptr<instruction[]>& page = pages_[index >> PAGE_BITS];
+    if (page == NULL) {
+        made_.push_back(index >> PAGE_BITS);
+    }
+    page.reset(new instruction[PAGE_WORDS]);
+    for (uint32_t i = 0; i < PAGE_WORDS; ++i) {
+        page[i].handler_ = handler;
+    }
+    return page.get();
+}
+
+void decode_cache::clear()
+{
+    for (auto page : made_) {
+        pages_[page].reset();
+    }
+    made_.clear();
+    madvise(marks_, num_marks_, MADV_DONTNEED);
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "memory.h"
+
+using std::unique_ptr;
+using std::vector;
+
+//
+// Instructions of the simulated program decoded once, the way decode.v
+// splits up ir, and kept by word index for the threaded interpreter in
+// cpu.cpp. Pages of decoded instructions are made when the program first
+// runs code in them; memory that is only read or written as data takes no
+// room here.
+//
+// Each word also has a mark saying whether it was decoded or translated
+// by the jit, so that a store can cheaply tell whether it changed code.
+//
+class decode_cache {
+public:
+    //
+    // handler_ is the code that executes the instruction, or the code that
+    // decodes it if that hasn't happened yet. The literal is sign-extended.
+    // rc_ is 32 rather than 31 for instructions that write R31, so they
+    // can write a spare register instead of testing for it.
+    //
+    struct instruction {
+        const void* handler_;
+        int32_t literal_;
+        uint8_t ra_;
+        uint8_t rb_;
+        uint8_t rc_;
+    };
+
+    static const int PAGE_BITS = 10;
+    static const uint32_t PAGE_WORDS = 1u << PAGE_BITS;
+
+    //
+    // Bits of the mark of a word.
+    //
+    static const uint8_t DECODED = 1;
+    static const uint8_t TRANSLATED = 2;
+
+    decode_cache(const memory& m);
+    decode_cache(const decode_cache&) = delete;
+    decode_cache& operator=(const decode_cache&) = delete;
+    ~decode_cache();
+
+    //
+    // The decoded instructions of the page holding word index, or NULL if
+    // the page hasn't been made yet.
+    //
+    instruction* find_page(uint32_t index) const
+    {
+        return pages_[index >> PAGE_BITS].get();
+    }
+
+    //
+    // Makes the page holding word index, with every instruction set to
+    // handler.
+    //
+    instruction* make_page(uint32_t index, const void* handler);
+
+    //
+    // One mark per word of memory, by word index.
+    //
+    uint8_t* marks() const { return marks_; }
+
+    //
+    // Forgets every decoded instruction, for when memory is changed other
+    // than by the program's own stores.
+    //
+    void clear();
+
+private:
+    vector<unique_ptr<instruction[]>> pages_;
+
+    //
+    // Which of pages_ have been made, so clearing doesn't have to look at
+    // every page of a large memory.
+    //
+    vector<uint32_t> made_;
+
+    uint8_t* marks_;
+    uint64_t num_marks_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,796 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "beta.h"
+#include "memory.h"
+#include "decode_cache.h"
+#include "jit.h"
+
+using std::string;
+using std::vector;
+
+jit::jit(
+    memory& instructions,
+    memory& data,
+    decode_cache& cache) :
+        instructions_(instructions), data_(data), cache_(cache)
+{
+}
+
+jit::~jit()
+{
+    if (code_ != NULL) {
+        munmap(code_, code_size_);
+    }
+}
+
+#if defined(__x86_64__)
+
+//
+// Size of the buffer translated code goes into, and the most one block can
+// take. The buffer is flushed when less than that is left.
+//
+static const size_t CODE_SIZE = 32 << 20;
+static const size_t MAX_BLOCK_SIZE = 64 << 10;
+
+static const int MAX_BLOCK_INSTRUCTIONS = 128;
+
+enum host_register {
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+//
+// Host registers Beta registers are kept in. RAX, RCX and RDX are scratch,
+// R12 points to the jit::state, R14 to memory and R15 to the registers.
+//
+static const int CACHE_REGISTERS[] = {
+    RBX, RBP, RSI, RDI, R8, R9, R10, R11, R13
+};
+static const int NUM_CACHE_REGISTERS =
+        sizeof(CACHE_REGISTERS) / sizeof(CACHE_REGISTERS[0]);
+
+enum condition { CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_L = 0xC,
+        CC_LE = 0xE };
+
+//
+// Writes the few x86-64 instruction forms the translation needs. Register
+// operands are host_register numbers, and only 32-bit operations are used
+// on Beta values.
+//
+class emitter {
+public:
+    emitter(uint8_t* p) : p_(p) {}
+
+    uint8_t* here() const { return p_; }
+
+    void byte(uint8_t b) { *p_++ = b; }
+    void dword(uint32_t d) { memcpy(p_, &d, 4); p_ += 4; }
+
+    //
+    // op with reg and the register rm.
+    //
+    void op_reg(uint8_t op, int reg, int rm, bool wide = false)
+    {
+        rex(wide, reg, 0, rm);
+        byte(op);
+        byte(0xC0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    //
+    // op with reg and [base + disp].
+    //
+    void op_mem(uint8_t op, int reg, int base, int32_t disp,
+            bool wide = false)
+    {
+        bool short_disp = disp >= -128 && disp < 128;
+        rex(wide, reg, 0, base);
+        byte(op);
+        byte((short_disp ? 0x40 : 0x80) | (reg & 7) << 3 | (base & 7));
+        if ((base & 7) == RSP) {
+            byte(0x24);
+        }
+        if (short_disp) {
+            byte((uint8_t)disp);
+        } else {
+            dword(disp);
+        }
+    }
+
+    //
+    // op with reg and [base + index << scale]. base can't be RBP or R13.
+    //
+    void op_index(uint8_t op, int reg, int base, int index, int scale)
+    {
+        rex(false, reg, index, base);
+        byte(op);
+        byte(0x04 | (reg & 7) << 3);
+        byte(scale << 6 | (index & 7) << 3 | (base & 7));
+    }
+
+    //
+    // Group 1 operation, ADD, OR, AND, SUB, XOR or CMP by digit, of rm and
+    // imm.
+    //
+    void op_imm(int digit, int rm, uint32_t imm, bool wide = false)
+    {
+        rex(wide, 0, 0, rm);
+        byte(0x81);
+        byte(0xC0 | digit << 3 | (rm & 7));
+        dword(imm);
+    }
+
+    void shift_imm(int digit, int rm, int count)
+    {
+        rex(false, 0, 0, rm);
+        byte(0xC1);
+        byte(0xC0 | digit << 3 | (rm & 7));
+        byte(count);
+    }
+
+    void mov_imm(int reg, uint32_t imm)
+    {
+        rex(false, 0, 0, reg);
+        byte(0xB8 + (reg & 7));
+        dword(imm);
+    }
+
+    //
+    // eax = cc ? 1 : 0, after a compare.
+    //
+    void set_eax(condition cc)
+    {
+        byte(0x0F);
+        byte(0x90 | cc);
+        byte(0xC0);
+        byte(0x0F);
+        byte(0xB6);
+        byte(0xC0);
+    }
+
+    //
+    // Jumps whose target is patched in later. Return the place to patch.
+    //
+    uint8_t* jcc(condition cc)
+    {
+        byte(0x0F);
+        byte(0x80 | cc);
+        dword(0);
+        return p_ - 4;
+    }
+
+    uint8_t* jmp()
+    {
+        byte(0xE9);
+        dword(0);
+        return p_ - 4;
+    }
+
+    static void patch(uint8_t* site, const uint8_t* target)
+    {
+        int32_t offset = (int32_t)(target - (site + 4));
+        memcpy(site, &offset, 4);
+    }
+
+private:
+    void rex(bool wide, int reg, int index, int base)
+    {
+        if (wide || reg >= R8 || index >= R8 || base >= R8) {
+            byte(0x40 | wide << 3 | (reg >> 3) << 2 | (index >> 3) << 1
+                    | (base >> 3));
+        }
+    }
+
+    uint8_t* p_;
+};
+
+//
+// Translates one block. The code starts by checking that the whole block
+// fits in the instruction limit and loading the host registers, and each
+// exit stores back the ones the block writes.
+//
+class translator {
+public:
+    //
+    // A jump out of the block to a known pc, which jit::link() points at
+    // the block there or back to run().
+    //
+    struct exit {
+        uint8_t* site_;
+        uint32_t pc_;
+    };
+
+    translator(
+        uint8_t* code,
+        const uint8_t* leave,
+        const memory& instructions,
+        const memory& data) :
+            e_(code), leave_(leave), instructions_(instructions),
+            data_(data)
+    {
+    }
+
+    //
+    // Returns false if the block would be empty.
+    //
+    bool translate(uint32_t pc, vector<uint32_t>& words_out);
+
+    uint8_t* end() const { return e_.here(); }
+    const vector<exit>& exits() const { return exits_; }
+
+private:
+    //
+    // Code after the block for its less likely exits.
+    //
+    enum stub_kind { LIMIT_STUB, STORE_STUB, JMP_STUB, TAKEN_STUB };
+
+    struct stub {
+        stub_kind kind_;
+        uint8_t* site_;
+        uint32_t pc_;
+        int remaining_;
+    };
+
+    void allocate(const vector<uint32_t>& irs);
+    void load(int reg, int r);
+    void store(int r, int reg);
+    void store_imm(int r, uint32_t value);
+    void write_back();
+    void set_state(size_t offset, uint32_t value);
+    void exit_to(uint32_t pc);
+    void leave();
+
+    void operate(uint32_t ir);
+    void address_index(int reg, int r, int32_t literal);
+    void emit_stubs();
+
+    emitter e_;
+    const uint8_t* leave_;
+    const memory& instructions_;
+    const memory& data_;
+
+    //
+    // Host register of each Beta register, or -1 if it stays in memory.
+    //
+    int host_[32];
+    uint32_t written_;
+
+    vector<stub> stubs_;
+    vector<exit> exits_;
+};
+
+bool translator::translate(
+    uint32_t pc,
+    vector<uint32_t>& words_out)
+{
+    vector<uint32_t> irs;
+    uint32_t address = pc;
+    bool terminated = false;
+    while (!terminated && (int)irs.size() < MAX_BLOCK_INSTRUCTIONS) {
+        uint32_t ir = instructions_.read(address);
+        int op = beta::opcode(ir);
+        if (ir == beta::INST_HALT || !beta::is_legal(op)) {
+            break;
+        }
+        if (op == beta::BEQ || op == beta::BNE) {
+            //
+            // A branch to itself might be the end of the program, which
+            // the interpreter checks for.
+            //
+            uint32_t next = beta::next_pc(address);
+            if (beta::branch_target(next, beta::literal(ir)) == address) {
+                break;
+            }
+            terminated = true;
+        }
+        terminated = terminated || op == beta::JMP;
+        irs.push_back(ir);
+        words_out.push_back(instructions_.word_index(address));
+        if (!terminated) {
+            address = beta::next_pc(address);
+        }
+    }
+    if (irs.empty()) {
+        return false;
+    }
+
+    allocate(irs);
+
+    e_.op_mem(0x8B, RAX, R12, offsetof(jit::state, count_), true);
+    e_.op_imm(0, RAX, irs.size(), true);
+    e_.op_mem(0x3B, RAX, R12, offsetof(jit::state, limit_), true);
+    stubs_.push_back({ LIMIT_STUB, e_.jcc(CC_A), pc, 0 });
+    e_.op_mem(0x89, RAX, R12, offsetof(jit::state, count_), true);
+    for (int r = 0; r < 32; ++r) {
+        if (host_[r] >= 0) {
+            e_.op_mem(0x8B, host_[r], R15, 4 * r);
+        }
+    }
+
+    address = pc;
+    for (size_t i = 0; i < irs.size(); ++i) {
+        uint32_t ir = irs[i];
+        int op = beta::opcode(ir);
+        int ra = beta::ra(ir);
+        int rc = beta::rc(ir);
+        int32_t literal = beta::literal(ir);
+        uint32_t next = beta::next_pc(address);
+
+        switch (op) {
+            case beta::LD:
+                address_index(RAX, ra, literal);
+                e_.op_index(0x8B, RAX, R14, RAX, 2);
+                store(rc, RAX);
+                break;
+
+            case beta::LDR:
+                e_.mov_imm(RAX, data_.word_index(
+                        beta::branch_target(next, literal)));
+                e_.op_index(0x8B, RAX, R14, RAX, 2);
+                store(rc, RAX);
+                break;
+
+            case beta::ST:
+                address_index(RDX, ra, literal);
+                load(RAX, rc);
+                e_.op_index(0x89, RAX, R14, RDX, 2);
+                if (&instructions_ != &data_) {
+                    break;
+                }
+                e_.op_mem(0x8B, RCX, R12, offsetof(jit::state, marks_), true);
+                e_.op_index(0x80, 7, RCX, RDX, 0);
+                e_.byte(0);
+                stubs_.push_back({ STORE_STUB, e_.jcc(CC_NE), next,
+                        (int)(irs.size() - i - 1) });
+                break;
+
+            case beta::BEQ:
+            case beta::BNE:
+                load(RAX, ra);
+                store_imm(rc, next);
+                e_.op_reg(0x85, RAX, RAX);
+                stubs_.push_back({ TAKEN_STUB,
+                        e_.jcc(op == beta::BEQ ? CC_E : CC_NE),
+                        beta::branch_target(next, literal), 0 });
+                exit_to(next);
+                break;
+
+            case beta::JMP:
+                //
+                // A JMP to itself goes back to the interpreter before it
+                // runs, since it might be the end of the program.
+                //
+                load(RAX, ra);
+                e_.op_imm(4, RAX, beta::jump_target(address, 0xFFFFFFFF));
+                e_.op_imm(7, RAX, address);
+                stubs_.push_back({ JMP_STUB, e_.jcc(CC_E), address, 0 });
+                store_imm(rc, next);
+                e_.op_mem(0x89, RAX, R12, offsetof(jit::state, pc_));
+                write_back();
+                leave();
+                break;
+
+            default:
+                operate(ir);
+                break;
+        }
+
+        if (i + 1 == irs.size() && !terminated) {
+            exit_to(next);
+        }
+        address = next;
+    }
+
+    emit_stubs();
+    return true;
+}
+
+//
+// Gives host registers to the Beta registers the block uses most.
+//
+void translator::allocate(
+    const vector<uint32_t>& irs)
+{
+    int uses[32] = {};
+    written_ = 0;
+    for (uint32_t ir : irs) {
+        int op = beta::opcode(ir);
+        uses[beta::ra(ir)]++;
+        uses[beta::rc(ir)]++;
+        if (op >= beta::ADD && op < beta::ADDC) {
+            uses[beta::rb(ir)]++;
+        }
+        if (op != beta::ST) {
+            written_ |= 1u << beta::rc(ir);
+        }
+    }
+    uses[beta::R31] = 0;
+
+    int order[31];
+    for (int r = 0; r < 31; ++r) {
+        order[r] = r;
+    }
+    std::stable_sort(order, order + 31,
+            [&](int a, int b) { return uses[a] > uses[b]; });
+
+    for (int r = 0; r < 32; ++r) {
+        host_[r] = -1;
+    }
+    for (int i = 0; i < NUM_CACHE_REGISTERS && uses[order[i]] > 0; ++i) {
+        host_[order[i]] = CACHE_REGISTERS[i];
+    }
+}
+
+void translator::load(
+    int reg,
+    int r)
+{
+    if (r == beta::R31) {
+        e_.op_reg(0x31, reg, reg);
+    } else if (host_[r] >= 0) {
+        e_.op_reg(0x89, host_[r], reg);
+    } else {
+        e_.op_mem(0x8B, reg, R15, 4 * r);
+    }
+}
+
+void translator::store(
+    int r,
+    int reg)
+{
+    if (r == beta::R31) {
+        return;
+    } else if (host_[r] >= 0) {
+        e_.op_reg(0x89, reg, host_[r]);
+    } else {
+        e_.op_mem(0x89, reg, R15, 4 * r);
+    }
+}
+
+void translator::store_imm(
+    int r,
+    uint32_t value)
+{
+    if (r == beta::R31) {
+        return;
+    } else if (host_[r] >= 0) {
+        e_.mov_imm(host_[r], value);
+    } else {
+        e_.op_mem(0xC7, 0, R15, 4 * r);
+        e_.dword(value);
+    }
+}
+
+void translator::write_back()
+{
+    for (int r = 0; r < 31; ++r) {
+        if (host_[r] >= 0 && (written_ & (1u << r)) != 0) {
+            e_.op_mem(0x89, host_[r], R15, 4 * r);
+        }
+    }
+}
+
+void translator::set_state(
+    size_t offset,
+    uint32_t value)
+{
+    e_.op_mem(0xC7, 0, R12, offset);
+    e_.dword(value);
+}
+
+void translator::exit_to(
+    uint32_t pc)
+{
+    write_back();
+    set_state(offsetof(jit::state, pc_), pc);
+    exits_.push_back({ e_.jmp(), pc });
+}
+
+void translator::leave()
+{
+    emitter::patch(e_.jmp(), leave_);
+}
+
+//
+// Operate instructions, folded to a constant when every operand is.
+//
+void translator::operate(
+    uint32_t ir)
+{
+    int op = beta::opcode(ir);
+    int ra = beta::ra(ir);
+    int rb = beta::rb(ir);
+    int rc = beta::rc(ir);
+    bool has_literal = op >= beta::ADDC;
+    uint32_t literal = has_literal ? beta::literal(ir) : 0;
+
+    if (rc == beta::R31) {
+        return;
+    }
+    if (ra == beta::R31 && (has_literal || rb == beta::R31)) {
+        store_imm(rc, beta::operate(op, 0, literal));
+        return;
+    }
+
+    load(RAX, ra);
+    int base = op & ~0x10;
+    if (has_literal || rb == beta::R31) {
+        switch (base) {
+            case beta::ADD: e_.op_imm(0, RAX, literal); break;
+            case beta::SUB: e_.op_imm(5, RAX, literal); break;
+            case beta::AND: e_.op_imm(4, RAX, literal); break;
+            case beta::OR: e_.op_imm(1, RAX, literal); break;
+            case beta::XOR: e_.op_imm(6, RAX, literal); break;
+            case beta::XNOR: e_.op_imm(6, RAX, ~literal); break;
+            case beta::SHL: e_.shift_imm(4, RAX, literal & 0x1F); break;
+            case beta::SHR: e_.shift_imm(5, RAX, literal & 0x1F); break;
+            case beta::SRA: e_.shift_imm(7, RAX, literal & 0x1F); break;
+            default: e_.op_imm(7, RAX, literal); break;
+        }
+    } else {
+        load(RCX, rb);
+        switch (base) {
+            case beta::ADD: e_.op_reg(0x01, RCX, RAX); break;
+            case beta::SUB: e_.op_reg(0x29, RCX, RAX); break;
+            case beta::AND: e_.op_reg(0x21, RCX, RAX); break;
+            case beta::OR: e_.op_reg(0x09, RCX, RAX); break;
+            case beta::XOR: e_.op_reg(0x31, RCX, RAX); break;
+            case beta::XNOR:
+                e_.op_reg(0x31, RCX, RAX);
+                e_.op_reg(0xF7, 2, RAX);
+                break;
+            case beta::SHL: e_.op_reg(0xD3, 4, RAX); break;
+            case beta::SHR: e_.op_reg(0xD3, 5, RAX); break;
+            case beta::SRA: e_.op_reg(0xD3, 7, RAX); break;
+            default: e_.op_reg(0x39, RCX, RAX); break;
+        }
+    }
+    switch (base) {
+        case beta::CMPEQ: e_.set_eax(CC_E); break;
+        case beta::CMPLT: e_.set_eax(CC_L); break;
+        case beta::CMPLE: e_.set_eax(CC_LE); break;
+    }
+    store(rc, RAX);
+}
+
+//
+// reg = word index of Beta register r + literal.
+//
+void translator::address_index(
+    int reg,
+    int r,
+    int32_t literal)
+{
+    if (r == beta::R31) {
+        e_.mov_imm(reg, data_.word_index(literal));
+        return;
+    }
+    load(reg, r);
+    if (literal != 0) {
+        e_.op_imm(0, reg, literal);
+    }
+    e_.shift_imm(5, reg, 2);
+    e_.op_imm(4, reg, data_.word_mask());
+}
+
+void translator::emit_stubs()
+{
+    for (const stub& s : stubs_) {
+        emitter::patch(s.site_, e_.here());
+        switch (s.kind_) {
+            case LIMIT_STUB:
+                set_state(offsetof(jit::state, pc_), s.pc_);
+                set_state(offsetof(jit::state, exit_), jit::LIMIT);
+                leave();
+                break;
+
+            case STORE_STUB:
+                e_.op_mem(0x89, RDX, R12, offsetof(jit::state, written_));
+                set_state(offsetof(jit::state, exit_), jit::STORE);
+                e_.op_mem(0x81, 5, R12, offsetof(jit::state, count_), true);
+                e_.dword(s.remaining_);
+                write_back();
+                set_state(offsetof(jit::state, pc_), s.pc_);
+                leave();
+                break;
+
+            case JMP_STUB:
+                e_.op_mem(0x81, 5, R12, offsetof(jit::state, count_), true);
+                e_.dword(1);
+                write_back();
+                set_state(offsetof(jit::state, pc_), s.pc_);
+                leave();
+                break;
+
+            case TAKEN_STUB:
+                exit_to(s.pc_);
+                break;
+        }
+    }
+}
+
+//
+// The code buffer starts with the function run() calls, which saves the
+// registers the ABI wants kept, sets up R12, R14 and R15 and jumps to the
+// block, and the code every exit back to run() jumps to, which restores
+// them and returns.
+//
+bool jit::allocate(
+    string& error_out)
+{
+    void* p = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        error_out = "unable to map memory for the jit\n";
+        return false;
+    }
+    code_ = (uint8_t*)p;
+    code_size_ = CODE_SIZE;
+
+    emitter e(code_);
+    static const int SAVED[] = { RBX, RBP, R12, R13, R14, R15 };
+    for (int reg : SAVED) {
+        if (reg >= R8) {
+            e.byte(0x41);
+        }
+        e.byte(0x50 + (reg & 7));
+    }
+    e.op_reg(0x89, RDI, R12, true);
+    e.op_reg(0x89, RSI, R15, true);
+    e.op_reg(0x89, RDX, R14, true);
+    e.op_reg(0xFF, 4, RCX);
+
+    leave_ = e.here();
+    for (int i = 5; i >= 0; --i) {
+        if (SAVED[i] >= R8) {
+            e.byte(0x41);
+        }
+        e.byte(0x58 + (SAVED[i] & 7));
+    }
+    e.byte(0xC3);
+
+    enter_ = (entry_function)code_;
+    first_block_ = e.here();
+    free_ = first_block_;
+    return true;
+}
+
+bool jit::run(
+    uint32_t& pc,
+    uint32_t* regs,
+    uint64_t& count,
+    uint64_t limit,
+    uint32_t& written_out)
+{
+    bool stored = false;
+    state_.count_ = count;
+    state_.limit_ = limit;
+    state_.marks_ = cache_.marks();
+
+    for (;;) {
+        block* b = &blocks_[pc];
+        if (b->entry_ == NULL) {
+            if (b->hits_ < 0 || ++b->hits_ < HOT_THRESHOLD) {
+                break;
+            }
+            if ((size_t)(code_ + code_size_ - free_) < MAX_BLOCK_SIZE) {
+                flush();
+                b = &blocks_[pc];
+            }
+            b->entry_ = translate(pc);
+            if (b->entry_ == NULL) {
+                b->hits_ = -1;
+                break;
+            }
+        }
+
+        state_.exit_ = BRANCH;
+        enter_(&state_, regs, data_.words(), b->entry_);
+        pc = state_.pc_;
+        if (state_.exit_ == STORE) {
+            written_out = state_.written_;
+            if (cache_.marks()[written_out] & decode_cache::TRANSLATED) {
+                flush();
+            }
+            stored = true;
+            break;
+        }
+        if (state_.exit_ == LIMIT) {
+            break;
+        }
+    }
+
+    count = state_.count_;
+    return stored;
+}
+
+const uint8_t* jit::translate(
+    uint32_t pc)
+{
+    translator t(free_, leave_, instructions_, data_);
+    size_t num_translated = translated_.size();
+    if (!t.translate(pc, translated_)) {
+        return NULL;
+    }
+
+    uint8_t* marks = cache_.marks();
+    for (size_t i = num_translated; i < translated_.size(); ++i) {
+        marks[translated_[i]] |= decode_cache::TRANSLATED;
+    }
+    for (const translator::exit& x : t.exits()) {
+        link(x.site_, x.pc_);
+    }
+
+    const uint8_t* entry = free_;
+    free_ = t.end();
+    blocks_translated_++;
+
+    auto range = unlinked_.equal_range(pc);
+    for (auto it = range.first; it != range.second; ++it) {
+        emitter::patch(it->second, entry);
+    }
+    unlinked_.erase(pc);
+    return entry;
+}
+
+//
+// Points the jump at site to the block at pc if it has been translated,
+// and back to run() until it is otherwise.
+//
+void jit::link(
+    uint8_t* site,
+    uint32_t pc)
+{
+    auto it = blocks_.find(pc);
+    if (it != blocks_.end() && it->second.entry_ != NULL) {
+        emitter::patch(site, it->second.entry_);
+    } else {
+        emitter::patch(site, leave_);
+        unlinked_.emplace(pc, site);
+    }
+}
+
+void jit::flush()
+{
+    uint8_t* marks = cache_.marks();
+    for (uint32_t index : translated_) {
+        marks[index] &= ~decode_cache::TRANSLATED;
+    }
+    translated_.clear();
+    blocks_.clear();
+    unlinked_.clear();
+    free_ = first_block_;
+    flushes_++;
+}
+
+#else
+
+bool jit::allocate(
+    string& error_out)
+{
+    error_out = "the jit needs an x86-64 host\n";
+    return false;
+}
+
+bool jit::run(
+    uint32_t& pc,
+    uint32_t* regs,
+    uint64_t& count,
+    uint64_t limit,
+    uint32_t& written_out)
+{
+    return false;
+}
+
+void jit::flush()
+{
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,140 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "memory.h"
+#include "decode_cache.h"
+
+using std::string;
+using std::unordered_map;
+using std::unordered_multimap;
+using std::vector;
+
+//
+// Translates basic blocks that run often into x86-64 code. A block starts
+// where a branch, JMP or trap continued and ends at the next BEQ, BNE or
+// JMP. The interpreter in cpu.cpp calls run() at the start of each block;
+// once a block has been started HOT_THRESHOLD times it is translated, and
+// from then on it runs as native code.
+//
+// The Beta registers a block uses most are kept in host registers while it
+// runs and R31 is folded into a constant zero. A block whose exit goes to
+// another translated block jumps straight to it. Only JMP, whose target
+// isn't known, and the exits back to the interpreter go through run().
+//
+// Every translated word is marked in the decode_cache. A store to a marked
+// word leaves the native code, and if the word was translated all
+// translated code is thrown away. The same happens when the code buffer is
+// full. Where instructions have a memory of their own, stores don't look
+// at the marks.
+//
+class jit {
+public:
+    static const int HOT_THRESHOLD = 16;
+
+    //
+    // Translates code from instructions, which loads and stores to data
+    // leave alone unless it is the same memory.
+    //
+    jit(memory& instructions, memory& data, decode_cache& cache);
+    jit(const jit&) = delete;
+    jit& operator=(const jit&) = delete;
+    ~jit();
+
+    //
+    // Maps the code buffer. Fails on hosts other than x86-64 or where
+    // memory can't be made writable and executable.
+    //
+    bool allocate(string& error_out);
+
+    //
+    // Runs translated code from pc, a block start, for as long as it leads
+    // to more translated blocks and count stays within limit. Updates pc,
+    // regs and count. Returns true if the code stopped after storing to a
+    // word marked in the decode_cache, with the word index in written_out;
+    // the caller has to drop its decoded instruction.
+    //
+    bool run(
+        uint32_t& pc,
+        uint32_t* regs,
+        uint64_t& count,
+        uint64_t limit,
+        uint32_t& written_out);
+
+    //
+    // Throws away all translated code.
+    //
+    void flush();
+
+    uint64_t blocks_translated() const { return blocks_translated_; }
+    uint64_t flushes() const { return flushes_; }
+
+    //
+    // What the generated code shares with run(). The offsets of the members
+    // are built into the code.
+    //
+    struct state {
+        uint64_t count_;
+        uint64_t limit_;
+        const uint8_t* marks_;
+        uint32_t pc_;
+        uint32_t written_;
+        uint32_t exit_;
+    };
+
+    enum exit_reason { BRANCH, LIMIT, STORE };
+
+private:
+    //
+    // A block start the interpreter has reached. hits_ is -1 if the block
+    // can't be translated.
+    //
+    struct block {
+        const uint8_t* entry_ = NULL;
+        int hits_ = 0;
+    };
+
+    typedef void (*entry_function)(
+        state* s,
+        uint32_t* regs,
+        uint32_t* words,
+        const uint8_t* entry);
+
+    const uint8_t* translate(uint32_t pc);
+    void link(uint8_t* site, uint32_t pc);
+
+    memory& instructions_;
+    memory& data_;
+    decode_cache& cache_;
+    state state_;
+
+    uint8_t* code_ = NULL;
+    size_t code_size_ = 0;
+    uint8_t* first_block_ = NULL;
+    uint8_t* free_ = NULL;
+    entry_function enter_ = NULL;
+    const uint8_t* leave_ = NULL;
+
+    unordered_map<uint32_t, block> blocks_;
+
+    //
+    // Jumps to blocks that weren't translated yet, by the pc they go to.
+    // They go back to run() until the block is translated.
+    //
+    unordered_multimap<uint32_t, uint8_t*> unlinked_;
+
+    //
+    // Word index of every translated instruction, to clear their marks.
+    //
+    vector<uint32_t> translated_;
+
+    uint64_t blocks_translated_ = 0;
+    uint64_t flushes_ = 0;
+};
+
+#endif
\ No newline at end of file
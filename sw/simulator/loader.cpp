@@ -0,0 +1,204 @@
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+#include "../assembler/mapped_file.h"
+#include "../assembler/segment_file.h"
+#include "memory.h"
+#include "loader.h"
+
+using std::string;
+using std::string_view;
+
+bool loader::parse_format(
+    const string& name,
+    image_format& format_out)
+{
+    if (name == "bin") {
+        format_out = BINARY;
+    } else if (name == "hex") {
+        format_out = HEX;
+    } else if (name == "testcase") {
+        format_out = TESTCASE;
+    } else if (name == "seg") {
+        format_out = SEGMENTS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool loader::format_of(
+    const string& filename,
+    image_format& format_out)
+{
+    size_t dot = filename.rfind('.');
+    if (dot == string::npos) {
+        return false;
+    }
+    string extension = filename.substr(dot + 1);
+    return parse_format(extension == "tc" ? "testcase" : extension,
+            format_out);
+}
+
+bool loader::load(
+    const string& filename,
+    image_format format,
+    memory& m,
+    string& error_out)
+{
+    if (format == SEGMENTS) {
+        return load_segments(filename, m, error_out);
+    }
+
+    mapped_file file;
+    if (!file.open(filename)) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+
+    bool loaded;
+    switch (format) {
+        case BINARY: loaded = load_binary(file.text(), m); break;
+        case HEX: loaded = load_hex(file.text(), m); break;
+        default: loaded = load_testcase(file.text(), m); break;
+    }
+    if (!loaded) {
+        error_out = filename + " is not a valid image or does not fit in "
+                "memory\n";
+    }
+    return loaded;
+}
+
+bool loader::load_binary(
+    string_view data,
+    memory& m)
+{
+    if (data.size() > m.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < data.size(); ++i) {
+        m.write_byte(i, data[i]);
+    }
+    m.map_pages(0, data.size());
+    return true;
+}
+
+string_view loader::next_word(
+    string_view text,
+    size_t& offset)
+{
+    while (offset < text.size()) {
+        if (isspace((unsigned char)text[offset])) {
+            offset++;
+        } else if (text.substr(offset, 2) == "//") {
+            while (offset < text.size() && text[offset] != '\n') {
+                offset++;
+            }
+        } else {
+            break;
+        }
+    }
+    size_t start = offset;
+    while (offset < text.size() && !isspace((unsigned char)text[offset])) {
+        offset++;
+    }
+    return text.substr(start, offset - start);
+}
+
+bool loader::parse_number(
+    string_view word,
+    int base,
+    uint64_t& value_out)
+{
+    string s(word);
+    char* end;
+    value_out = strtoull(s.c_str(), &end, base);
+    return !s.empty() && *end == 0;
+}
+
+//
+// $readmemh format: one word per entry, "@N" moves to word N.
+//
+bool loader::load_hex(
+    string_view text,
+    memory& m)
+{
+    uint64_t index = 0;
+    size_t offset = 0;
+    for (string_view word = next_word(text, offset); !word.empty();
+            word = next_word(text, offset)) {
+        uint64_t value;
+        if (word[0] == '@') {
+            if (!parse_number(word.substr(1), 16, index)) {
+                return false;
+            }
+            continue;
+        }
+        if (!parse_number(word, 16, value) || value > 0xFFFFFFFF
+                || index >= m.size() / 4) {
+            return false;
+        }
+        m.map_page(index * 4);
+        m.write(index++ * 4, value);
+    }
+    return true;
+}
+
+//
+// A NUM_INST/INST block as found in testbench/testcases.txt.
+//
+bool loader::load_testcase(
+    string_view text,
+    memory& m)
+{
+    size_t offset = 0;
+    uint64_t num_words;
+    if (next_word(text, offset) != "NUM_INST"
+            || !parse_number(next_word(text, offset), 10, num_words)
+            || next_word(text, offset) != "INST"
+            || num_words > m.size() / 4) {
+        return false;
+    }
+    for (uint64_t i = 0; i < num_words; ++i) {
+        uint64_t value;
+        if (!parse_number(next_word(text, offset), 16, value)
+                || value > 0xFFFFFFFF) {
+            return false;
+        }
+        m.map_page(i * 4);
+        m.write(i * 4, value);
+    }
+    return true;
+}
+
+//
+// Zero fills are skipped, memory is already clear, but their pages are
+// mapped like the rest.
+//
+bool loader::load_segments(
+    const string& filename,
+    memory& m,
+    string& error_out)
+{
+    segment_file file;
+    if (!file.open(filename, error_out)) {
+        return false;
+    }
+    if (file.size() > m.size()) {
+        error_out = filename + " does not fit in memory\n";
+        return false;
+    }
+    for (auto const& s : file.segments()) {
+        m.map_pages(s.address_, s.length_);
+        if (s.data_ == NULL) {
+            continue;
+        }
+        for (uint32_t i = 0; i < s.length_; ++i) {
+            m.write_byte(s.address_ + i, s.data_[i]);
+        }
+    }
+    return true;
+}
\ No newline at end of file
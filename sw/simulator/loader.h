@@ -0,0 +1,53 @@
+#ifndef LOADER_H
+#define LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "memory.h"
+
+using std::string;
+using std::string_view;
+
+//
+// Loads an image written by the assembler into memory, starting from
+// address 0. Memory should be clear, only assembled bytes are written.
+//
+class loader {
+public:
+    enum image_format { BINARY, HEX, TESTCASE, SEGMENTS };
+
+    static bool parse_format(const string& name, image_format& format_out);
+
+    //
+    // Format given by the extension the assembler uses, such as ".seg".
+    //
+    static bool format_of(const string& filename, image_format& format_out);
+
+    static bool load(
+        const string& filename,
+        image_format format,
+        memory& m,
+        string& error_out);
+
+    //
+    // Reads the next whitespace separated word, skipping // comments, for
+    // the text formats. Returns an empty word at the end of the text.
+    //
+    static string_view next_word(string_view text, size_t& offset);
+
+    static bool parse_number(string_view word, int base, uint64_t& value_out);
+
+private:
+    static bool load_binary(string_view data, memory& m);
+    static bool load_hex(string_view text, memory& m);
+    static bool load_testcase(string_view text, memory& m);
+    static bool load_segments(
+        const string& filename,
+        memory& m,
+        string& error_out);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../assembler/line_map.h"
+#include "../assembler/mapped_file.h"
+#include "beta.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "memory.h"
+#include "loader.h"
+#include "cpu.h"
+#include "pipeline.h"
+#include "predictor.h"
+#include "profile.h"
+#include "regression.h"
+#include "trace.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ofstream;
+using std::string;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+
+void usage();
+
+template <typename model>
+void print_state(
+    const model& c,
+    cpu::stop_reason reason,
+    uint64_t memory_size);
+
+void print_cycles(
+    const pipeline::statistics& stats);
+
+void print_caches(
+    const pipeline::statistics& stats,
+    const cache* icache,
+    const cache* dcache,
+    const cache* l2);
+
+void print_prediction(
+    const predictor& p);
+
+int run_tests(
+    const string& filename,
+    int jobs,
+    bool show_stats);
+
+bool write_profile(
+    const profile& counts,
+    const line_map* lines,
+    uint64_t cycles,
+    const string& report_filename,
+    const string& collapsed_filename,
+    string& error_out);
+
+int compare_traces(
+    const string& filename_a,
+    const string& filename_b,
+    int context);
+
+void usage()
+{
+    cout << "usage: simulator [-f bin|hex|testcase|seg] [-m memory_size] "
+            << "[-n max_instructions] [-i illop_address] "
+            << "[-d jit|threaded|switch] [-r repetitions] [--pipeline] "
+            << "[--split] [--no-wrap] [--trap-unmapped] [--trace file] "
+            << "[--checkpoint file] [--profile report] "
+            << "[--collapsed stacks] [-l line_map] "
+            << "[--icache spec] [--dcache spec] [--l2 spec] "
+            << "[--memory-latency cycles] [--predictor scheme] "
+            << "[--btb entries] [--stats] image | --restore file" << endl;
+    cout << "       simulator --tests [-j jobs] [--stats] testcases.txt"
+            << endl;
+    cout << "       simulator --diff [-c context] trace trace" << endl;
+}
+
+template <typename model>
+void print_state(
+    const model& c,
+    cpu::stop_reason reason,
+    uint64_t memory_size)
+{
+    static const char* reasons[] = {
+        "halted", "looping", "stopped", "faulted"
+    };
+    char line[64];
+
+    snprintf(line, sizeof(line), "%s at 0x%08x after ", reasons[reason],
+            c.pc());
+    cout << line << c.instructions() << " instructions, " << c.traps()
+            << " traps" << endl;
+    if (reason == cpu::FAULT) {
+        snprintf(line, sizeof(line), (c.fault_address() & 0x7FFFFFFF)
+                < memory_size ? "0x%08x is in a page that isn't mapped"
+                : "0x%08x is past the end of memory", c.fault_address());
+        cout << line << endl;
+    }
+    for (int i = 0; i < 32; ++i) {
+        snprintf(line, sizeof(line), "R%-2d 0x%08x%s", i, c.reg(i),
+                i % 4 == 3 ? "\n" : "   ");
+        cout << line;
+    }
+}
+
+void print_cycles(
+    const pipeline::statistics& stats)
+{
+    static const char* kinds[] = {
+        "", "pipeline fill", "taken BEQ", "taken BNE", "JMP", "trap",
+        "not taken branch"
+    };
+    char line[64];
+
+    uint64_t run = stats.instructions_ - stats.restored_instructions_;
+    snprintf(line, sizeof(line), "%.3f", (double)stats.cycles_
+            / std::max<uint64_t>(run, 1));
+    cout << stats.cycles_ << " cycles, " << run << " instructions, CPI "
+            << line << endl;
+    cout << "load-use stalls: " << stats.load_stalls_ex_
+            << " with the load in execute, " << stats.load_stalls_mem_
+            << " in mem_access" << endl;
+    cout << "bubbles:";
+    for (int i = pipeline::FILL; i < pipeline::NUM_SLOT_KINDS; ++i) {
+        cout << (i == pipeline::FILL ? " " : ", ") << stats.bubbles_[i]
+                << " " << kinds[i];
+    }
+    cout << endl;
+}
+
+//
+// What the caches cost and how each of them did, the L2 only if there is
+// one.
+//
+void print_caches(
+    const pipeline::statistics& stats,
+    const cache* icache,
+    const cache* dcache,
+    const cache* l2)
+{
+    char line[128];
+    uint64_t instructions = std::max<uint64_t>(stats.instructions_
+            - stats.restored_instructions_, 1);
+    uint64_t stalls = stats.fetch_stalls_ + stats.data_stalls_;
+    snprintf(line, sizeof(line), "%.3f", (double)(stats.cycles_ - stalls)
+            / instructions);
+    cout << "cache stalls: " << stats.fetch_stalls_ << " fetching, "
+            << stats.data_stalls_ << " in mem_access, CPI " << line
+            << " without them" << endl;
+
+    auto percent = [&](uint64_t part, uint64_t whole) {
+        snprintf(line, sizeof(line), "%.2f%%",
+                whole == 0 ? 0.0 : 100.0 * part / whole);
+        return string(line);
+    };
+    const char* names[] = { "I$", "D$", "L2" };
+    const cache* caches[] = { icache, dcache, l2 };
+    for (int i = 0; i < 3; ++i) {
+        if (caches[i] == NULL) {
+            continue;
+        }
+        const cache::statistics& s = caches[i]->stats();
+        cout << names[i] << " " << caches[i]->describe() << ": " << s.reads_
+                << " reads, " << s.read_misses_ << " missed ("
+                << percent(s.read_misses_, s.reads_) << ")";
+        if (s.writes_ != 0) {
+            cout << ", " << s.writes_ << " writes, " << s.write_misses_
+                    << " missed (" << percent(s.write_misses_, s.writes_)
+                    << ")";
+        }
+        if (s.write_backs_ != 0) {
+            cout << ", " << s.write_backs_ << " lines written back";
+        }
+        cout << endl;
+    }
+}
+
+//
+// How often the predictor was right and the bubbles that made a difference
+// to. A bubble can hide a load-use stall, so avoiding it doesn't always
+// save a cycle.
+//
+void print_prediction(
+    const predictor& p)
+{
+    const predictor::statistics& s = p.stats();
+    char line[128];
+    snprintf(line, sizeof(line), "%.2f%% of %" PRIu64 " branches and "
+            "%.2f%% of %" PRIu64 " JMPs", s.branches_ == 0 ? 0.0
+                    : 100.0 * s.branches_right_ / s.branches_,
+            s.branches_, s.jumps_ == 0 ? 0.0
+                    : 100.0 * s.jumps_right_ / s.jumps_, s.jumps_);
+    cout << "predictor " << p.describe() << ": " << line << " right"
+            << endl;
+    cout << "bubbles avoided: " << s.bubbles_avoided_ << ", added: "
+            << s.bubbles_added_ << ", saving "
+            << (int64_t)(s.bubbles_avoided_ - s.bubbles_added_)
+            << " cycles less the load-use stalls they hid" << endl;
+}
+
+//
+// Runs a file of tests in the format of testbench/testcases.txt on the
+// pipeline model, see regression.h.
+//
+int run_tests(
+    const string& filename,
+    int jobs,
+    bool show_stats)
+{
+    mapped_file file;
+    if (!file.open(filename)) {
+        cout << "unable to open " << filename << endl;
+        return -1;
+    }
+
+    vector<regression::test> tests;
+    vector<regression::result> results;
+    string error;
+    if (!regression::parse(file.text(), tests, error)) {
+        cout << filename << ": " << error;
+        return -1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!regression::run(tests, jobs, results, error)) {
+        cout << error;
+        return -1;
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    int failed = regression::report(tests, results, cout);
+    if (show_stats) {
+        uint64_t cycles = 0;
+        for (auto const& r : results) {
+            cycles += r.cycles_;
+        }
+        double seconds = std::chrono::duration<double>(end - start).count();
+        char line[128];
+        snprintf(line, sizeof(line), "%.3f ms, %.1f million cycles per "
+                "second", seconds * 1e3,
+                seconds > 0 ? cycles / seconds / 1e6 : 0.0);
+        cerr << line << endl;
+    }
+    return failed == 0 ? 0 : -1;
+}
+
+//
+// Writes the report and the collapsed stacks of a profile, each if its
+// file name is given.
+//
+bool write_profile(
+    const profile& counts,
+    const line_map* lines,
+    uint64_t cycles,
+    const string& report_filename,
+    const string& collapsed_filename,
+    string& error_out)
+{
+    if (!report_filename.empty()) {
+        ofstream ofs(report_filename);
+        counts.write_report(ofs, lines, cycles);
+        if (!ofs) {
+            error_out = "unable to write " + report_filename + "\n";
+            return false;
+        }
+    }
+    if (!collapsed_filename.empty()) {
+        ofstream ofs(collapsed_filename);
+        counts.write_collapsed(ofs, lines);
+        if (!ofs) {
+            error_out = "unable to write " + collapsed_filename + "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+int compare_traces(
+    const string& filename_a,
+    const string& filename_b,
+    int context)
+{
+    trace_reader a;
+    trace_reader b;
+    string error;
+    if (!a.open(filename_a, error) || !b.open(filename_b, error)) {
+        cout << error;
+        return -1;
+    }
+    return diff_traces(a, filename_a, b, filename_b, context, cout) ? 0 : -1;
+}
+
+int main(
+    int argc,
+    char *argv[])
+{
+    vector<string> filenames;
+    loader::image_format format;
+    bool have_format = false;
+    uint64_t memory_size = memory::DEFAULT_SIZE;
+    uint64_t max_instructions = 0;
+    uint32_t illop = beta::PC_ILLOP;
+    cpu::dispatch_mode dispatch = cpu::JIT;
+    bool have_dispatch = false;
+    int repetitions = 1;
+    bool show_stats = false;
+    bool use_pipeline = false;
+    bool split = false;
+    bool wrap = true;
+    bool trap_unmapped = false;
+    bool tests = false;
+    int jobs = thread::hardware_concurrency();
+    string trace_filename;
+    string checkpoint_filename;
+    string restore_filename;
+    string profile_filename;
+    string collapsed_filename;
+    string line_map_filename;
+    bool diff = false;
+    int context = 5;
+    cache::config cache_configs[3];
+    bool have_cache[3] = {};
+    uint32_t memory_latency = 20;
+    predictor::scheme scheme = predictor::NONE;
+    int predictor_bits = 10;
+    bool have_predictor = false;
+    uint32_t btb_entries = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "-f" && i + 1 < argc) {
+            if (!loader::parse_format(argv[++i], format)) {
+                cout << "unknown image format " << argv[i] << endl;
+                usage();
+                return -1;
+            }
+            have_format = true;
+        } else if (arg == "-m" && i + 1 < argc) {
+            memory_size = strtoull(argv[++i], NULL, 0);
+        } else if (arg == "-n" && i + 1 < argc) {
+            max_instructions = strtoull(argv[++i], NULL, 0);
+        } else if (arg == "-i" && i + 1 < argc) {
+            illop = strtoul(argv[++i], NULL, 0);
+        } else if (arg == "-d" && i + 1 < argc) {
+            string mode = argv[++i];
+            have_dispatch = true;
+            if (mode == "jit") {
+                dispatch = cpu::JIT;
+            } else if (mode == "threaded") {
+                dispatch = cpu::THREADED;
+            } else if (mode == "switch") {
+                dispatch = cpu::SWITCH;
+            } else {
+                usage();
+                return -1;
+            }
+        } else if (arg == "-r" && i + 1 < argc) {
+            repetitions = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--pipeline") {
+            use_pipeline = true;
+        } else if (arg == "--split") {
+            split = true;
+        } else if (arg == "--no-wrap") {
+            wrap = false;
+        } else if (arg == "--trap-unmapped") {
+            trap_unmapped = true;
+        } else if (arg == "--tests") {
+            tests = true;
+        } else if (arg == "-j" && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpoint_filename = argv[++i];
+        } else if (arg == "--restore" && i + 1 < argc) {
+            restore_filename = argv[++i];
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profile_filename = argv[++i];
+            use_pipeline = true;
+        } else if (arg == "--collapsed" && i + 1 < argc) {
+            collapsed_filename = argv[++i];
+            use_pipeline = true;
+        } else if ((arg == "--icache" || arg == "--dcache" || arg == "--l2")
+                && i + 1 < argc) {
+            int level = arg == "--icache" ? 0 : arg == "--dcache" ? 1 : 2;
+            string error;
+            if (!cache::parse(argv[++i], cache_configs[level], error)) {
+                cout << error;
+                return -1;
+            }
+            have_cache[level] = true;
+            use_pipeline = true;
+        } else if (arg == "--memory-latency" && i + 1 < argc) {
+            memory_latency = strtoul(argv[++i], NULL, 0);
+        } else if (arg == "--predictor" && i + 1 < argc) {
+            string error;
+            if (!predictor::parse(argv[++i], scheme, predictor_bits,
+                    error)) {
+                cout << error;
+                return -1;
+            }
+            have_predictor = true;
+            use_pipeline = true;
+        } else if (arg == "--btb" && i + 1 < argc) {
+            btb_entries = strtoul(argv[++i], NULL, 0);
+            if ((btb_entries & (btb_entries - 1)) != 0
+                    || btb_entries > 1u << 20) {
+                cout << "the BTB entries must be a power of two" << endl;
+                return -1;
+            }
+            have_predictor = true;
+            use_pipeline = true;
+        } else if (arg == "-l" && i + 1 < argc) {
+            line_map_filename = argv[++i];
+        } else if (arg == "--diff") {
+            diff = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            context = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg[0] != '-') {
+            filenames.push_back(arg);
+        } else {
+            usage();
+            return -1;
+        }
+    }
+
+    bool restoring = !restore_filename.empty();
+    if (filenames.size() != (diff ? 2 : restoring ? 0 : 1)
+            || (restoring && (diff || tests))
+            || (split && (restoring || !checkpoint_filename.empty()))
+            || (have_cache[2] && !have_cache[0] && !have_cache[1])) {
+        usage();
+        return -1;
+    }
+    if (diff) {
+        return compare_traces(filenames[0], filenames[1], context);
+    }
+    if (tests) {
+        return run_tests(filenames[0], std::max(1, jobs), show_stats);
+    }
+
+    //
+    // A checkpoint brings its own memory size. With --split the image is
+    // loaded into m, which only instructions are fetched from, and data
+    // memory starts out cleared, as in testbench/core_tb.v.
+    //
+    memory m;
+    memory data;
+    checkpoint saved;
+    string error;
+    if (restoring) {
+        if (!saved.open(restore_filename, error)
+                || !m.allocate(saved.memory_size(), error)) {
+            cout << error;
+            return -1;
+        }
+    } else {
+        const string& filename = filenames[0];
+        if (!have_format && !loader::format_of(filename, format)) {
+            cout << "unable to tell the format of " << filename
+                    << ", use -f" << endl;
+            return -1;
+        }
+        if (!m.allocate(memory_size, error)
+                || (split && !data.allocate(memory_size, error))
+                || !loader::load(filename, format, m, error)) {
+            cout << error;
+            return -1;
+        }
+    }
+
+    trace_writer trace;
+    if (!trace_filename.empty() && !trace.open(trace_filename, error)) {
+        cout << error;
+        return -1;
+    }
+
+    //
+    // With -r the program is run again from reset, for timing programs too
+    // short to time once. Memory keeps what earlier runs stored, and the
+    // trace has every run. With --restore each run starts from the
+    // checkpoint instead, memory included. --checkpoint saves the state the
+    // last run stopped in.
+    //
+    if (use_pipeline) {
+        pipeline p(m, split ? data : m, illop);
+        p.set_wrap(wrap);
+        p.set_trap_unmapped(trap_unmapped);
+
+        //
+        // The L1 caches share the L2, if there is one.
+        //
+        unique_ptr<cache> caches[3];
+        for (int i = 2; i >= 0; --i) {
+            if (have_cache[i]) {
+                caches[i].reset(new cache(cache_configs[i],
+                        i < 2 ? caches[2].get() : NULL, memory_latency));
+            }
+        }
+        p.set_caches(caches[0].get(), caches[1].get());
+        predictor prediction(scheme, predictor_bits, btb_entries);
+        if (have_predictor) {
+            p.set_predictor(&prediction);
+        }
+        if (!trace_filename.empty()) {
+            p.set_trace(&trace);
+        }
+        profile counts(m);
+        bool profiling = !profile_filename.empty()
+                || !collapsed_filename.empty();
+        if (profiling) {
+            p.set_profile(&counts);
+        }
+        line_map lines;
+        if (!line_map_filename.empty()
+                && !lines.load(line_map_filename, error)) {
+            cout << error;
+            return -1;
+        }
+        uint64_t total = 0;
+        cpu::stop_reason reason = cpu::LIMIT;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repetitions; ++i) {
+            if (restoring) {
+                if (!saved.restore(m, error)) {
+                    cout << error;
+                    return -1;
+                }
+                p.restore_state(saved.cpu_state());
+            } else {
+                p.reset();
+            }
+            for (auto& c : caches) {
+                if (c != NULL) {
+                    c->reset();
+                }
+            }
+            prediction.reset();
+            reason = p.run(max_instructions);
+            total += p.stats().cycles_;
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (!trace.close(error)
+                || (!checkpoint_filename.empty()
+                        && !checkpoint::save(checkpoint_filename,
+                                p.save_state(), m, error))
+                || (profiling && !write_profile(counts,
+                        line_map_filename.empty() ? NULL : &lines, total,
+                        profile_filename, collapsed_filename, error))) {
+            cout << error;
+            return -1;
+        }
+
+        print_state(p, reason, m.size());
+        print_cycles(p.stats());
+        if (caches[0] != NULL || caches[1] != NULL) {
+            print_caches(p.stats(), caches[0].get(), caches[1].get(),
+                    caches[2].get());
+        }
+        if (have_predictor) {
+            print_prediction(prediction);
+        }
+        if (show_stats) {
+            double seconds =
+                    std::chrono::duration<double>(end - start).count();
+            char line[128];
+            snprintf(line, sizeof(line), "%.3f ms, %.1f million cycles "
+                    "per second", seconds * 1e3,
+                    seconds > 0 ? total / seconds / 1e6 : 0.0);
+            cerr << line << endl;
+        }
+        return 0;
+    }
+
+    //
+    // The jit falls back to threaded code where it can't run, unless it
+    // was asked for. Tracing, --no-wrap and --trap-unmapped only use the
+    // switch.
+    //
+    if (!trace_filename.empty() || !wrap || trap_unmapped) {
+        dispatch = cpu::SWITCH;
+    }
+    cpu c(m, split ? data : m, illop);
+    c.set_wrap(wrap);
+    c.set_trap_unmapped(trap_unmapped);
+    if (!c.set_dispatch(dispatch, error)) {
+        if (have_dispatch) {
+            cout << error;
+            return -1;
+        }
+        c.set_dispatch(cpu::THREADED, error);
+    }
+    if (!trace_filename.empty()) {
+        c.set_trace(&trace);
+    }
+    uint64_t instructions = 0;
+    cpu::stop_reason reason = cpu::LIMIT;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repetitions; ++i) {
+        if (restoring) {
+            if (!saved.restore(m, error)) {
+                cout << error;
+                return -1;
+            }
+            c.restore_state(saved.cpu_state());
+        } else {
+            c.reset();
+        }
+        reason = c.run(max_instructions);
+        instructions += c.instructions();
+    }
+    auto end = std::chrono::steady_clock::now();
+    if (!trace.close(error)
+            || (!checkpoint_filename.empty()
+                    && !checkpoint::save(checkpoint_filename,
+                            c.save_state(), m, error))) {
+        cout << error;
+        return -1;
+    }
+
+    print_state(c, reason, m.size());
+    if (show_stats) {
+        double seconds = std::chrono::duration<double>(end - start).count();
+        char line[128];
+        snprintf(line, sizeof(line), "%.3f ms, %.1f million instructions "
+                "per second", seconds * 1e3,
+                seconds > 0 ? instructions / seconds / 1e6 : 0.0);
+        cerr << line << endl;
+        if (c.translator() != NULL) {
+            cerr << c.translator()->blocks_translated()
+                    << " blocks translated, " << c.translator()->flushes()
+                    << " flushes" << endl;
+        }
+    }
+    return 0;
+}
\ No newline at end of file
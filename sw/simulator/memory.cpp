@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+#include <sys/mman.h>
+
+#include "memory.h"
+
+using std::string;
+
+memory::~memory()
+{
+    release();
+}
+
+bool memory::allocate(
+    uint64_t size,
+    string& error_out)
+{
+    release();
+    if (size < 4 || size > (1ULL << 32) || (size & (size - 1)) != 0) {
+        error_out = "memory size must be a power of two between 4 bytes "
+                "and 4 GB\n";
+        return false;
+    }
+
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) {
+        error_out = "unable to reserve " + std::to_string(size)
+                + " bytes of memory\n";
+        return false;
+    }
+
+    words_ = (uint32_t*)p;
+    word_mask_ = (uint32_t)(size / 4 - 1);
+    size_ = size;
+    directory_.resize(((size - 1) / PAGE_SIZE >> ENTRY_PAGE_BITS) + 1);
+    return true;
+}
+
+void memory::clear()
+{
+    if (words_ == NULL) {
+        return;
+    }
+    unmap_pages();
+    if (file_mapped_) {
+        mmap(words_, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE
+                | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        file_mapped_ = false;
+    } else {
+        madvise(words_, size_, MADV_DONTNEED);
+    }
+}
+
+bool memory::map_file(
+    uint64_t address,
+    uint64_t length,
+    int fd,
+    uint64_t offset)
+{
+    void* p = mmap((uint8_t*)words_ + address, length,
+            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    file_mapped_ = true;
+    return true;
+}
+
+void memory::map_page(
+    uint32_t address)
+{
+    uint32_t page = word_index(address) >> PAGE_WORD_BITS;
+    unique_ptr<uint64_t[]>& bits = directory_[page >> ENTRY_PAGE_BITS];
+    if (bits == NULL) {
+        bits.reset(new uint64_t[(ENTRY_PAGE_MASK + 1) / 64]());
+    }
+    uint32_t bit = page & ENTRY_PAGE_MASK;
+    bits[bit >> 6] |= 1ULL << (bit & 63);
+}
+
+void memory::map_pages(
+    uint64_t address,
+    uint64_t length)
+{
+    if (length == 0) {
+        return;
+    }
+    uint64_t first = address / PAGE_SIZE;
+    uint64_t last = std::min(address + length - 1, size_ - 1) / PAGE_SIZE;
+    for (uint64_t page = first; page <= last; ++page) {
+        map_page(page * PAGE_SIZE);
+    }
+}
+
+void memory::unmap_pages()
+{
+    for (auto& bits : directory_) {
+        bits.reset();
+    }
+    last_page_ = NO_PAGE;
+}
+
+void memory::write_byte(
+    uint32_t address,
+    uint8_t value)
+{
+    int shift = 8 * (address & 3);
+    uint32_t word = read(address) & ~(0xFFu << shift);
+    write(address, word | ((uint32_t)value << shift));
+}
+
+void memory::release()
+{
+    if (words_ != NULL) {
+        munmap(words_, size_);
+        unmap_pages();
+        directory_.clear();
+        words_ = NULL;
+        word_mask_ = 0;
+        size_ = 0;
+        file_mapped_ = false;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,150 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+//
+// Main memory of the simulated Beta, one array of words shared by
+// instruction fetches, loads and stores, or one of the two when they are
+// kept apart. The size is a power of two and addresses wrap around it, the
+// way testbench/core_tb.v only decodes addr[11:2] of its 4 KB memories.
+// The low two bits of an address are ignored. The array is reserved, not
+// allocated, so only the pages a program touches take memory.
+//
+// Memory also keeps track of which of its 4 KB pages are mapped: those an
+// image or checkpoint was loaded into, and those the program has stored to
+// when the models trap on unmapped pages. The page table has two levels,
+// a directory entry for every 1024 pages and a bitmap for each entry in
+// use, so it too grows with the pages used. The last page found mapped is
+// remembered, which makes looking up most accesses one compare.
+//
+class memory {
+public:
+    //
+    // Large enough that only the supervisor bit of an address is dropped.
+    //
+    static const uint64_t DEFAULT_SIZE = 1ULL << 31;
+
+    memory() = default;
+    memory(const memory&) = delete;
+    memory& operator=(const memory&) = delete;
+    ~memory();
+
+    bool allocate(uint64_t size, string& error_out);
+
+    //
+    // Sets every word back to zero and gives the pages back.
+    //
+    void clear();
+
+    //
+    // Maps length bytes of the file fd from offset over memory at address,
+    // copy on write, so the file isn't changed and only pages written to
+    // are copied. address, length and offset are multiples of the host's
+    // page size.
+    //
+    bool map_file(
+        uint64_t address,
+        uint64_t length,
+        int fd,
+        uint64_t offset);
+
+    //
+    // Index of the word an address refers to.
+    //
+    uint32_t word_index(uint32_t address) const
+    {
+        return (address >> 2) & word_mask_;
+    }
+
+    //
+    // Whether address is inside memory rather than wrapping around to
+    // another word. The supervisor bit is left out, so memory the default
+    // size contains every address.
+    //
+    bool contains(uint32_t address) const
+    {
+        return (address & 0x7FFFFFFF) < size_;
+    }
+
+    uint32_t read(uint32_t address) const
+    {
+        return words_[word_index(address)];
+    }
+
+    void write(uint32_t address, uint32_t value)
+    {
+        words_[word_index(address)] = value;
+    }
+
+    //
+    // Words are little-endian, byte 0 is bits 7:0.
+    //
+    void write_byte(uint32_t address, uint8_t value);
+
+    //
+    // Whether the page holding address is mapped.
+    //
+    bool mapped(uint32_t address) const
+    {
+        uint32_t page = word_index(address) >> PAGE_WORD_BITS;
+        if (page == last_page_) {
+            return true;
+        }
+        const uint64_t* bits = directory_[page >> ENTRY_PAGE_BITS].get();
+        uint32_t bit = page & ENTRY_PAGE_MASK;
+        if (bits == NULL || !((bits[bit >> 6] >> (bit & 63)) & 1)) {
+            return false;
+        }
+        last_page_ = page;
+        return true;
+    }
+
+    void map_page(uint32_t address);
+
+    //
+    // Maps every page from address up to address + length.
+    //
+    void map_pages(uint64_t address, uint64_t length);
+
+    uint64_t size() const { return size_; }
+
+    //
+    // The words themselves, for code generated by the jit.
+    //
+    uint32_t* words() const { return words_; }
+    uint32_t word_mask() const { return word_mask_; }
+
+    static const uint64_t PAGE_SIZE = 4096;
+
+private:
+    static const int PAGE_WORD_BITS = 10;
+    static const int ENTRY_PAGE_BITS = 10;
+    static const uint32_t ENTRY_PAGE_MASK = (1u << ENTRY_PAGE_BITS) - 1;
+    static const uint32_t NO_PAGE = 0xFFFFFFFF;
+
+    void release();
+    void unmap_pages();
+
+    uint32_t* words_ = NULL;
+    uint32_t word_mask_ = 0;
+    uint64_t size_ = 0;
+
+    //
+    // Set once part of memory is mapped from a file, which giving the
+    // pages back wouldn't clear.
+    //
+    bool file_mapped_ = false;
+
+    vector<unique_ptr<uint64_t[]>> directory_;
+    mutable uint32_t last_page_ = NO_PAGE;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,446 @@
+#include <cstdint>
+#include <cstring>
+
+#include "beta.h"
+#include "memory.h"
+#include "cache.h"
+#include "cpu.h"
+#include "predictor.h"
+#include "pipeline.h"
+
+//
+// The opcode bits the stages of the RTL decode. Only bit 5 and bits 2:0
+// tell the instructions apart, so an illegal opcode looks like one of the
+// legal ones; opcode 0 looks like LD.
+//
+static bool is_st(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x27) == 0x01;
+}
+
+static bool is_ld(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x27) == 0x00;
+}
+
+static bool is_jmp(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x27) == 0x03;
+}
+
+static bool is_beq(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x27) == 0x04;
+}
+
+static bool is_bne(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x27) == 0x05;
+}
+
+static bool is_ldr(
+    uint32_t ir)
+{
+    return (ir >> 26 & 0x07) == 0x07;
+}
+
+static bool is_br_or_jmp(
+    uint32_t ir)
+{
+    return is_jmp(ir) || is_beq(ir) || is_bne(ir);
+}
+
+//
+// Register an instruction writes as far as the bypasses are concerned, R31
+// for ST.
+//
+static int rc_0(
+    uint32_t ir)
+{
+    return is_st(ir) ? beta::R31 : beta::rc(ir);
+}
+
+pipeline::pipeline(
+    memory& m,
+    uint32_t illop) :
+        pipeline(m, m, illop)
+{
+}
+
+pipeline::pipeline(
+    memory& instructions,
+    memory& data,
+    uint32_t illop) :
+        instructions_(instructions), data_(data), illop_(illop)
+{
+    reset();
+}
+
+void pipeline::reset()
+{
+    pc_fetch_ = beta::PC_RESET;
+    pc_decode_ = 0;
+    ir_decode_ = beta::INST_NOP;
+    kind_decode_ = FILL;
+    pc_exec_ = 0;
+    ir_exec_ = beta::INST_NOP;
+    a_exec_ = b_exec_ = d_exec_ = 0;
+    pc_mem_ = 0;
+    ir_mem_ = beta::INST_NOP;
+    y_mem_ = d_mem_ = 0;
+    pc_wb_ = 0;
+    ir_wb_ = beta::INST_NOP;
+    y_wb_ = mem_rd_wb_ = 0;
+    memset(regs_, 0, sizeof(regs_));
+    memset(&stats_, 0, sizeof(stats_));
+    looping_ = false;
+    faulted_ = false;
+}
+
+void pipeline::restore_state(
+    const cpu::state& s)
+{
+    reset();
+    pc_fetch_ = s.pc_;
+    memcpy(regs_, s.regs_, sizeof(regs_));
+    regs_[31] = 0;
+    stats_.instructions_ = s.instructions_;
+    stats_.traps_ = s.traps_;
+    stats_.restored_instructions_ = s.instructions_;
+}
+
+cpu::state pipeline::save_state() const
+{
+    cpu::state s;
+    s.pc_ = pc();
+    memcpy(s.regs_, regs_, sizeof(s.regs_));
+    s.instructions_ = stats_.instructions_;
+    s.traps_ = stats_.traps_;
+    return s;
+}
+
+uint32_t pipeline::pc() const
+{
+    return kind_decode_ == INSTRUCTION ? pc_decode_ - 4 : pc_fetch_;
+}
+
+cpu::stop_reason pipeline::run(
+    uint64_t max_instructions,
+    uint64_t max_cycles)
+{
+    uint64_t limit = max_instructions == 0
+            ? UINT64_MAX : stats_.instructions_ + max_instructions;
+    uint64_t cycle_limit = max_cycles == 0
+            ? UINT64_MAX : stats_.cycles_ + max_cycles;
+    cpu::stop_reason reason = cpu::LIMIT;
+
+    //
+    // HALT stops the pipeline while it is in decode, without being passed
+    // on, and so does the instruction after the last one allowed or one
+    // fetched from outside memory or from a page that isn't mapped.
+    //
+    looping_ = false;
+    faulted_ = false;
+    while (stats_.cycles_ < cycle_limit) {
+        if (kind_decode_ == INSTRUCTION) {
+            if ((!wrap_ && !instructions_.contains(pc_decode_ - 4))
+                    || (trap_unmapped_
+                            && !instructions_.mapped(pc_decode_ - 4))) {
+                fault_address_ = pc_decode_ - 4;
+                reason = cpu::FAULT;
+                break;
+            }
+            if (ir_decode_ == beta::INST_HALT) {
+                reason = cpu::HALTED;
+                break;
+            }
+            if (stats_.instructions_ == limit) {
+                break;
+            }
+        }
+        clock(false);
+        if (looping_) {
+            reason = cpu::LOOPING;
+            break;
+        }
+        if (faulted_) {
+            reason = cpu::FAULT;
+            break;
+        }
+    }
+
+    //
+    // Fetch and decode keep what they have, so a later run() carries on
+    // where this one stopped. A load or store past the end of memory can
+    // still reach execute while draining.
+    //
+    for (int i = 0; i < 3; ++i) {
+        if (stats_.cycles_ >= cycle_limit) {
+            return cpu::LIMIT;
+        }
+        clock(true);
+    }
+    return faulted_ ? cpu::FAULT : reason;
+}
+
+void pipeline::clock(
+    bool drain)
+{
+    stats_.cycles_++;
+
+    //
+    // wb: the result an instruction writes comes from the ALU for operate
+    // instructions, from memory for LD and LDR and is PC + 4 for branches
+    // and JMP.
+    //
+    int rc_wb = rc_0(ir_wb_);
+    uint32_t rf_w_data = (ir_wb_ & 0x80000000) ? y_wb_
+            : is_ld(ir_wb_) || is_ldr(ir_wb_) ? mem_rd_wb_ : pc_wb_;
+
+    //
+    // mem_access. The RTL reads memory for every instruction; only what
+    // loads read is ever used, and reading at the results of other
+    // instructions would touch pages of memory all over.
+    //
+    int rc_mem = rc_0(ir_mem_);
+    uint32_t mem_bypass = is_br_or_jmp(ir_mem_) ? pc_mem_ : y_mem_;
+    bool load_mem = is_ld(ir_mem_) || is_ldr(ir_mem_);
+    uint32_t mem_rd = load_mem ? data_.read(y_mem_) : 0;
+
+    //
+    // execute: LD and ST add the literal, LDR passes on the address decode
+    // worked out.
+    //
+    int rc_ex = rc_0(ir_exec_);
+    uint32_t y_exec;
+    if (ir_exec_ & 0x80000000) {
+        y_exec = beta::operate(beta::opcode(ir_exec_), a_exec_, b_exec_);
+    } else if (is_ldr(ir_exec_)) {
+        y_exec = a_exec_;
+    } else {
+        y_exec = a_exec_ + b_exec_;
+    }
+    uint32_t ex_bypass = is_br_or_jmp(ir_exec_) ? pc_exec_ : y_exec;
+    bool load_ex = is_ld(ir_exec_) || is_ldr(ir_exec_);
+    bool fault = (!wrap_ && (load_ex || is_st(ir_exec_))
+            && !data_.contains(y_exec))
+            || (trap_unmapped_ && load_ex && !data_.mapped(y_exec));
+
+    //
+    // decode: operands come from the newest of the later stages that
+    // writes the register, as in operand_mux.v, and a load in execute or
+    // mem_access whose result is needed holds decode and fetch.
+    //
+    uint32_t ir = ir_decode_;
+    int op = beta::opcode(ir);
+    bool op_lit = (op & 0x30) == 0x30;
+    bool op_no_lit = (op & 0x30) == 0x20;
+    int ra1 = beta::ra(ir);
+    int ra2 = is_st(ir) ? beta::rc(ir) : beta::rb(ir);
+    bool trap = kind_decode_ == INSTRUCTION && !beta::is_legal(op);
+
+    auto operand = [&](int r) -> uint32_t {
+        if (r == beta::R31) {
+            return 0;
+        } else if (r == rc_ex) {
+            return ex_bypass;
+        } else if (r == rc_mem) {
+            return mem_bypass;
+        } else if (r == rc_wb) {
+            return rf_w_data;
+        }
+        return regs_[r];
+    };
+
+    bool reads_ra2 = op_no_lit || is_st(ir);
+    bool stall_ex = load_ex
+            && (ra1 == rc_ex || (reads_ra2 && ra2 == rc_ex));
+    bool stall_mem = load_mem
+            && (ra1 == rc_mem || (reads_ra2 && ra2 == rc_mem));
+    bool stall = !drain && !trap && (stall_ex || stall_mem);
+
+    uint32_t rd1 = operand(ra1);
+    uint32_t rd2 = operand(ra2);
+    uint32_t literal = beta::literal(ir);
+    uint32_t br_addr = pc_decode_ + 4 * literal;
+    bool zr = rd1 == 0;
+
+    //
+    // fetch reads the instruction at pc_fetch whether or not it is kept.
+    //
+    uint32_t ir_fetch = instructions_.read(pc_fetch_);
+
+    //
+    // The clock edge. Everything above read the register file and memory
+    // as they were before it.
+    //
+    //
+    // The instruction in wb comes before the one in mem_access, so its
+    // record goes first.
+    //
+    if (rc_wb != beta::R31) {
+        regs_[rc_wb] = rf_w_data;
+        if (trace_ != NULL) {
+            trace_->write_register(pc_wb_ - 4, rc_wb, rf_w_data);
+        }
+    }
+    if (is_st(ir_mem_)) {
+        data_.write(y_mem_, d_mem_);
+        if (trace_ != NULL) {
+            trace_->write_store(pc_mem_ - 4, y_mem_, d_mem_);
+        }
+    }
+    if (dcache_ != NULL && (load_mem || is_st(ir_mem_))) {
+        bool miss;
+        uint32_t wait = dcache_->access(y_mem_, is_st(ir_mem_), miss);
+        stats_.cycles_ += wait;
+        stats_.data_stalls_ += wait;
+        if (profile_ != NULL) {
+            profile::counts& c = profile_->at(pc_mem_ - 4);
+            c.memory_stalls_ += wait;
+            c.misses_ += miss;
+        }
+    }
+
+    pc_wb_ = pc_mem_;
+    ir_wb_ = ir_mem_;
+    y_wb_ = y_mem_;
+    mem_rd_wb_ = mem_rd;
+
+    pc_mem_ = pc_exec_;
+    ir_mem_ = fault ? beta::INST_NOP : ir_exec_;
+    y_mem_ = y_exec;
+    d_mem_ = d_exec_;
+
+    //
+    // A load or store past the end of memory, or a load from a page that
+    // isn't mapped, goes back to decode in place of the instruction there,
+    // and fetch starts again after it. It no longer counts as having left
+    // decode.
+    //
+    if (fault) {
+        faulted_ = true;
+        fault_address_ = y_exec;
+        stats_.instructions_--;
+        if (profile_ != NULL) {
+            profile_->at(pc_exec_ - 4).executed_--;
+        }
+        ir_decode_ = ir_exec_;
+        ir_exec_ = beta::INST_NOP;
+        pc_decode_ = pc_exec_;
+        kind_decode_ = INSTRUCTION;
+        pc_fetch_ = pc_exec_;
+        return;
+    }
+    if (trap_unmapped_ && is_st(ir_mem_)) {
+        data_.map_page(y_mem_);
+    }
+
+    pc_exec_ = pc_decode_;
+    if (drain || stall) {
+        ir_exec_ = beta::INST_NOP;
+        if (stall_ex) {
+            stats_.load_stalls_ex_++;
+        } else if (stall) {
+            stats_.load_stalls_mem_++;
+        }
+        if (stall && profile_ != NULL && kind_decode_ == INSTRUCTION) {
+            profile_->at(pc_decode_ - 4).load_stalls_++;
+        }
+        return;
+    }
+
+    ir_exec_ = trap ? beta::INST_BNE_EXCEPT : ir;
+    a_exec_ = is_ldr(ir) ? br_addr : rd1;
+    b_exec_ = is_ld(ir) || op_lit || is_st(ir) ? literal : rd2;
+    d_exec_ = rd2;
+    if (kind_decode_ == INSTRUCTION) {
+        stats_.instructions_++;
+        if (profile_ != NULL) {
+            profile_->at(pc_decode_ - 4).executed_++;
+        }
+    } else {
+        stats_.bubbles_[kind_decode_]++;
+    }
+
+    //
+    // fetch: if the instruction in decode doesn't go on where fetch went,
+    // which without a predictor is PC + 4, the instruction just fetched is
+    // replaced with a NOP, but it was fetched all the same. Fetch only
+    // looks in the cache when it moves on, as a stalled fetch would wait
+    // rather than read again.
+    //
+    if (icache_ != NULL) {
+        bool miss;
+        uint32_t wait = icache_->access(pc_fetch_, false, miss);
+        stats_.cycles_ += wait;
+        stats_.fetch_stalls_ += wait;
+        if (profile_ != NULL) {
+            profile::counts& c = profile_->at(pc_fetch_);
+            c.memory_stalls_ += wait;
+            c.misses_ += miss;
+        }
+    }
+    uint32_t next = pc_decode_;
+    slot_kind flow = INSTRUCTION;
+    bool settled = true;
+    uint32_t a = beta::rc(ir) == ra1 && ra1 != beta::R31 ? pc_decode_ : rd1;
+    if (trap) {
+        stats_.traps_++;
+        next = illop_;
+        flow = TRAP;
+    } else if (is_jmp(ir)) {
+        next = rd1;
+        flow = JMP;
+        settled = a == pc_decode_ - 4;
+    } else if (is_beq(ir) && zr) {
+        next = br_addr;
+        flow = TAKEN_BEQ;
+        settled = a == 0;
+    } else if (is_bne(ir) && !zr) {
+        next = br_addr;
+        flow = TAKEN_BNE;
+        settled = a != 0;
+    }
+
+    //
+    // A branch, JMP or trap that goes back to itself and will do so again
+    // with the registers it leaves behind, such as the BR(.) at the end of
+    // a test, ends the run.
+    //
+    looping_ = flow != INSTRUCTION && next == pc_decode_ - 4 && settled;
+
+    //
+    // Without a predictor, fetch.v makes a bubble after every taken branch
+    // and JMP, even one that goes on to PC + 4.
+    //
+    slot_kind next_kind = INSTRUCTION;
+    if (kind_decode_ == INSTRUCTION) {
+        if (predictor_ != NULL && !trap) {
+            predictor_->update(pc_decode_ - 4, ir, pc_fetch_, next);
+        }
+        bool wrong = predictor_ != NULL ? trap || next != pc_fetch_
+                : flow != INSTRUCTION;
+        if (wrong) {
+            next_kind = flow != INSTRUCTION ? flow : NOT_TAKEN;
+            if (profile_ != NULL) {
+                profile_->at(pc_decode_ - 4).bubbles_++;
+            }
+        }
+    }
+
+    ir_decode_ = next_kind == INSTRUCTION ? ir_fetch : beta::INST_NOP;
+    pc_decode_ = pc_fetch_ + 4;
+    kind_decode_ = next_kind;
+    if (next_kind != INSTRUCTION) {
+        pc_fetch_ = next;
+    } else {
+        pc_fetch_ = predictor_ != NULL
+                ? predictor_->predict(pc_fetch_, ir_fetch) : pc_fetch_ + 4;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,230 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cstdint>
+
+#include "beta.h"
+#include "memory.h"
+#include "cache.h"
+#include "cpu.h"
+#include "predictor.h"
+#include "trace.h"
+#include "profile.h"
+
+//
+// Cycle by cycle model of the five stage pipeline in rtl/: fetch, decode,
+// execute, mem_access and wb. Each call of clock() works out what the
+// combinational logic of every stage produces from the pipeline registers
+// and then updates them, as one rising edge of clk would.
+//
+// The model follows the RTL where it differs from the functional model in
+// cpu.h: branch and jump targets are plain 32-bit sums and register values,
+// with no supervisor bit rule, and instructions are read when they are
+// fetched, so a store changes the code only for instructions fetched after
+// it reached mem_access. The RTL leaves the illegal instruction exception
+// unconnected; here an illegal opcode in decode does what fetch.v and the
+// INST_BNE_EXCEPT it was meant to pass on would do, saving PC + 4 in XP and
+// fetching from the illegal instruction vector.
+//
+class pipeline {
+public:
+    //
+    // What decode holds when it isn't an instruction: the NOP the pipeline
+    // starts with, or the NOP fetch put in place of the instruction after a
+    // taken branch, a JMP or a trap. With a predictor, that happens only
+    // where it went the wrong way, and also after a branch it wrongly
+    // predicted taken.
+    //
+    enum slot_kind {
+        INSTRUCTION, FILL, TAKEN_BEQ, TAKEN_BNE, JMP, TRAP, NOT_TAKEN
+    };
+    static const int NUM_SLOT_KINDS = NOT_TAKEN + 1;
+
+    //
+    // Where the cycles went. Every cycle either passes what decode holds on
+    // to execute or is a stall; a stall is a load-use hazard with the load
+    // in execute or mem_access. The last three cycles drain the pipeline.
+    // With caches, the cycles the whole pipeline waits for them on top of
+    // that are counted apart, by whether fetch or mem_access missed.
+    //
+    struct statistics {
+        uint64_t cycles_;
+        uint64_t instructions_;
+        uint64_t traps_;
+        uint64_t load_stalls_ex_;
+        uint64_t load_stalls_mem_;
+        uint64_t bubbles_[NUM_SLOT_KINDS];
+        uint64_t fetch_stalls_;
+        uint64_t data_stalls_;
+
+        //
+        // Instructions already counted by the checkpoint the pipeline was
+        // restored from, which took no cycles here.
+        //
+        uint64_t restored_instructions_;
+    };
+
+    pipeline(memory& m, uint32_t illop = beta::PC_ILLOP);
+
+    //
+    // Fetches from one memory and loads and stores to the other, like the
+    // i_mem and d_mem of testbench/core_tb.v.
+    //
+    pipeline(
+        memory& instructions,
+        memory& data,
+        uint32_t illop = beta::PC_ILLOP);
+
+    //
+    // Puts the pipeline in the state it has after rst: fetch at PC_RESET,
+    // NOPs in the other stages and the registers cleared.
+    //
+    void reset();
+
+    //
+    // Starts from the state of a checkpoint taken with the functional
+    // model: as after reset, but fetching at its PC with its registers.
+    // The instruction and trap counts go on from the checkpoint's, cycles
+    // are counted from here on.
+    //
+    void restore_state(const cpu::state& s);
+
+    //
+    // The state to checkpoint, once run() has returned and the pipeline
+    // has drained.
+    //
+    cpu::state save_state() const;
+
+    //
+    // Runs until the program stops or max_instructions more have left
+    // decode, then lets the instructions in execute, mem_access and wb
+    // finish. It also stops once max_cycles more cycles have gone by, with
+    // the pipeline as the RTL would have it then. 0 means no limit.
+    //
+    cpu::stop_reason run(uint64_t max_instructions, uint64_t max_cycles = 0);
+
+    //
+    // Address of the next instruction to leave decode.
+    //
+    uint32_t pc() const;
+
+    //
+    // Writes every register write to trace as wb makes it and every store
+    // as mem_access makes it, or stops if trace is NULL.
+    //
+    void set_trace(trace_writer* trace) { trace_ = trace; }
+
+    //
+    // Counts what each instruction costs in p, or stops if p is NULL. A
+    // stall is charged to the instruction held in decode, a bubble to the
+    // branch, JMP or trap that caused it.
+    //
+    void set_profile(profile* p) { profile_ = p; }
+
+    //
+    // Looks up every instruction fetch kept in instructions and every load
+    // and store in data, either of which can be NULL for memory as fast as
+    // core.v expects. The cycles a lookup costs hold up the whole pipeline,
+    // as a memory that isn't ready would, and are charged to the
+    // instruction fetched or to the load or store.
+    //
+    void set_caches(cache* instructions, cache* data)
+    {
+        icache_ = instructions;
+        dcache_ = data;
+    }
+
+    //
+    // Has fetch go where p predicts rather than on to PC + 4, or stops
+    // predicting if p is NULL.
+    //
+    void set_predictor(predictor* p) { predictor_ = p; }
+
+    //
+    // With wrap false, an instruction fetched from past the end of memory
+    // stops the run with FAULT when it would leave decode, and a load or
+    // store past the end when it would leave execute. A load or store goes
+    // back to decode, as if fetched again, so that pc() is left at it and
+    // nothing after it has run.
+    //
+    void set_wrap(bool wrap) { wrap_ = wrap; }
+
+    //
+    // With trap_unmapped true, an instruction fetched or a load from a page
+    // of memory that isn't mapped faults the same way. A store maps the
+    // page it writes when it leaves execute, so a load right behind it
+    // finds the page mapped, as it would in the functional model.
+    //
+    void set_trap_unmapped(bool trap_unmapped)
+    {
+        trap_unmapped_ = trap_unmapped;
+    }
+
+    uint32_t reg(int index) const { return regs_[index]; }
+    uint64_t instructions() const { return stats_.instructions_; }
+    uint64_t traps() const { return stats_.traps_; }
+    const statistics& stats() const { return stats_; }
+
+    //
+    // The address that stopped the last run with FAULT.
+    //
+    uint32_t fault_address() const { return fault_address_; }
+
+private:
+    //
+    // One rising edge of clk. With drain set decode holds what it has and
+    // passes a NOP on, as during a stall, and only the instructions already
+    // past decode move on.
+    //
+    void clock(bool drain);
+
+    memory& instructions_;
+    memory& data_;
+    uint32_t illop_;
+
+    uint32_t pc_fetch_;
+
+    uint32_t pc_decode_;
+    uint32_t ir_decode_;
+    slot_kind kind_decode_;
+
+    uint32_t pc_exec_;
+    uint32_t ir_exec_;
+    uint32_t a_exec_;
+    uint32_t b_exec_;
+    uint32_t d_exec_;
+
+    uint32_t pc_mem_;
+    uint32_t ir_mem_;
+    uint32_t y_mem_;
+    uint32_t d_mem_;
+
+    uint32_t pc_wb_;
+    uint32_t ir_wb_;
+    uint32_t y_wb_;
+    uint32_t mem_rd_wb_;
+
+    uint32_t regs_[32];
+    statistics stats_;
+    trace_writer* trace_ = NULL;
+    profile* profile_ = NULL;
+    cache* icache_ = NULL;
+    cache* dcache_ = NULL;
+    predictor* predictor_ = NULL;
+    bool wrap_ = true;
+    bool trap_unmapped_ = false;
+
+    //
+    // Set by clock() when it passed on a branch, JMP or trap that settled
+    // into continuing at its own address.
+    //
+    bool looping_;
+
+    //
+    // Set by clock() when it sent a load or store back to decode.
+    //
+    bool faulted_;
+    uint32_t fault_address_ = 0;
+};
+
+#endif
\ No newline at end of file
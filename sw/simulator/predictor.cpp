@@ -0,0 +1,160 @@
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "beta.h"
+#include "predictor.h"
+
+using std::string;
+using std::vector;
+
+bool predictor::parse(
+    const string& spec,
+    scheme& scheme_out,
+    int& bits_out,
+    string& error_out)
+{
+    size_t colon = spec.find(':');
+    string name = spec.substr(0, colon);
+    int bits = 10;
+    bool bad = false;
+    if (colon != string::npos) {
+        char* end;
+        bits = strtol(spec.c_str() + colon + 1, &end, 10);
+        bad = *end != '\0' || end == spec.c_str() + colon + 1 || bits < 1
+                || bits > 24 || (name != "bimodal" && name != "gshare");
+    }
+
+    if (name == "none") {
+        scheme_out = NONE;
+    } else if (name == "static") {
+        scheme_out = STATIC;
+    } else if (name == "bimodal") {
+        scheme_out = BIMODAL;
+    } else if (name == "gshare") {
+        scheme_out = GSHARE;
+    } else {
+        bad = true;
+    }
+    if (bad) {
+        error_out = "bad predictor " + spec + ", expected none, static, "
+                "bimodal[:bits] or gshare[:bits]\n";
+        return false;
+    }
+    bits_out = bits;
+    return true;
+}
+
+predictor::predictor(
+    scheme s,
+    int bits,
+    uint32_t btb_entries) :
+        scheme_(s), bits_(bits),
+        counters_(s == BIMODAL || s == GSHARE ? 1u << bits : 0),
+        btb_(btb_entries)
+{
+    reset();
+}
+
+void predictor::reset()
+{
+    //
+    // Counters start out weakly not taken.
+    //
+    for (auto& c : counters_) {
+        c = 1;
+    }
+    for (auto& e : btb_) {
+        e = btb_entry();
+    }
+    history_ = 0;
+    stats_ = statistics();
+}
+
+uint32_t predictor::counter_index(
+    uint32_t pc) const
+{
+    uint32_t index = pc >> 2;
+    if (scheme_ == GSHARE) {
+        index ^= history_;
+    }
+    return index & (counters_.size() - 1);
+}
+
+uint32_t predictor::predict(
+    uint32_t pc,
+    uint32_t ir) const
+{
+    int op = beta::opcode(ir);
+    if (op == beta::JMP && !btb_.empty()) {
+        const btb_entry& e = btb_[(pc >> 2) & (btb_.size() - 1)];
+        return e.valid_ && e.pc_ == pc ? e.target_ : pc + 4;
+    }
+    if (op != beta::BEQ && op != beta::BNE) {
+        return pc + 4;
+    }
+
+    int32_t literal = beta::literal(ir);
+    bool taken;
+    switch (scheme_) {
+        case STATIC: taken = literal < 0; break;
+        case BIMODAL:
+        case GSHARE: taken = counters_[counter_index(pc)] >= 2; break;
+        default: taken = false; break;
+    }
+    return taken ? pc + 4 + 4 * literal : pc + 4;
+}
+
+void predictor::update(
+    uint32_t pc,
+    uint32_t ir,
+    uint32_t predicted,
+    uint32_t next)
+{
+    int op = beta::opcode(ir);
+    bool right = predicted == next;
+    bool taken = next != pc + 4;
+    if (right && taken) {
+        stats_.bubbles_avoided_++;
+    } else if (!right && !taken) {
+        stats_.bubbles_added_++;
+    }
+
+    if (op == beta::JMP) {
+        stats_.jumps_++;
+        stats_.jumps_right_ += right;
+        if (!btb_.empty()) {
+            btb_[(pc >> 2) & (btb_.size() - 1)] = { pc, next, true };
+        }
+        return;
+    }
+    if (op != beta::BEQ && op != beta::BNE) {
+        return;
+    }
+
+    stats_.branches_++;
+    stats_.branches_right_ += right;
+    if (!counters_.empty()) {
+        uint8_t& c = counters_[counter_index(pc)];
+        if (taken) {
+            c += c < 3;
+        } else {
+            c -= c > 0;
+        }
+        history_ = (history_ << 1 | taken) & (counters_.size() - 1);
+    }
+}
+
+string predictor::describe() const
+{
+    static const char* names[] = { "none", "static", "bimodal", "gshare" };
+    string text = names[scheme_];
+    if (!counters_.empty()) {
+        text += ", " + std::to_string(counters_.size()) + " counters";
+    }
+    if (!btb_.empty()) {
+        text += ", " + std::to_string(btb_.size()) + " entry BTB";
+    }
+    return text;
+}
\ No newline at end of file
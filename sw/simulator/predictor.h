@@ -0,0 +1,105 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+//
+// Branch prediction for fetch in the pipeline model. fetch.v always goes
+// on to PC + 4, so every taken BEQ, BNE and JMP costs the bubble decode
+// makes when it finds out. Here fetch asks the predictor where to go
+// next instead, and decode only makes a bubble when that was wrong.
+//
+// The target of a BEQ or BNE comes from its literal, as a predecoder
+// beside fetch would work it out; the scheme only picks the direction.
+// STATIC takes backward branches and not forward ones, BIMODAL has a two
+// bit counter for each branch address and GSHARE indexes its counters with
+// the address xored with the outcomes of the last branches. A JMP, whose
+// target is in a register, goes where the BTB says it went last time, if
+// there is a BTB; otherwise it is predicted to go on to PC + 4.
+//
+class predictor {
+public:
+    enum scheme { NONE, STATIC, BIMODAL, GSHARE };
+
+    //
+    // How the predictions did, and the bubbles they saved: avoided is the
+    // taken branches and JMPs predicted right, each of which would have
+    // cost a bubble going on to PC + 4, and added the branches predicted
+    // taken that weren't.
+    //
+    struct statistics {
+        uint64_t branches_;
+        uint64_t branches_right_;
+        uint64_t jumps_;
+        uint64_t jumps_right_;
+        uint64_t bubbles_avoided_;
+        uint64_t bubbles_added_;
+    };
+
+    //
+    // Reads "none", "static", "bimodal" or "gshare", the last two with an
+    // optional ":bits" for the log2 of their counters, 10 by default.
+    //
+    static bool parse(
+        const string& spec,
+        scheme& scheme_out,
+        int& bits_out,
+        string& error_out);
+
+    //
+    // btb_entries is a power of two, or 0 for no BTB.
+    //
+    predictor(scheme s, int bits, uint32_t btb_entries);
+    predictor(const predictor&) = delete;
+    predictor& operator=(const predictor&) = delete;
+
+    //
+    // Forgets what was learned and clears the counts.
+    //
+    void reset();
+
+    //
+    // Where fetch goes after fetching ir from pc.
+    //
+    uint32_t predict(uint32_t pc, uint32_t ir) const;
+
+    //
+    // Tells the predictor that ir at pc, which fetch followed with
+    // predicted, continued at next.
+    //
+    void update(
+        uint32_t pc,
+        uint32_t ir,
+        uint32_t predicted,
+        uint32_t next);
+
+    //
+    // A line such as "gshare, 1024 counters, 64 entry BTB".
+    //
+    string describe() const;
+
+    const statistics& stats() const { return stats_; }
+
+private:
+    struct btb_entry {
+        uint32_t pc_;
+        uint32_t target_;
+        bool valid_;
+    };
+
+    uint32_t counter_index(uint32_t pc) const;
+
+    scheme scheme_;
+    int bits_;
+    vector<uint8_t> counters_;
+    uint32_t history_;
+    vector<btb_entry> btb_;
+    statistics stats_;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+#include <algorithm>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../assembler/line_map.h"
+#include "memory.h"
+#include "profile.h"
+
+using std::endl;
+using std::pair;
+using std::string;
+using std::vector;
+
+profile::profile(
+    const memory& m) :
+        memory_(m), pages_((m.size() / 4 + PAGE_WORDS - 1) / PAGE_WORDS)
+{
+}
+
+profile::counts* profile::make_page(
+    uint32_t index)
+{
+    unique_ptr<counts[]>& page = pages_[index >> PAGE_BITS];
+    page.reset(new counts[PAGE_WORDS]());
+    made_.push_back(index >> PAGE_BITS);
+    return page.get();
+}
+
+void profile::clear()
+{
+    for (auto page : made_) {
+        pages_[page].reset();
+    }
+    made_.clear();
+}
+
+//
+// Every instruction with counts, in increasing order of address.
+//
+vector<profile::entry> profile::entries() const
+{
+    vector<uint32_t> made = made_;
+    std::sort(made.begin(), made.end());
+    vector<entry> result;
+    for (auto page : made) {
+        const counts* c = pages_[page].get();
+        for (uint32_t i = 0; i < PAGE_WORDS; ++i) {
+            if (c[i].cycles() != 0 || c[i].misses_ != 0) {
+                result.push_back({ ((page << PAGE_BITS) | i) * 4, c[i] });
+            }
+        }
+    }
+    return result;
+}
+
+static string frame_label(
+    const line_map& lines,
+    int frame)
+{
+    const line_map::frame& f = lines.frames()[frame];
+    string label = lines.files()[f.file_] + ":" + std::to_string(f.line_);
+    if (!f.name_.empty()) {
+        label += " " + f.name_;
+    }
+    return label;
+}
+
+static string address_label(
+    uint32_t address)
+{
+    char label[16];
+    snprintf(label, sizeof(label), "0x%08x", address);
+    return label;
+}
+
+void profile::write_report(
+    ostream& os,
+    const line_map* lines,
+    uint64_t total_cycles) const
+{
+    vector<entry> all = entries();
+    uint64_t attributed = 0;
+    for (auto const& e : all) {
+        attributed += e.counts_.cycles();
+    }
+    os << total_cycles << " cycles, " << attributed
+            << " spent on instructions" << endl;
+    char line[128];
+
+    if (lines != NULL) {
+        //
+        // A line's cycles are those of the instructions assembled by it
+        // or by the macros it calls; self only counts the former.
+        //
+        struct line_total {
+            uint64_t cycles_;
+            uint64_t self_;
+            counts counts_;
+        };
+        std::map<pair<int, int>, line_total> totals;
+        for (auto const& e : all) {
+            vector<pair<int, int>> seen;
+            int frame = lines->find(e.address_);
+            for (int f = frame; f >= 0; f = lines->frames()[f].parent_) {
+                pair<int, int> key(lines->frames()[f].file_,
+                        lines->frames()[f].line_);
+                if (std::find(seen.begin(), seen.end(), key) != seen.end()) {
+                    continue;
+                }
+                seen.push_back(key);
+                line_total& t = totals[key];
+                t.cycles_ += e.counts_.cycles();
+                t.self_ += f == frame ? e.counts_.cycles() : 0;
+                t.counts_.executed_ += e.counts_.executed_;
+                t.counts_.load_stalls_ += e.counts_.load_stalls_;
+                t.counts_.bubbles_ += e.counts_.bubbles_;
+                t.counts_.memory_stalls_ += e.counts_.memory_stalls_;
+                t.counts_.misses_ += e.counts_.misses_;
+            }
+        }
+
+        vector<pair<pair<int, int>, line_total>> sorted(totals.begin(),
+                totals.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                [](auto const& a, auto const& b) {
+                    return a.second.cycles_ > b.second.cycles_;
+                });
+
+        os << endl << "source lines, by cycles including the macros they "
+                "call" << endl;
+        os << "    cycles      self  executed  load-use   bubbles    memory"
+                "    misses  line" << endl;
+        for (auto const& [key, t] : sorted) {
+            snprintf(line, sizeof(line), "%10" PRIu64 "%10" PRIu64
+                    "%10" PRIu64 "%10" PRIu64 "%10" PRIu64 "%10" PRIu64
+                    "%10" PRIu64 "  ", t.cycles_, t.self_,
+                    t.counts_.executed_, t.counts_.load_stalls_,
+                    t.counts_.bubbles_, t.counts_.memory_stalls_,
+                    t.counts_.misses_);
+            os << line << lines->files()[key.first] << ":" << key.second
+                    << endl;
+        }
+    }
+
+    std::stable_sort(all.begin(), all.end(),
+            [](const entry& a, const entry& b) {
+                return a.counts_.cycles() > b.counts_.cycles();
+            });
+    os << endl << "instructions, by cycles" << endl;
+    os << "   address    cycles  executed  load-use   bubbles    memory"
+            "    misses  line" << endl;
+    for (auto const& e : all) {
+        snprintf(line, sizeof(line), "0x%08x%10" PRIu64 "%10" PRIu64
+                "%10" PRIu64 "%10" PRIu64 "%10" PRIu64 "%10" PRIu64 "  ",
+                e.address_, e.counts_.cycles(), e.counts_.executed_,
+                e.counts_.load_stalls_, e.counts_.bubbles_,
+                e.counts_.memory_stalls_, e.counts_.misses_);
+        int frame = lines != NULL ? lines->find(e.address_) : -1;
+        os << line << (frame >= 0 ? frame_label(*lines, frame) : "")
+                << endl;
+    }
+}
+
+void profile::write_collapsed(
+    ostream& os,
+    const line_map* lines) const
+{
+    std::map<string, uint64_t> stacks;
+    for (auto const& e : entries()) {
+        int frame = lines != NULL ? lines->find(e.address_) : -1;
+        if (frame < 0) {
+            stacks[address_label(e.address_)] += e.counts_.cycles();
+            continue;
+        }
+        vector<int> chain;
+        for (int f = frame; f >= 0; f = lines->frames()[f].parent_) {
+            chain.push_back(f);
+        }
+        string stack;
+        for (size_t i = chain.size(); i-- > 0;) {
+            stack += frame_label(*lines, chain[i]);
+            stack += i > 0 ? ";" : "";
+        }
+        stacks[stack] += e.counts_.cycles();
+    }
+    for (auto const& [stack, cycles] : stacks) {
+        os << stack << " " << cycles << endl;
+    }
+}
\ No newline at end of file
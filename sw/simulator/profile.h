@@ -0,0 +1,100 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "../assembler/line_map.h"
+#include "memory.h"
+
+using std::ostream;
+using std::unique_ptr;
+using std::vector;
+
+//
+// Counts for each instruction of a program run on the pipeline model: the
+// times it left decode, the load-use stall cycles it spent waiting there
+// and the bubbles it caused as a branch, JMP or trap that fetch didn't
+// follow. Each of those is a cycle of decode. With caches, the cycles the
+// pipeline waited for them to fetch the instruction or to load or store
+// for it add to those, and the misses are counted too. The cycles together
+// are what the instruction cost. As in decode_cache, the counts are kept
+// in pages made when code in them first runs, so counting costs an index
+// and an add.
+//
+// A line map from the assembler folds the counts back onto source lines
+// and the macro calls that led to them.
+//
+class profile {
+public:
+    struct counts {
+        uint64_t executed_;
+        uint64_t load_stalls_;
+        uint64_t bubbles_;
+        uint64_t memory_stalls_;
+        uint64_t misses_;
+
+        uint64_t cycles() const
+        {
+            return executed_ + load_stalls_ + bubbles_ + memory_stalls_;
+        }
+    };
+
+    static const int PAGE_BITS = 10;
+    static const uint32_t PAGE_WORDS = 1u << PAGE_BITS;
+
+    //
+    // Counts instructions fetched from m.
+    //
+    profile(const memory& m);
+    profile(const profile&) = delete;
+    profile& operator=(const profile&) = delete;
+
+    counts& at(uint32_t pc)
+    {
+        uint32_t index = memory_.word_index(pc);
+        counts* page = pages_[index >> PAGE_BITS].get();
+        if (page == NULL) {
+            page = make_page(index);
+        }
+        return page[index & (PAGE_WORDS - 1)];
+    }
+
+    void clear();
+
+    //
+    // Lists the source lines by the cycles spent in them and the macros
+    // they call, then the instructions by their cycles. Without a map only
+    // the instructions are listed. total_cycles is that of the whole run,
+    // which also has cycles no instruction is to blame for, such as those
+    // filling and draining the pipeline.
+    //
+    void write_report(
+        ostream& os,
+        const line_map* lines,
+        uint64_t total_cycles) const;
+
+    //
+    // Writes a line for each call stack with the cycles spent in it, the
+    // collapsed form flamegraph.pl reads. Without a map each instruction
+    // is a stack of its own.
+    //
+    void write_collapsed(ostream& os, const line_map* lines) const;
+
+private:
+    struct entry {
+        uint32_t address_;
+        counts counts_;
+    };
+
+    counts* make_page(uint32_t index);
+    vector<entry> entries() const;
+
+    const memory& memory_;
+    vector<unique_ptr<counts[]>> pages_;
+    vector<uint32_t> made_;
+};
+
+#endif
\ No newline at end of file
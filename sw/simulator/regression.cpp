@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "cpu.h"
+#include "memory.h"
+#include "loader.h"
+#include "pipeline.h"
+#include "regression.h"
+
+using std::atomic;
+using std::endl;
+using std::string;
+using std::string_view;
+using std::thread;
+using std::vector;
+
+bool regression::parse(
+    string_view text,
+    vector<test>& tests_out,
+    string& error_out)
+{
+    test t = {};
+    size_t offset = 0;
+    string_view word = loader::next_word(text, offset);
+    uint64_t value;
+
+    while (!word.empty()) {
+        if (word != "TEST"
+                || !loader::parse_number(loader::next_word(text, offset),
+                        10, value)) {
+            error_out = tests_out.empty() ? "expected TEST\n"
+                    : "expected TEST after test "
+                            + std::to_string(t.number_) + "\n";
+            return false;
+        }
+        t.number_ = value;
+        string where = "test " + std::to_string(t.number_) + ": ";
+
+        word = loader::next_word(text, offset);
+        if (word == "WAIT") {
+            if (!loader::parse_number(loader::next_word(text, offset), 10,
+                    t.wait_)) {
+                error_out = where + "bad WAIT\n";
+                return false;
+            }
+            word = loader::next_word(text, offset);
+        }
+
+        //
+        // Values are decimal and may be negative, strtoull wraps those
+        // around the way $fscanf does.
+        //
+        if (word == "RF") {
+            for (int i = 0; i < 32; ++i) {
+                if (!loader::parse_number(loader::next_word(text, offset),
+                        10, value)) {
+                    error_out = where + "bad RF\n";
+                    return false;
+                }
+                t.rf_[i] = value;
+            }
+            word = loader::next_word(text, offset);
+        }
+
+        uint64_t num_words;
+        if (word != "NUM_INST"
+                || !loader::parse_number(loader::next_word(text, offset),
+                        10, num_words)
+                || loader::next_word(text, offset) != "INST") {
+            error_out = where + "expected NUM_INST and INST\n";
+            return false;
+        }
+        if (num_words > MEMORY_SIZE / 4) {
+            error_out = where + "more instructions than fit in memory\n";
+            return false;
+        }
+        t.words_.clear();
+        for (uint64_t i = 0; i < num_words; ++i) {
+            if (!loader::parse_number(loader::next_word(text, offset), 16,
+                    value) || value > 0xFFFFFFFF) {
+                error_out = where + "bad instruction\n";
+                return false;
+            }
+            t.words_.push_back(value);
+        }
+        tests_out.push_back(t);
+        word = loader::next_word(text, offset);
+    }
+    return true;
+}
+
+//
+// Each worker has its own memories and pipeline and takes the next test
+// nobody has started yet, so a slow test holds up only its own worker.
+//
+bool regression::run(
+    const vector<test>& tests,
+    int jobs,
+    vector<result>& results_out,
+    string& error_out)
+{
+    results_out.assign(tests.size(), result());
+    atomic<size_t> next(0);
+
+    jobs = std::max(1, std::min(jobs, (int)tests.size()));
+    vector<string> errors(jobs);
+
+    auto worker = [&](int index) {
+        memory instructions;
+        memory data;
+        if (!instructions.allocate(MEMORY_SIZE, errors[index])
+                || !data.allocate(MEMORY_SIZE, errors[index])) {
+            return;
+        }
+        pipeline p(instructions, data);
+
+        for (size_t i = next++; i < tests.size(); i = next++) {
+            const test& t = tests[i];
+            result& r = results_out[i];
+
+            instructions.clear();
+            data.clear();
+            for (size_t j = 0; j < t.words_.size(); ++j) {
+                instructions.write(j * 4, t.words_[j]);
+            }
+            p.reset();
+            r.reason_ = t.wait_ == 0 ? cpu::LIMIT : p.run(0, t.wait_);
+            r.cycles_ = p.stats().cycles_;
+            r.passed_ = true;
+            for (int k = 0; k < 32; ++k) {
+                r.rf_[k] = p.reg(k);
+                r.passed_ = r.passed_ && r.rf_[k] == t.rf_[k];
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int i = 0; i < jobs; ++i) {
+        workers.emplace_back(worker, i);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    for (auto const& error : errors) {
+        if (!error.empty()) {
+            error_out = error;
+            return false;
+        }
+    }
+    return true;
+}
+
+int regression::report(
+    const vector<test>& tests,
+    const vector<result>& results,
+    ostream& out)
+{
+    static const char* reasons[] = {
+        "halted", "looping", "still running", "faulted"
+    };
+    char line[80];
+    int failed = 0;
+
+    for (size_t i = 0; i < tests.size(); ++i) {
+        const test& t = tests[i];
+        const result& r = results[i];
+        if (r.passed_ && r.reason_ != cpu::LIMIT) {
+            continue;
+        }
+
+        out << "test " << t.number_ << (r.passed_ ? " passed, " : " FAILED, ")
+                << reasons[r.reason_] << " after " << r.cycles_ << " cycles"
+                << endl;
+        for (int k = 0; k < 32; ++k) {
+            if (r.rf_[k] != t.rf_[k]) {
+                snprintf(line, sizeof(line), "    R%-2d expected 0x%08x, "
+                        "got 0x%08x", k, t.rf_[k], r.rf_[k]);
+                out << line << endl;
+            }
+        }
+        failed += !r.passed_;
+    }
+    out << tests.size() << " tests, " << failed << " failed" << endl;
+    return failed;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cpu.h"
+
+using std::ostream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+//
+// Runs the tests of testbench/testcases.txt on the pipeline model the way
+// core_tb.v runs them on the RTL: the instructions go into an instruction
+// memory of MEMORY_SIZE bytes, the data memory and registers start out
+// clear, and after WAIT cycles the registers are compared with RF. A test
+// stops early once it halts or settles into a loop, such as the BR(.)
+// every test ends with, so a generous WAIT costs nothing. The tests are
+// shared out between worker threads.
+//
+class regression {
+public:
+    static const uint64_t MEMORY_SIZE = 4096;
+
+    struct test {
+        int number_;
+        uint64_t wait_;
+        uint32_t rf_[32];
+        vector<uint32_t> words_;
+    };
+
+    struct result {
+        cpu::stop_reason reason_;
+        uint64_t cycles_;
+        uint32_t rf_[32];
+        bool passed_;
+    };
+
+    //
+    // Reads the tests in text. As in core_tb.v, a test without WAIT or RF
+    // keeps the one of the test before it.
+    //
+    static bool parse(
+        string_view text,
+        vector<test>& tests_out,
+        string& error_out);
+
+    //
+    // Runs every test on up to jobs threads. results_out is in the order
+    // of tests.
+    //
+    static bool run(
+        const vector<test>& tests,
+        int jobs,
+        vector<result>& results_out,
+        string& error_out);
+
+    //
+    // Prints the tests that failed, with the registers that differ, those
+    // that were still running when their WAIT ran out, and a summary line.
+    // Returns the number of failures.
+    //
+    static int report(
+        const vector<test>& tests,
+        const vector<result>& results,
+        ostream& out);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../beta.h"
+#include "../memory.h"
+#include "../cpu.h"
+#include "../pipeline.h"
+#include "../checkpoint.h"
+
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+//
+// Checks of the simulator that testbench/testcases.txt doesn't cover. Each
+// test returns what went wrong, or an empty string if it passed.
+//
+struct test {
+    const char* name_;
+    string (*run_)();
+};
+
+static const uint64_t MEMORY_SIZE = 4096;
+
+//
+// A loop that counts in R1 and traps on an illegal instruction every time
+// around, the handler at PC_ILLOP going straight back:
+//
+//     0x00  BR(loop)
+//     0x04  NOP
+//     0x08  JMP(XP)
+//     0x0C  loop: ADDC(R1, 1, R1)
+//     0x10  illegal
+//     0x14  BR(loop)
+//
+static const uint32_t TRAP_LOOP[] = {
+    0x73FF0002, beta::INST_NOP, 0x6FFE0000, 0xC0210001, 0x04000000,
+    0x73FFFFFD
+};
+
+static void load(
+    memory& m,
+    const uint32_t* words,
+    size_t num_words)
+{
+    m.clear();
+    for (size_t i = 0; i < num_words; ++i) {
+        m.write(i * 4, words[i]);
+    }
+}
+
+template <typename model>
+static string compare(
+    const char* what,
+    const cpu& expected,
+    const model& actual)
+{
+    char line[128];
+    if (actual.instructions() != expected.instructions()
+            || actual.traps() != expected.traps()) {
+        snprintf(line, sizeof(line), "%s: %llu instructions and %llu "
+                "traps, expected %llu and %llu\n", what,
+                (unsigned long long)actual.instructions(),
+                (unsigned long long)actual.traps(),
+                (unsigned long long)expected.instructions(),
+                (unsigned long long)expected.traps());
+        return line;
+    }
+    for (int i = 0; i < 32; ++i) {
+        if (actual.reg(i) != expected.reg(i)) {
+            snprintf(line, sizeof(line), "%s: R%d is 0x%08x, expected "
+                    "0x%08x\n", what, i, actual.reg(i), expected.reg(i));
+            return line;
+        }
+    }
+    return "";
+}
+
+//
+// A checkpoint saved by the functional model part way through and restored
+// into either model carries on with the same instruction and trap counts
+// as a run that never stopped, and so does a checkpoint saved after the
+// restore.
+//
+static string test_restore_counts()
+{
+    string error;
+    memory m;
+    if (!m.allocate(MEMORY_SIZE, error)) {
+        return error;
+    }
+    load(m, TRAP_LOOP, sizeof(TRAP_LOOP) / sizeof(TRAP_LOOP[0]));
+
+    cpu straight(m);
+    straight.set_dispatch(cpu::SWITCH, error);
+    straight.reset();
+    straight.run(300);
+    cpu::state at_300 = straight.save_state();
+    straight.run(100);
+
+    string filename = "/tmp/simulator_tests."
+            + std::to_string(getpid()) + ".ckpt";
+    checkpoint saved;
+    bool opened = checkpoint::save(filename, at_300, m, error)
+            && saved.open(filename, error);
+    remove(filename.c_str());
+    if (!opened) {
+        return error;
+    }
+
+    cpu c(m);
+    c.set_dispatch(cpu::SWITCH, error);
+    if (!saved.restore(m, error)) {
+        return error;
+    }
+    c.restore_state(saved.cpu_state());
+    c.run(100);
+    string result = compare("functional model", straight, c);
+    if (!result.empty()) {
+        return result;
+    }
+
+    pipeline p(m);
+    if (!saved.restore(m, error)) {
+        return error;
+    }
+    p.restore_state(saved.cpu_state());
+    p.run(100);
+    result = compare("pipeline", straight, p);
+    if (!result.empty()) {
+        return result;
+    }
+
+    cpu::state again = p.save_state();
+    if (again.instructions_ != straight.instructions()
+            || again.traps_ != straight.traps()) {
+        return "checkpoint of the restored pipeline has the wrong counts\n";
+    }
+    return "";
+}
+
+//
+// Stores to a page nothing was loaded into, loads it back straight after
+// and then loads from a page that is still untouched:
+//
+//     0x00  ADDC(R31, 5, R1)
+//     0x04  ST(R1, 0x1000, R31)
+//     0x08  LD(R31, 0x1000, R2)
+//     0x0C  LD(R31, 0x2000, R3)
+//     0x10  HALT()
+//
+static const uint32_t UNMAPPED_LOAD[] = {
+    0xC03F0005, 0x643F1000, 0x605F1000, 0x607F2000, beta::INST_HALT
+};
+
+template <typename model>
+static string check_unmapped(
+    const char* what,
+    model& c,
+    memory& m)
+{
+    load(m, UNMAPPED_LOAD, sizeof(UNMAPPED_LOAD) / sizeof(UNMAPPED_LOAD[0]));
+    m.map_pages(0, sizeof(UNMAPPED_LOAD));
+    c.set_trap_unmapped(true);
+    c.reset();
+    cpu::stop_reason reason = c.run(0);
+    if (reason != cpu::FAULT || c.fault_address() != 0x2000
+            || c.pc() != 0x8000000C || c.instructions() != 3 || c.reg(2) != 5) {
+        char line[128];
+        snprintf(line, sizeof(line), "%s: stopped %d at 0x%08x on 0x%08x "
+                "after %llu instructions, R2 0x%08x\n", what, (int)reason,
+                c.pc(), c.fault_address(),
+                (unsigned long long)c.instructions(), c.reg(2));
+        return line;
+    }
+    return "";
+}
+
+//
+// With unmapped pages trapping, a store maps its page, so a load right
+// behind it runs, while a load from a page nothing touched faults in both
+// models.
+//
+static string test_unmapped_load()
+{
+    string error;
+    memory m;
+    if (!m.allocate(4 * MEMORY_SIZE, error)) {
+        return error;
+    }
+    cpu c(m);
+    c.set_dispatch(cpu::SWITCH, error);
+    string result = check_unmapped("functional model", c, m);
+    if (!result.empty()) {
+        return result;
+    }
+    pipeline p(m);
+    return check_unmapped("pipeline", p, m);
+}
+
+static const test TESTS[] = {
+    { "restore counts", test_restore_counts },
+    { "unmapped load", test_unmapped_load },
+};
+
+int main()
+{
+    int failed = 0;
+    for (auto const& t : TESTS) {
+        string error = t.run_();
+        if (!error.empty()) {
+            cout << t.name_ << " FAILED: " << error;
+            failed++;
+        }
+    }
+    size_t num_tests = sizeof(TESTS) / sizeof(TESTS[0]);
+    cout << num_tests << " tests, " << failed << " failed" << endl;
+    return failed == 0 ? 0 : -1;
+}
\ No newline at end of file
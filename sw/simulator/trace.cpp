@@ -0,0 +1,426 @@
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "beta.h"
+#include "trace.h"
+
+using std::endl;
+using std::string;
+using std::unique_lock;
+using std::vector;
+
+const char trace_codec::MAGIC[8] = { 'B', 'E', 'T', 'A', 'T', 'R', 'C', '1' };
+
+static const uint8_t STORE_BIT = 0x80;
+static const uint8_t PC_BIT = 0x40;
+static const uint8_t RC_MASK = 0x1F;
+
+static size_t put_varint(
+    uint32_t difference,
+    uint8_t* out)
+{
+    uint32_t value = (difference << 1) ^ (uint32_t)((int32_t)difference >> 31);
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+//
+// Returns the number of bytes read, 0 if the varint runs past end.
+//
+static size_t get_varint(
+    const uint8_t* in,
+    const uint8_t* end,
+    uint32_t& difference_out)
+{
+    uint32_t value = 0;
+    for (size_t n = 0; n < 5 && in + n < end; ++n) {
+        value |= (uint32_t)(in[n] & 0x7F) << (7 * n);
+        if ((in[n] & 0x80) == 0) {
+            difference_out = (value >> 1) ^ (0u - (value & 1));
+            return n + 1;
+        }
+    }
+    return 0;
+}
+
+trace_codec::trace_codec() :
+        pc_(beta::PC_RESET - 4), address_(0), data_(0)
+{
+    memset(regs_, 0, sizeof(regs_));
+}
+
+size_t trace_codec::encode(
+    const trace_record& r,
+    uint8_t* out)
+{
+    size_t n = 1;
+    uint32_t expected = pc_ + 4;
+    out[0] = r.kind_ == trace_record::STORE ? STORE_BIT : r.rc_ & RC_MASK;
+    if (r.pc_ != expected) {
+        out[0] |= PC_BIT;
+        n += put_varint(r.pc_ - expected, out + n);
+    }
+    pc_ = r.pc_;
+
+    if (r.kind_ == trace_record::STORE) {
+        n += put_varint(r.address_ - address_, out + n);
+        n += put_varint(r.data_ - data_, out + n);
+        address_ = r.address_;
+        data_ = r.data_;
+    } else {
+        n += put_varint(r.data_ - regs_[r.rc_ & RC_MASK], out + n);
+        regs_[r.rc_ & RC_MASK] = r.data_;
+    }
+    return n;
+}
+
+size_t trace_codec::decode(
+    const uint8_t* in,
+    size_t size,
+    trace_record& r_out)
+{
+    const uint8_t* end = in + size;
+    const uint8_t* p = in + 1;
+    uint32_t pc = pc_ + 4;
+    uint32_t difference;
+    size_t n;
+
+    if (size == 0) {
+        return 0;
+    }
+    if (in[0] & PC_BIT) {
+        if ((n = get_varint(p, end, difference)) == 0) {
+            return 0;
+        }
+        pc += difference;
+        p += n;
+    }
+
+    trace_record r = {};
+    r.pc_ = pc;
+    if (in[0] & STORE_BIT) {
+        uint32_t address_difference;
+        if ((n = get_varint(p, end, address_difference)) == 0) {
+            return 0;
+        }
+        p += n;
+        if ((n = get_varint(p, end, difference)) == 0) {
+            return 0;
+        }
+        p += n;
+        r.kind_ = trace_record::STORE;
+        r.address_ = address_ + address_difference;
+        r.data_ = data_ + difference;
+        address_ = r.address_;
+        data_ = r.data_;
+    } else {
+        if ((n = get_varint(p, end, difference)) == 0) {
+            return 0;
+        }
+        p += n;
+        r.kind_ = trace_record::REGISTER;
+        r.rc_ = in[0] & RC_MASK;
+        r.data_ = regs_[r.rc_] + difference;
+        regs_[r.rc_] = r.data_;
+    }
+    pc_ = pc;
+    r_out = r;
+    return p - in;
+}
+
+trace_writer::~trace_writer()
+{
+    string error;
+    close(error);
+}
+
+bool trace_writer::open(
+    const string& filename,
+    string& error_out)
+{
+    file_ = fopen(filename.c_str(), "wb");
+    if (file_ == NULL) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+    filename_ = filename;
+    fwrite(trace_codec::MAGIC, sizeof(trace_codec::MAGIC), 1, file_);
+    chunk_.reserve(CHUNK_RECORDS);
+    closing_ = false;
+    failed_ = false;
+    thread_ = thread(&trace_writer::write_chunks, this);
+    return true;
+}
+
+bool trace_writer::close(
+    string& error_out)
+{
+    if (file_ == NULL) {
+        return true;
+    }
+    hand_off();
+    {
+        unique_lock<mutex> lock(mutex_);
+        closing_ = true;
+    }
+    changed_.notify_all();
+    thread_.join();
+
+    bool failed = failed_ || ferror(file_) != 0;
+    failed = fclose(file_) != 0 || failed;
+    file_ = NULL;
+    if (failed) {
+        error_out = "unable to write " + filename_ + "\n";
+    }
+    return !failed;
+}
+
+//
+// Passes the records collected so far to the thread and starts a new
+// chunk, waiting if the thread is too far behind.
+//
+void trace_writer::hand_off()
+{
+    if (chunk_.empty()) {
+        return;
+    }
+    unique_lock<mutex> lock(mutex_);
+    changed_.wait(lock, [&] { return full_.size() < MAX_CHUNKS; });
+    full_.push_back(std::move(chunk_));
+    if (empty_.empty()) {
+        chunk_ = vector<trace_record>();
+        chunk_.reserve(CHUNK_RECORDS);
+    } else {
+        chunk_ = std::move(empty_.back());
+        empty_.pop_back();
+    }
+    lock.unlock();
+    changed_.notify_all();
+}
+
+//
+// The thread: encodes each chunk into a buffer and writes it.
+//
+void trace_writer::write_chunks()
+{
+    trace_codec codec;
+    vector<uint8_t> buffer(CHUNK_RECORDS * trace_codec::MAX_RECORD_BYTES);
+
+    for (;;) {
+        vector<trace_record> chunk;
+        {
+            unique_lock<mutex> lock(mutex_);
+            changed_.wait(lock, [&] { return !full_.empty() || closing_; });
+            if (full_.empty()) {
+                return;
+            }
+            chunk = std::move(full_.front());
+            full_.pop_front();
+        }
+        changed_.notify_all();
+
+        size_t n = 0;
+        for (auto const& r : chunk) {
+            n += codec.encode(r, &buffer[n]);
+        }
+        bool written = fwrite(buffer.data(), 1, n, file_) == n;
+
+        chunk.clear();
+        unique_lock<mutex> lock(mutex_);
+        empty_.push_back(std::move(chunk));
+        failed_ = failed_ || !written;
+    }
+}
+
+trace_reader::~trace_reader()
+{
+    if (file_ != NULL) {
+        fclose(file_);
+    }
+}
+
+bool trace_reader::open(
+    const string& filename,
+    string& error_out)
+{
+    file_ = fopen(filename.c_str(), "rb");
+    if (file_ == NULL) {
+        error_out = "unable to open " + filename + "\n";
+        return false;
+    }
+    filename_ = filename;
+    buffer_.resize(BUFFER_SIZE);
+
+    char magic[sizeof(trace_codec::MAGIC)];
+    size_t n = fread(magic, 1, sizeof(magic), file_);
+    text_ = n != sizeof(magic)
+            || memcmp(magic, trace_codec::MAGIC, sizeof(magic)) != 0;
+    if (text_) {
+        rewind(file_);
+    }
+    return true;
+}
+
+//
+// Moves what is left of the buffer to its start and reads more after it.
+//
+void trace_reader::fill()
+{
+    memmove(buffer_.data(), buffer_.data() + start_, end_ - start_);
+    end_ -= start_;
+    start_ = 0;
+    size_t n = fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_);
+    end_ += n;
+}
+
+bool trace_reader::next(
+    trace_record& r_out)
+{
+    if (!error_.empty()) {
+        return false;
+    }
+
+    if (text_) {
+        char kind;
+        unsigned pc;
+        unsigned where;
+        unsigned data;
+        int fields = fscanf(file_, " %c %x %x %x", &kind, &pc, &where, &data);
+        if (fields == EOF) {
+            return false;
+        }
+        if (fields != 4 || (kind != 'R' && kind != 'S')
+                || (kind == 'R' && where > 31)) {
+            error_ = filename_ + " has a bad record\n";
+            return false;
+        }
+        trace_record r = {};
+        r.pc_ = pc;
+        r.kind_ = kind == 'S' ? trace_record::STORE : trace_record::REGISTER;
+        r.rc_ = kind == 'S' ? 0 : where;
+        r.address_ = kind == 'S' ? where : 0;
+        r.data_ = data;
+        r_out = r;
+        return true;
+    }
+
+    size_t n = codec_.decode(&buffer_[start_], end_ - start_, r_out);
+    if (n == 0 && end_ - start_ < trace_codec::MAX_RECORD_BYTES) {
+        fill();
+        n = codec_.decode(&buffer_[start_], end_ - start_, r_out);
+    }
+    if (n == 0) {
+        if (start_ != end_) {
+            error_ = filename_ + " has a bad or unfinished record\n";
+        }
+        return false;
+    }
+    start_ += n;
+    return true;
+}
+
+static void print_record(
+    const trace_record& r,
+    uint64_t index,
+    const char* mark,
+    ostream& out)
+{
+    char line[80];
+    if (r.kind_ == trace_record::STORE) {
+        snprintf(line, sizeof(line), "%s%12" PRIu64 "  0x%08x  "
+                "mem[0x%08x] <- 0x%08x", mark, index, r.pc_, r.address_,
+                r.data_);
+    } else {
+        snprintf(line, sizeof(line), "%s%12" PRIu64 "  0x%08x  "
+                "R%-2d <- 0x%08x", mark, index, r.pc_, r.rc_, r.data_);
+    }
+    out << line << endl;
+}
+
+static bool same(
+    const trace_record& a,
+    const trace_record& b)
+{
+    return a.pc_ == b.pc_ && a.kind_ == b.kind_ && a.rc_ == b.rc_
+            && a.address_ == b.address_ && a.data_ == b.data_;
+}
+
+//
+// Prints what follows a difference in one trace, starting with the
+// record that differs, if there is one.
+//
+static void print_after(
+    trace_reader& t,
+    const string& name,
+    bool have_first,
+    const trace_record& first,
+    uint64_t index,
+    int context,
+    ostream& out)
+{
+    out << name << ":" << endl;
+    if (!have_first) {
+        out << "  > (end of trace)" << endl;
+        return;
+    }
+    print_record(first, index, "  > ", out);
+    trace_record r;
+    for (int i = 0; i < context && t.next(r); ++i) {
+        print_record(r, index + 1 + i, "    ", out);
+    }
+}
+
+bool diff_traces(
+    trace_reader& a,
+    const string& name_a,
+    trace_reader& b,
+    const string& name_b,
+    int context,
+    ostream& out)
+{
+    //
+    // The last context records, which both traces agree on.
+    //
+    vector<trace_record> before(context > 0 ? context : 1);
+    uint64_t index = 0;
+    trace_record ra;
+    trace_record rb;
+
+    for (;; ++index) {
+        bool have_a = a.next(ra);
+        bool have_b = b.next(rb);
+        if (!a.error().empty() || !b.error().empty()) {
+            out << a.error() << b.error();
+            return false;
+        }
+        if (!have_a && !have_b) {
+            out << "traces match, " << index << " records" << endl;
+            return true;
+        }
+        if (have_a && have_b && same(ra, rb)) {
+            before[index % before.size()] = ra;
+            continue;
+        }
+
+        out << "traces differ at record " << index << endl;
+        uint64_t first = index > (uint64_t)context ? index - context : 0;
+        for (uint64_t i = first; i < index; ++i) {
+            print_record(before[i % before.size()], i, "    ", out);
+        }
+        print_after(a, name_a, have_a, ra, index, context, out);
+        print_after(b, name_b, have_b, rb, index, context, out);
+        return false;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,197 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::condition_variable;
+using std::deque;
+using std::mutex;
+using std::ostream;
+using std::string;
+using std::thread;
+using std::vector;
+
+//
+// One change to the architectural state: a register write, other than to
+// R31, or a store, with the address of the instruction that made it.
+// Instructions that change neither, such as branches that write R31 and the
+// NOPs the pipeline makes, leave no record. That way the RTL, which can't
+// tell a NOP in the program from one it made, the pipeline model and the
+// functional model all give the same trace for the same program.
+//
+struct trace_record {
+    enum record_kind { REGISTER, STORE };
+
+    uint32_t pc_;
+    uint8_t kind_;
+    uint8_t rc_;
+    uint32_t address_;
+    uint32_t data_;
+};
+
+//
+// A trace file starts with MAGIC and then has one record after another,
+// each encoded against the ones before it:
+//
+//     byte    bit 7 set for a store, bit 6 set if the PC isn't 4 more
+//             than that of the record before, bits 4:0 the register
+//     varint  the PC less the expected one, if bit 6 is set
+//     varint  register: the value less what was last written to it
+//             store: the address less that of the last store, then the
+//             data less that of the last store
+//
+// Varints hold the difference zigzag encoded, 7 bits to a byte with the
+// low bits first and bit 7 set in all but the last byte. Everything
+// starts out as zero, the PC as PC_RESET - 4.
+//
+// The text form, written by testbench/core_tb.v, has a line for each
+// record: "R pc register data" or "S pc address data", all in hex.
+//
+class trace_codec {
+public:
+    static const char MAGIC[8];
+    static const size_t MAX_RECORD_BYTES = 16;
+
+    trace_codec();
+
+    //
+    // Encodes r into out, which must have room for MAX_RECORD_BYTES, and
+    // returns the number of bytes written.
+    //
+    size_t encode(const trace_record& r, uint8_t* out);
+
+    //
+    // Decodes the record at in, which has size bytes. Returns the number
+    // of bytes read, or 0 if the record is cut short.
+    //
+    size_t decode(const uint8_t* in, size_t size, trace_record& r_out);
+
+private:
+    uint32_t pc_;
+    uint32_t regs_[32];
+    uint32_t address_;
+    uint32_t data_;
+};
+
+//
+// Writes a trace file. Records are collected in chunks that a thread of
+// the writer encodes and writes out, so the simulation only copies each
+// record once. At most MAX_CHUNKS wait at a time; a simulation faster
+// than the disk waits for them.
+//
+class trace_writer {
+public:
+    static const size_t CHUNK_RECORDS = 1 << 16;
+    static const size_t MAX_CHUNKS = 4;
+
+    trace_writer() = default;
+    trace_writer(const trace_writer&) = delete;
+    trace_writer& operator=(const trace_writer&) = delete;
+    ~trace_writer();
+
+    bool open(const string& filename, string& error_out);
+
+    //
+    // Writes the records still in memory and closes the file. Fails if
+    // anything couldn't be written.
+    //
+    bool close(string& error_out);
+
+    void write_register(uint32_t pc, int rc, uint32_t data)
+    {
+        add({ pc, trace_record::REGISTER, (uint8_t)rc, 0, data });
+    }
+
+    void write_store(uint32_t pc, uint32_t address, uint32_t data)
+    {
+        add({ pc, trace_record::STORE, 0, address, data });
+    }
+
+private:
+    void add(const trace_record& r)
+    {
+        chunk_.push_back(r);
+        if (chunk_.size() == CHUNK_RECORDS) {
+            hand_off();
+        }
+    }
+
+    void hand_off();
+    void write_chunks();
+
+    FILE* file_ = NULL;
+    string filename_;
+    vector<trace_record> chunk_;
+
+    //
+    // Shared with the thread: chunks waiting to be written, emptied ones
+    // to use again, and whether anything failed.
+    //
+    thread thread_;
+    mutex mutex_;
+    condition_variable changed_;
+    deque<vector<trace_record>> full_;
+    vector<vector<trace_record>> empty_;
+    bool closing_ = false;
+    bool failed_ = false;
+};
+
+//
+// Reads a trace file in either form, a buffer at a time.
+//
+class trace_reader {
+public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    trace_reader() = default;
+    trace_reader(const trace_reader&) = delete;
+    trace_reader& operator=(const trace_reader&) = delete;
+    ~trace_reader();
+
+    bool open(const string& filename, string& error_out);
+
+    //
+    // Reads the next record. Returns false at the end of the trace or if
+    // the rest of it can't be read, see error().
+    //
+    bool next(trace_record& r_out);
+
+    const string& error() const { return error_; }
+
+private:
+    void fill();
+
+    FILE* file_ = NULL;
+    string filename_;
+    bool text_ = false;
+    trace_codec codec_;
+    vector<uint8_t> buffer_;
+    size_t start_ = 0;
+    size_t end_ = 0;
+    string error_;
+};
+
+//
+// Compares two traces record by record, keeping no more than context
+// records of either in memory. At the first difference it prints the
+// records leading up to it and those that follow in each trace, and
+// stops. Returns true if the traces are the same.
+//
+bool diff_traces(
+    trace_reader& a,
+    const string& name_a,
+    trace_reader& b,
+    const string& name_b,
+    int context,
+    ostream& out);
+
+#endif
\ No newline at end of file
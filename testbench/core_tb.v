@@ -77,6 +77,39 @@ core dut(
     .d_mem_oe(d_mem_oe)
 );
 
+//
+// Commit trace, written when the simulation is run with +trace=<file>:
+// every register write wb makes and every store, with the address of the
+// instruction, in the text form sw/simulator/trace.h describes. Compare it
+// with one from the simulator using simulator --diff.
+//
+integer trace_file = 0;
+string trace_name;
+
+initial begin
+    if ($value$plusargs("trace=%s", trace_name)) begin
+        trace_file = $fopen(trace_name, "w");
+    end
+end
+
+//
+// The instruction in wb is older than the one in mem_access, so its write
+// goes first.
+//
+always @(posedge clk) begin
+    if (trace_file && !rst) begin
+        if (dut.rf_we && dut.rf_w_addr != 5'd31) begin
+            $fdisplay(trace_file, "R %h %h %h", dut.wb0.pc_wb - 32'd4,
+                      dut.rf_w_addr, dut.rf_w_data);
+        end
+        if (d_mem_we) begin
+            $fdisplay(trace_file, "S %h %h %h",
+                      dut.mem_access0.pc_mem - 32'd4, d_mem_w_addr,
+                      d_mem_w_data);
+        end
+    end
+end
+
 integer i;
 initial begin
     for (i = 0; i < 32; i++) begin
@@ -89,17 +122,48 @@ begin
     for (i = 0; i < 32 - 1; i++) begin
         dut.decode0.rf.mem[i] = 32'd0;
     end
-    for (i = 0; i < MEM_SIZE - 1; i++) begin
+    for (i = 0; i < MEM_SIZE; i++) begin
         i_mem[i] = 32'd0;
         d_mem[i] = 32'd0;
     end
 end
 endtask
 
+//
+// With +hex=<file> the testbench runs that program instead of the test
+// cases. The file is written by assembler -f hex; it skips long runs of
+// zeros with @N addresses, so memory is cleared before it is loaded into
+// both memories. The core then runs for +cycles=<n> cycles, 10000 unless
+// given.
+//
+string hex_name;
+
 initial begin
-    process_file();
+    if ($value$plusargs("hex=%s", hex_name)) begin
+        run_hex();
+    end else begin
+        process_file();
+    end
 end
 
+task run_hex;
+    int cycles;
+
+    if (!$value$plusargs("cycles=%d", cycles)) begin
+        cycles = 10000;
+    end
+    clear_mem();
+    $readmemh(hex_name, i_mem);
+    $readmemh(hex_name, d_mem);
+    reset();
+    wait_cycles(cycles);
+
+    if (trace_file) begin
+        $fclose(trace_file);
+    end
+    $stop;
+endtask
+
 initial begin
     $dumpfile("core_tb.vcd");
     $dumpvars(0, core_tb);